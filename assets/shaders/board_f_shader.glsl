@@ -0,0 +1,63 @@
+out vec4 frag_color;
+in vec2 local;
+flat in uint kind;
+flat in uint style;
+flat in vec2 half_size;
+
+uniform float zoom;
+
+// by sys::wire_colors
+const vec3 wire_colors[10] = vec3[10](
+	vec3(1.0f, 0.749f, 0.0f),     // amber
+	vec3(0.2f, 0.8f, 0.2f),       // green
+	vec3(0.9f, 0.2f, 0.2f),       // red
+	vec3(0.251f, 0.4f, 1.0f),     // blue
+	vec3(0.502f, 0.8f, 1.0f),     // sky blue
+	vec3(0.6f, 0.349f, 0.902f),   // violet
+	vec3(1.0f, 0.502f, 0.749f),   // pink
+	vec3(0.702f, 1.0f, 0.2f),     // lime
+	vec3(0.0f, 0.6f, 0.6f),       // teal
+	vec3(0.949f, 0.949f, 0.949f)  // white
+);
+const vec4 part_color = vec4(0.851f, 0.851f, 0.8f, 1.0f);
+const vec4 module_fill = vec4(0.2196f, 0.251f, 0.2706f, 1.0f);
+
+void main() {
+	// half the width of a wire, so that the leads of a component meet the wires at its pins
+	float lead = max(0.0625, 1.0 / zoom);
+
+	if(kind == 3u) {
+		frag_color = vec4(wire_colors[min(style, 9u)], 1.0f);
+		return;
+	}
+	if(kind == 4u) { // filled, with a border two pixels wide
+		vec2 inside = half_size - abs(local);
+		frag_color = min(inside.x, inside.y) * zoom < 2.0 ? part_color : module_fill;
+		return;
+	}
+
+	float x = local.x;
+	float y = local.y;
+	// the lead from the input pin to the output pin
+	bool drawn = abs(y) <= lead;
+	if(kind == 0u) {
+		// a diode: a triangle pointing at the output, with a bar across its tip
+		drawn = drawn || (x >= -0.3 && x <= 0.3 && abs(y) <= (0.3 - x) * 0.7);
+		drawn = drawn || (x > 0.3 && x <= 0.3 + 2.0 * lead && abs(y) <= 0.42);
+	} else {
+		// a transistor: a ring around the lead, and a lead from the control pin to the ring; an enable low transistor
+		// has a small ring, its inverting bubble, between the two
+		float r = length(local);
+		drawn = drawn || (r <= 0.4 && r >= 0.4 - 2.0 * lead);
+		float control_from = 0.4;
+		if(kind == 2u) {
+			float b = length(local - vec2(0.0, 0.52));
+			drawn = drawn || (b <= 0.12 && b >= 0.12 - 2.0 * lead);
+			control_from = 0.64;
+		}
+		drawn = drawn || (abs(x) <= lead && y >= control_from);
+	}
+	if(!drawn)
+		discard;
+	frag_color = part_color;
+}
@@ -0,0 +1,51 @@
+// per instance; see board_instance in board_renderer.hpp
+layout (location = 0) in ivec4 ends; // in grid points
+layout (location = 1) in uvec2 kind_style;
+// in cells from the center of the part; for a component, +x points to its output pin and +y to its control pin
+out vec2 local;
+flat out uint kind;
+flat out uint style;
+flat out vec2 half_size; // module instances only, in cells
+
+// the board position (grid points times zoom) of the top left corner of the screen
+uniform vec2 origin;
+// the size of a cell on the screen
+uniform float zoom;
+uniform vec2 screen_size;
+
+// by sys::orientation, on a screen whose y axis points down
+const vec2 directions[4] = vec2[4](vec2(1.0, 0.0), vec2(0.0, 1.0), vec2(-1.0, 0.0), vec2(0.0, -1.0));
+
+void main() {
+	// the four corners of a triangle strip
+	vec2 corner = vec2(float(gl_VertexID & 1), float(gl_VertexID >> 1)) * 2.0 - 1.0;
+	vec2 start = vec2(ends.xy);
+	vec2 end = vec2(ends.zw);
+	kind = kind_style.x;
+	style = kind_style.y;
+	local = vec2(0.0);
+	half_size = vec2(0.0);
+
+	vec2 position;
+	if(kind == 3u) { // a wire segment: a line from start to end with square caps, at least a pixel wide
+		float half_width = max(0.0625, 1.0 / zoom);
+		vec2 along = end - start;
+		float len = length(along);
+		vec2 dir = len > 0.0 ? along / len : vec2(1.0, 0.0);
+		vec2 across = vec2(-dir.y, dir.x);
+		position = (corner.x < 0.0 ? start - dir * half_width : end + dir * half_width) + across * (corner.y * half_width);
+	} else if(kind == 4u) { // a module instance: the cells from start to end
+		half_size = (end - start) * 0.5 + 0.5;
+		local = corner * half_size;
+		position = (start + end) * 0.5 + local;
+	} else { // a component: its cell and the leads to the pins on either side of it
+		position = start + corner;
+		local = vec2(dot(corner, directions[style & 3u]), dot(corner, directions[(style + 3u) & 3u]));
+	}
+
+	vec2 screen = position * zoom - origin;
+	gl_Position = vec4(
+		-1.0 + (2.0 * screen.x / screen_size.x),
+		 1.0 - (2.0 * screen.y / screen_size.y),
+		0.0, 1.0);
+}
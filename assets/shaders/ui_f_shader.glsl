@@ -1,14 +1,18 @@
 out vec4 frag_color;
 in vec2 tex_coord;
 
+// set by the vertex shader, from its uniforms or from the instance being drawn
+in ui_parameters {
+	flat vec4 d_rect;
+	flat vec4 subrect;
+	flat vec3 inner_color;
+	flat float border_size;
+	flat uvec2 subroutines_index;
+};
+
 uniform float screen_width;
 uniform float screen_height;
-uniform vec4 d_rect;
-uniform float border_size;
-uniform vec3 inner_color;
-uniform vec4 subrect;
 uniform float gamma;
-uniform uvec2 subroutines_index;
 
 uniform sampler2D texture_sampler;
 uniform sampler2D secondary_texture_sampler;
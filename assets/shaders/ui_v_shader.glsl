@@ -1,6 +1,20 @@
 layout (location = 0) in vec2 vertex_position; //0
 layout (location = 1) in vec2 v_tex_coord; //1
+// per instance, when drawing a batch of sprites (see sprite_instance in opengl_wrapper.hpp)
+layout (location = 2) in vec4 instance_d_rect;
+layout (location = 3) in vec4 instance_subrect;
+layout (location = 4) in vec4 instance_inner_color; // border_size in w
+layout (location = 5) in uvec2 instance_subroutines;
+layout (location = 6) in uint instance_square;
 out vec2 tex_coord;
+// passed on to the fragment shader, from the uniforms or from the instance
+out ui_parameters {
+	flat vec4 d_rect;
+	flat vec4 subrect;
+	flat vec3 inner_color;
+	flat float border_size;
+	flat uvec2 subroutines_index;
+} parameters;
 
 uniform float screen_width;
 uniform float screen_height;
@@ -10,13 +24,41 @@ uniform float screen_height;
 // d_rect.z - width
 // d_rect.w - height
 uniform vec4 d_rect;
+uniform vec4 subrect;
+uniform vec3 inner_color;
+uniform float border_size;
+uniform uvec2 subroutines_index;
+// set while drawing a batch of sprites, which ignores the uniforms above and the vertex buffer
+uniform bool batched;
+// the four vertices (position, then texture coordinates) of each square, by square_index
+uniform vec4 square_vertices[48];
 
 void main() {
+	vec2 position;
+	vec4 rect;
+	if(batched) {
+		vec4 vertex = square_vertices[instance_square * 4u + uint(gl_VertexID)];
+		position = vertex.xy;
+		tex_coord = vertex.zw;
+		rect = instance_d_rect;
+		parameters.subrect = instance_subrect;
+		parameters.inner_color = instance_inner_color.xyz;
+		parameters.border_size = instance_inner_color.w;
+		parameters.subroutines_index = instance_subroutines;
+	} else {
+		position = vertex_position;
+		tex_coord = v_tex_coord;
+		rect = d_rect;
+		parameters.subrect = subrect;
+		parameters.inner_color = inner_color;
+		parameters.border_size = border_size;
+		parameters.subroutines_index = subroutines_index;
+	}
+	parameters.d_rect = rect;
 	// Transform the d_rect rectangle to screen space coordinates
 	// vertex_position is used to flip and/or rotate the coordinates
 	gl_Position = vec4(
-		-1.0 + (2.0 * ((vertex_position.x * d_rect.z)  + d_rect.x) / screen_width),
-		 1.0 - (2.0 * ((vertex_position.y * d_rect.w)  + d_rect.y) / screen_height),
+		-1.0 + (2.0 * ((position.x * rect.z)  + rect.x) / screen_width),
+		 1.0 - (2.0 * ((position.y * rect.w)  + rect.y) / screen_height),
 		0.0, 1.0);
-	tex_coord = v_tex_coord;
 }
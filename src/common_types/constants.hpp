@@ -1,23 +1,10 @@
 #pragma once
 #include <stdint.h>
 #include <iterator>
+#include "constants_dcon.hpp"
 
 namespace sys {
 
-enum class wire_colors : uint8_t {
-	amber = 0,
-	green = 1,
-	red = 2,
-	blue = 3,
-	sky_blue = 4,
-	violet = 5,
-	pink = 6,
-	lime = 7,
-	teal = 8,
-	white = 9
-};
-constexpr inline uint8_t max_wire_color = 9;
-
 enum class basic_component_type : uint8_t {
 	diode, enable_high_transistor, enable_low_transistor
 };
@@ -203,9 +190,9 @@ constexpr inline size_t ui_scales_count = std::size(ui_scales);
 
 enum class autosave_frequency : uint8_t {
 	none = 0,
-	yearly = 1,
-	monthly = 2,
-	daily = 3,
+	rarely = 1,    // every five minutes
+	regularly = 2, // every minute
+	often = 3,     // every ten seconds
 };
 
 constexpr inline int32_t max_autosaves = 16;
@@ -1,4 +1,5 @@
 #pragma once
+#include <stdint.h>
 
 // CONSTANTS WHICH ARE USED IN DCON DIRECTLY
 
@@ -8,6 +9,30 @@ inline constexpr int32_t max_issue_options = 6;
 
 namespace sys {
 
+enum class wire_colors : uint8_t {
+	amber = 0,
+	green = 1,
+	red = 2,
+	blue = 3,
+	sky_blue = 4,
+	violet = 5,
+	pink = 6,
+	lime = 7,
+	teal = 8,
+	white = 9
+};
+constexpr inline uint8_t max_wire_color = 9;
+
+// the direction a placed component faces: its output pin lies one grid step in this direction,
+// its input pin one step behind it, and (for transistors) its control pin one step to its left
+enum class orientation : uint8_t {
+	right = 0,
+	down = 1,
+	left = 2,
+	up = 3
+};
+constexpr inline uint8_t max_orientation = 3;
+
 constexpr int32_t max_event_options = 8;
 constexpr uint32_t max_gamerule_settings = 15;
 
@@ -0,0 +1,95 @@
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <type_traits>
+#include <cassert>
+
+// a bounded queue that any number of threads may push into while a single thread consumes it. each slot carries a
+// sequence number saying whether it is free to write for the current lap around the ring or holds a value ready to
+// read, so producers only contend on claiming a position and never on each other's writes
+//
+// the consumer side has the interface of rigtorp::SPSCQueue: front to peek, pop to release
+
+namespace concurrency_tools {
+
+template<typename T>
+class mpsc_queue {
+	static_assert(std::is_trivially_copyable_v<T>, "values are copied in and out of the slots");
+
+	struct slot {
+		std::atomic<uint64_t> sequence;
+		T value;
+	};
+
+	std::unique_ptr<slot[]> slots;
+	uint64_t mask = 0;
+	alignas(64) std::atomic<uint64_t> write_position = 0;
+	alignas(64) std::atomic<uint64_t> read_position = 0; // written only by the consumer
+
+public:
+	// the capacity is rounded up to a power of two
+	explicit mpsc_queue(size_t capacity) {
+		size_t size = 1;
+		while(size < capacity)
+			size <<= 1;
+		slots = std::make_unique<slot[]>(size);
+		mask = size - 1;
+		for(size_t i = 0; i < size; ++i)
+			slots[i].sequence.store(i, std::memory_order::relaxed);
+	}
+
+	mpsc_queue(mpsc_queue const&) = delete;
+	mpsc_queue& operator=(mpsc_queue const&) = delete;
+
+	// may be called from any thread; fails if the queue is full
+	[[nodiscard]] bool try_push(T const& v) noexcept {
+		auto position = write_position.load(std::memory_order::relaxed);
+		while(true) {
+			auto& s = slots[position & mask];
+			auto sequence = s.sequence.load(std::memory_order::acquire);
+			auto lap = int64_t(sequence - position);
+			if(lap == 0) {
+				if(write_position.compare_exchange_weak(position, position + 1, std::memory_order::relaxed)) {
+					s.value = v;
+					s.sequence.store(position + 1, std::memory_order::release);
+					return true;
+				}
+			} else if(lap < 0) {
+				return false; // the slot still holds the value from the previous lap
+			} else {
+				position = write_position.load(std::memory_order::relaxed);
+			}
+		}
+	}
+
+	// consumer only: the oldest value, or null if there is none yet. a value whose producer has claimed its position
+	// but not finished writing holds back the ones after it
+	[[nodiscard]] T* front() noexcept {
+		auto position = read_position.load(std::memory_order::relaxed);
+		auto& s = slots[position & mask];
+		if(s.sequence.load(std::memory_order::acquire) != position + 1)
+			return nullptr;
+		return &s.value;
+	}
+	// consumer only, after front has returned a value
+	void pop() noexcept {
+		auto position = read_position.load(std::memory_order::relaxed);
+		auto& s = slots[position & mask];
+		assert(s.sequence.load(std::memory_order::relaxed) == position + 1);
+		s.sequence.store(position + mask + 1, std::memory_order::release);
+		read_position.store(position + 1, std::memory_order::release);
+	}
+
+	// the number of positions claimed and not yet consumed, including those still being written
+	[[nodiscard]] size_t size() const noexcept {
+		auto r = read_position.load(std::memory_order::acquire);
+		auto w = write_position.load(std::memory_order::acquire);
+		return w > r ? size_t(w - r) : 0;
+	}
+	[[nodiscard]] size_t capacity() const noexcept {
+		return size_t(mask + 1);
+	}
+};
+
+} // namespace concurrency_tools
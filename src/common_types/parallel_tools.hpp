@@ -0,0 +1,23 @@
+#pragma once
+#include <stdint.h>
+#ifdef _WIN32
+#include <ppl.h>
+#else
+#include <oneapi/tbb/parallel_for.h>
+#endif
+
+// work stealing parallel loops: the windows build uses the concurrency runtime that ships with msvc,
+// everything else links the bundled tbb
+
+namespace concurrency_tools {
+
+template<typename F>
+void parallel_for(uint32_t first, uint32_t last, F&& f) {
+#ifdef _WIN32
+	concurrency::parallel_for(first, last, f);
+#else
+	tbb::parallel_for(first, last, f);
+#endif
+}
+
+} // namespace concurrency_tools
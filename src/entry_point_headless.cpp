@@ -0,0 +1,218 @@
+#include <algorithm>
+#include <bit>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <span>
+#include <thread>
+#include <vector>
+#include "blake2.h"
+#include "system_state.hpp"
+#include "board_save.hpp"
+#include "state_hash.hpp"
+#include "simulation.hpp"
+#include "lane_simulation.hpp"
+
+// runs a saved board for a number of ticks as fast as possible and reports the tick rate and the state it ends in,
+// without creating a window or touching opengl, for benchmarking on machines without a display
+//
+// usage: MainHeadless <board file> [ticks] [--serial] [--no-tables] [--sweep <inputs> <outputs>]
+//   --serial     simulate the board as a single partition
+//   --no-tables  evaluate every component on its own instead of through logic tables
+//   --sweep      instead of running ticks, evaluates the board for every combination of the inputs with the lane
+//                simulation (see lane_simulation.hpp) and prints the outputs for each, or only their digest when there
+//                are too many to list. the inputs and outputs are grid points written x,y and separated by slashes,
+//                such as 0,0/0,4. on a board without feedback some of the vectors are then run again through the
+//                event driven simulation, which must agree with the sweep
+// two runs of the same board for the same number of ticks print the same state hash exactly when they end in the
+// same state, whatever the options; two sweeps of the same board print the same digest
+
+static sys::state game_state; // too big for the stack
+
+static int usage(char const* program) {
+	std::fprintf(stderr, "usage: %s <board file> [ticks] [--serial] [--no-tables] [--sweep <inputs> <outputs>]\n", program);
+	return EXIT_FAILURE;
+}
+
+// a list of grid points written x,y and separated by slashes
+static bool parse_points(char const* text, std::vector<circuit::grid_point>& out) {
+	while(true) {
+		char* end = nullptr;
+		auto x = std::strtol(text, &end, 10);
+		if(end == text || *end != ',')
+			return false;
+		text = end + 1;
+		auto y = std::strtol(text, &end, 10);
+		if(end == text || x < INT16_MIN || x > INT16_MAX || y < INT16_MIN || y > INT16_MAX)
+			return false;
+		out.push_back(circuit::grid_point{ int16_t(x), int16_t(y) });
+		if(*end == 0)
+			return true;
+		if(*end != '/')
+			return false;
+		text = end + 1;
+	}
+}
+
+constexpr uint64_t max_listed_vectors = 256;
+constexpr uint64_t max_checked_vectors = 256;
+
+// must run on the thread that owns the game state; returns the number of vectors on which the event driven simulation
+// disagrees with the sweep
+static uint64_t run_sweep(std::span<circuit::grid_point const> inputs, std::span<circuit::grid_point const> outputs) {
+	auto start = std::chrono::steady_clock::now();
+	auto result = circuit::exhaustive_sweep(game_state, inputs, outputs);
+	auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	uint64_t unsettled = 0;
+	for(auto w : result.unsettled_bits)
+		unsettled += uint64_t(std::popcount(w));
+	std::printf("%llu vectors in %.3f ms, %llu unsettled\n", (unsigned long long)result.vector_count, seconds * 1000.0, (unsigned long long)unsettled);
+	if(result.vector_count <= max_listed_vectors) {
+		for(uint64_t v = 0; v < result.vector_count; ++v) {
+			for(uint32_t i = 0; i < result.input_count; ++i)
+				std::putchar(((v >> i) & 1) != 0 ? '1' : '0');
+			std::printf(" -> ");
+			for(uint32_t j = 0; j < result.output_count; ++j)
+				std::putchar(!result.settled(v) ? '?' : (result.output_high(j, v) ? '1' : '0'));
+			std::putchar('\n');
+		}
+	}
+	circuit::state_hash digest;
+	blake2b_state s;
+	blake2b_init(&s, digest.size());
+	blake2b_update(&s, result.output_bits.data(), result.output_bits.size() * sizeof(uint64_t));
+	blake2b_update(&s, result.unsettled_bits.data(), result.unsettled_bits.size() * sizeof(uint64_t));
+	blake2b_final(&s, digest.data(), digest.size());
+	std::printf("sweep digest: ");
+	for(auto b : digest)
+		std::printf("%02x", b);
+	std::printf("\n");
+
+	// the event driven simulation carries the state of a loop over from one vector to the next, where the sweep
+	// starts every vector from nothing, so the two only have to agree on a board without feedback
+	circuit::lane_program p;
+	circuit::compile_lane_program(game_state, p, inputs, outputs);
+	if(p.has_feedback) {
+		std::printf("the board has feedback; not checked against the event driven simulation\n");
+		return 0;
+	}
+
+	// only the inputs of the sweep may drive the board, as they are the only ones the sweep applies
+	std::vector<circuit::grid_point> driven;
+	for(auto& [key, high] : game_state.simulation.board_inputs)
+		driven.push_back(circuit::unpack_point(key));
+	for(auto pt : driven)
+		circuit::set_board_input(game_state, pt, false);
+
+	auto checked = std::min(result.vector_count, max_checked_vectors);
+	uint64_t mismatches = 0;
+	for(uint64_t k = 0; k < checked; ++k) {
+		auto v = k * result.vector_count / checked; // spread over the whole range
+		for(uint32_t i = 0; i < result.input_count; ++i)
+			circuit::set_board_input(game_state, inputs[i], ((v >> i) & 1) != 0);
+		for(uint32_t t = 0; t < circuit::lane_program::max_passes; ++t) {
+			game_state.single_game_tick();
+			if(game_state.simulation.last_tick_evaluations == 0)
+				break;
+		}
+		for(uint32_t j = 0; j < result.output_count; ++j) {
+			if(circuit::net_is_high(game_state, circuit::simulation_net_at(game_state, outputs[j])) != result.output_high(j, v)) {
+				if(mismatches == 0)
+					std::printf("first mismatch: vector %llu, output %u\n", (unsigned long long)v, j);
+				++mismatches;
+				break;
+			}
+		}
+	}
+	std::printf("%llu vectors checked against the event driven simulation, %llu mismatched\n", (unsigned long long)checked, (unsigned long long)mismatches);
+	return mismatches;
+}
+
+int main(int argc, char* argv[]) {
+	if(argc < 2)
+		return usage(argv[0]);
+
+	uint64_t ticks = 1000;
+	bool sweep = false;
+	std::vector<circuit::grid_point> sweep_inputs;
+	std::vector<circuit::grid_point> sweep_outputs;
+	for(int i = 2; i < argc; ++i) {
+		if(std::strcmp(argv[i], "--sweep") == 0) {
+			if(i + 2 >= argc || !parse_points(argv[i + 1], sweep_inputs) || !parse_points(argv[i + 2], sweep_outputs)) {
+				std::fprintf(stderr, "--sweep takes a list of inputs and a list of outputs, such as 0,0/0,4 8,2\n");
+				return usage(argv[0]);
+			}
+			if(sweep_inputs.size() > circuit::max_sweep_inputs) {
+				std::fprintf(stderr, "a sweep takes at most %u inputs\n", circuit::max_sweep_inputs);
+				return EXIT_FAILURE;
+			}
+			sweep = true;
+			i += 2;
+		} else if(std::strcmp(argv[i], "--serial") == 0) {
+			game_state.simulation.parallel = false;
+		} else if(std::strcmp(argv[i], "--no-tables") == 0) {
+			game_state.simulation.tables.enabled = false;
+		} else {
+			// anything else must be the tick count, all digits, so that a mistyped option is not read as zero ticks
+			char* end = nullptr;
+			ticks = std::strtoull(argv[i], &end, 10);
+			if(argv[i][0] < '0' || argv[i][0] > '9' || *end != 0) {
+				std::fprintf(stderr, "unrecognized argument %s\n", argv[i]);
+				return usage(argv[0]);
+			}
+		}
+	}
+
+	auto path = simple_fs::utf8_to_native(argv[1]);
+	auto separator = path.find_last_of(NATIVE("/") NATIVE_DIR_SEPARATORS);
+	auto directory = separator == native_string::npos ? simple_fs::directory(nullptr, NATIVE(".")) : simple_fs::directory(nullptr, path.substr(0, separator));
+	auto file = simple_fs::open_file(directory, separator == native_string::npos ? path : path.substr(separator + 1));
+	if(!file) {
+		std::fprintf(stderr, "could not open %s\n", argv[1]);
+		return EXIT_FAILURE;
+	}
+	auto contents = simple_fs::view_contents(*file);
+	if(!circuit::read_board(game_state, std::span<uint8_t const>(reinterpret_cast<uint8_t const*>(contents.data), size_t(contents.file_size)))) {
+		std::fprintf(stderr, "%s is not a valid board\n", argv[1]);
+		return EXIT_FAILURE;
+	}
+
+	if(sweep) {
+		uint64_t mismatches = 0;
+		std::thread sweep_thread([&]() { mismatches = run_sweep(sweep_inputs, sweep_outputs); });
+		sweep_thread.join();
+		return mismatches == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	using clock = std::chrono::steady_clock;
+	double structure_seconds = 0.0;
+	double tick_seconds = 0.0;
+	// the ticks run on a thread of their own, as they do under game_loop; the netlist and the levelization are
+	// compiled before the clock starts, so that the rate is that of the simulation alone
+	std::thread update_thread([&]() {
+		auto start = clock::now();
+		circuit::update_simulation_structure(game_state);
+		auto ticking = clock::now();
+		for(uint64_t i = 0; i < ticks; ++i)
+			game_state.single_game_tick();
+		auto end = clock::now();
+		structure_seconds = std::chrono::duration<double>(ticking - start).count();
+		tick_seconds = std::chrono::duration<double>(end - ticking).count();
+	});
+	update_thread.join();
+
+	auto components = game_state.simulation.component_count;
+	auto nets = uint32_t(game_state.simulation.net_value.size());
+	std::printf("%u components, %u nets, %zu partitions, %zu logic tables\n", components, nets, game_state.simulation.partitions.size(), game_state.simulation.tables.tables.size());
+	std::printf("structure: %.3f ms\n", structure_seconds * 1000.0);
+	std::printf("%llu ticks in %.3f s: %.1f ticks/s\n", (unsigned long long)ticks, tick_seconds, tick_seconds > 0.0 ? double(ticks) / tick_seconds : 0.0);
+
+	auto hash = circuit::full_state_hash(game_state);
+	std::printf("state hash: ");
+	for(auto b : hash)
+		std::printf("%02x", b);
+	std::printf("\n");
+	return EXIT_SUCCESS;
+}
@@ -24,6 +24,7 @@ int main(int argc, char* argv[]) {
 
 		window::create_window(game_state, window::creation_parameters{ 1024, 780, window::window_state::maximized, game_state.user_settings.prefer_fullscreen });
 		game_state.quit_signaled.store(true, std::memory_order_release);
+		game_state.wake_game_thread();
 
 		update_thread.join();
 
@@ -0,0 +1,416 @@
+#include <cstring>
+#include <algorithm>
+#include <optional>
+#include "zstd.h"
+#include "autosave.hpp"
+#include "board_save.hpp"
+#include "journal.hpp"
+#include "module.hpp"
+#include "netlist.hpp"
+#include "spatial_index.hpp"
+#include "simulation.hpp"
+#include "simple_fs.hpp"
+#include "system_state.hpp"
+
+namespace circuit {
+
+constexpr inline native_char const* autosave_slot_names[2] = { NATIVE("autosave_0.bin"), NATIVE("autosave_1.bin") };
+
+std::chrono::steady_clock::duration autosave_interval(sys::autosave_frequency f) {
+	switch(f) {
+	case sys::autosave_frequency::none:
+		break;
+	case sys::autosave_frequency::rarely:
+		return std::chrono::minutes(5);
+	case sys::autosave_frequency::regularly:
+		return std::chrono::minutes(1);
+	case sys::autosave_frequency::often:
+		return std::chrono::seconds(10);
+	}
+	return std::chrono::steady_clock::duration::max();
+}
+
+void autosave_part_changed(sys::state& state, board_item part) {
+	state.autosave_log.dirty_chunks.insert(anchor_chunk(state, part));
+}
+void autosave_inputs_changed(sys::state& state) {
+	state.autosave_log.inputs_dirty = true;
+}
+void autosave_mark_clean(sys::state& state) {
+	auto& a = state.autosave_log;
+	a.dirty_chunks.clear();
+	a.inputs_dirty = false;
+	a.saved_definitions = uint32_t(state.modules.definitions.size());
+}
+void autosave_board_replaced(sys::state& state) {
+	autosave_mark_clean(state);
+	state.autosave_log.needs_compaction = true;
+}
+
+//
+// delta records
+//
+// a record is, in the varints of the journal: the index of the first new module definition, the number of them and
+// each definition; then a flag and, if it is set, the number of board inputs and the packed point of each; then the
+// number of chunks and, for each, its packed coordinate, the number of parts belonging to it and each part
+//
+
+void write_autosave_definition(std::vector<uint8_t>& out, module_definition const& def) {
+	command::journal_write_varint(out, uint32_t(def.components.size()));
+	for(auto& m : def.components) {
+		command::journal_write_coordinate(out, m.x);
+		command::journal_write_coordinate(out, m.y);
+		command::journal_write_varint(out, uint32_t(m.orientation));
+		command::journal_write_varint(out, uint32_t(m.type));
+	}
+	command::journal_write_varint(out, uint32_t(def.wires.size()));
+	for(auto& w : def.wires) {
+		command::journal_write_coordinate(out, w.start_x);
+		command::journal_write_coordinate(out, w.start_y);
+		command::journal_write_coordinate(out, w.end_x);
+		command::journal_write_coordinate(out, w.end_y);
+		command::journal_write_varint(out, uint32_t(w.color));
+	}
+	command::journal_write_varint(out, uint32_t(def.ports.size()));
+	for(auto& p : def.ports) {
+		command::journal_write_coordinate(out, p.x);
+		command::journal_write_coordinate(out, p.y);
+		command::journal_write_varint(out, p.is_output ? 1 : 0);
+	}
+	command::journal_write_coordinate(out, def.width);
+	command::journal_write_coordinate(out, def.height);
+}
+
+void read_autosave_definition(command::journal_reader& r, module_definition& def) {
+	auto components = r.varint();
+	for(uint32_t i = 0; i < components && !r.failed; ++i) {
+		auto& m = def.components.emplace_back();
+		m.x = r.coordinate();
+		m.y = r.coordinate();
+		m.orientation = sys::orientation(r.varint());
+		m.type = sys::basic_component_type(r.varint());
+	}
+	auto wires = r.varint();
+	for(uint32_t i = 0; i < wires && !r.failed; ++i) {
+		auto& w = def.wires.emplace_back();
+		w.start_x = r.coordinate();
+		w.start_y = r.coordinate();
+		w.end_x = r.coordinate();
+		w.end_y = r.coordinate();
+		w.color = sys::wire_colors(r.varint());
+	}
+	auto ports = r.varint();
+	for(uint32_t i = 0; i < ports && !r.failed; ++i) {
+		auto& p = def.ports.emplace_back();
+		p.x = r.coordinate();
+		p.y = r.coordinate();
+		p.is_output = r.varint() != 0;
+	}
+	def.width = r.coordinate();
+	def.height = r.coordinate();
+}
+
+std::vector<uint8_t> write_autosave_delta(sys::state& state) {
+	auto& a = state.autosave_log;
+	std::vector<uint8_t> out;
+
+	// module definitions are only ever added
+	auto& definitions = state.modules.definitions;
+	command::journal_write_varint(out, a.saved_definitions);
+	command::journal_write_varint(out, uint32_t(definitions.size()) - a.saved_definitions);
+	for(auto i = a.saved_definitions; i < definitions.size(); ++i)
+		write_autosave_definition(out, definitions[i]);
+
+	command::journal_write_varint(out, a.inputs_dirty ? 1 : 0);
+	if(a.inputs_dirty) {
+		std::vector<uint32_t> inputs;
+		for(auto& bi : state.simulation.board_inputs) {
+			if(bi.second)
+				inputs.push_back(bi.first);
+		}
+		std::sort(inputs.begin(), inputs.end());
+		command::journal_write_varint(out, uint32_t(inputs.size()));
+		for(auto p : inputs)
+			command::journal_write_varint(out, p);
+	}
+
+	std::vector<uint32_t> chunks(a.dirty_chunks.begin(), a.dirty_chunks.end());
+	std::sort(chunks.begin(), chunks.end());
+	command::journal_write_varint(out, uint32_t(chunks.size()));
+	std::vector<board_item> parts;
+	for(auto chunk : chunks) {
+		parts_in_chunk(state, chunk, parts);
+		command::journal_write_varint(out, chunk);
+		command::journal_write_varint(out, uint32_t(parts.size()));
+		for(auto part : parts)
+			command::journal_write_part(out, describe_item(state, part));
+	}
+
+	autosave_mark_clean(state);
+	return out;
+}
+
+struct autosave_delta {
+	std::vector<module_definition> definitions;
+	bool has_inputs = false;
+	std::vector<uint32_t> inputs;
+	std::vector<uint32_t> chunks;
+	std::vector<uint32_t> chunk_ends; // for each chunk, one past its last part
+	std::vector<part_description> parts;
+};
+
+// everything is checked before anything is applied
+bool read_autosave_delta(sys::state& state, std::span<uint8_t const> data, autosave_delta& d) {
+	command::journal_reader r{ data };
+	auto first_definition = r.varint();
+	auto definition_count = r.varint();
+	if(r.failed || first_definition != state.modules.definitions.size())
+		return false;
+	for(uint32_t i = 0; i < definition_count && !r.failed; ++i) {
+		read_autosave_definition(r, d.definitions.emplace_back());
+		if(!r.failed && !module_definition_is_valid(d.definitions.back()))
+			return false;
+	}
+	auto total_definitions = first_definition + uint64_t(d.definitions.size());
+
+	d.has_inputs = r.varint() != 0;
+	if(d.has_inputs) {
+		auto count = r.varint();
+		for(uint32_t i = 0; i < count && !r.failed; ++i)
+			d.inputs.push_back(r.varint());
+	}
+
+	auto chunk_count = r.varint();
+	for(uint32_t i = 0; i < chunk_count && !r.failed; ++i) {
+		auto chunk = r.varint();
+		auto count = r.varint();
+		for(uint32_t j = 0; j < count && !r.failed; ++j) {
+			auto p = r.part();
+			if(pack_chunk(p.position.x >> spatial_index::chunk_bits, p.position.y >> spatial_index::chunk_bits) != chunk)
+				return false;
+			switch(p.kind) {
+			case item_kind::diode:
+			case item_kind::enable_high_transistor:
+			case item_kind::enable_low_transistor:
+				if(uint8_t(p.orientation) > sys::max_orientation)
+					return false;
+				break;
+			case item_kind::wire_segment:
+				if(uint8_t(p.color) > sys::max_wire_color)
+					return false;
+				break;
+			case item_kind::module_instance:
+				if(p.definition >= total_definitions)
+					return false;
+				break;
+			}
+			d.parts.push_back(p);
+		}
+		d.chunks.push_back(chunk);
+		d.chunk_ends.push_back(uint32_t(d.parts.size()));
+	}
+	return !r.failed && r.at_end();
+}
+
+void apply_autosave_delta(sys::state& state, autosave_delta& d) {
+	suspend_netlist(state);
+	for(auto& def : d.definitions) {
+		compile_module(def);
+		state.modules.definitions.push_back(std::move(def));
+	}
+
+	std::vector<board_item> parts;
+	uint32_t first = 0;
+	for(size_t i = 0; i < d.chunks.size(); ++i) {
+		parts_in_chunk(state, d.chunks[i], parts);
+		// from the highest index down, as in delete_region
+		for(auto j = parts.size(); j-- > 0; )
+			remove_item(state, parts[j]);
+		for(auto j = first; j < d.chunk_ends[i]; ++j)
+			place_described(state, d.parts[j]);
+		first = d.chunk_ends[i];
+	}
+
+	if(d.has_inputs) {
+		std::vector<uint32_t> cleared;
+		for(auto& bi : state.simulation.board_inputs) {
+			if(!std::binary_search(d.inputs.begin(), d.inputs.end(), bi.first))
+				cleared.push_back(bi.first);
+		}
+		for(auto p : cleared)
+			set_board_input(state, unpack_point(p), false);
+		for(auto p : d.inputs)
+			set_board_input(state, unpack_point(p), true);
+	}
+	resume_netlist(state);
+}
+
+//
+// writing
+//
+
+// the generation of the save in a slot file, or zero if there is none
+uint64_t autosave_slot_generation(std::optional<simple_fs::file> const& f) {
+	if(!f)
+		return 0;
+	auto contents = simple_fs::view_contents(*f);
+	autosave_file_header header;
+	if(contents.file_size < sizeof(header))
+		return 0;
+	std::memcpy(&header, contents.data, sizeof(header));
+	return header.magic == autosave_file_magic ? header.generation : 0;
+}
+
+void autosave_now(sys::state& state) {
+	auto& a = state.autosave_log;
+	if(a.writing.load(std::memory_order::acquire))
+		return;
+	if(a.writer.joinable())
+		a.writer.join();
+	a.last_save = std::chrono::steady_clock::now();
+
+	if(a.dirty_chunks.empty() && !a.inputs_dirty && a.saved_definitions == state.modules.definitions.size())
+		return;
+
+	auto directory = simple_fs::get_or_create_save_game_directory(simple_fs::get_mod_save_dir_name(state.common_fs));
+	a.writing.store(true, std::memory_order::release);
+	bool compact = a.needs_compaction || a.log_size > a.base_size;
+	// the board is gathered under the ui lock: the ui thread queries the spatial index while it holds it, and
+	// parts_in_chunk shares the scratch of those queries
+	board_snapshot snapshot;
+	std::vector<uint8_t> delta;
+	state.yield_ui_lock = true;
+	{
+		std::lock_guard lock(state.ui_lock);
+		if(compact) {
+			snapshot = snapshot_board(state);
+			autosave_mark_clean(state);
+		} else {
+			delta = write_autosave_delta(state);
+		}
+		state.yield_ui_lock = false;
+	}
+	state.ui_lock_cv.notify_one();
+
+	if(compact) {
+		a.needs_compaction = false;
+		if(a.generation == 0) { // the first autosave of the session must be newer than those of the last one
+			for(auto name : autosave_slot_names)
+				a.generation = std::max(a.generation, autosave_slot_generation(simple_fs::open_file(directory, name)));
+		}
+		++a.generation;
+		a.writer = std::thread([&a, directory, generation = a.generation, snapshot = std::move(snapshot)]() mutable {
+			auto image = encode_board(snapshot);
+			autosave_file_header header;
+			header.generation = generation;
+			header.base_size = image.size();
+			std::vector<uint8_t> file(sizeof(header) + image.size());
+			std::memcpy(file.data(), &header, sizeof(header));
+			std::memcpy(file.data() + sizeof(header), image.data(), image.size());
+			simple_fs::write_file(directory, autosave_slot_names[generation % 2], reinterpret_cast<char const*>(file.data()), uint32_t(file.size()));
+			a.base_size = image.size();
+			a.log_size = 0;
+			a.writing.store(false, std::memory_order::release);
+		});
+	} else {
+		a.writer = std::thread([&a, directory, generation = a.generation, delta = std::move(delta)]() {
+			autosave_record_header header;
+			header.raw_size = uint32_t(delta.size());
+			std::vector<uint8_t> record(sizeof(header) + ZSTD_compressBound(delta.size()));
+			auto size = ZSTD_compress(record.data() + sizeof(header), record.size() - sizeof(header), delta.data(), delta.size(), board_compression_level);
+			assert(!ZSTD_isError(size));
+			header.compressed_size = uint32_t(size);
+			std::memcpy(record.data(), &header, sizeof(header));
+			record.resize(sizeof(header) + size);
+			simple_fs::append_file(directory, autosave_slot_names[generation % 2], reinterpret_cast<char const*>(record.data()), uint32_t(record.size()));
+			a.log_size += record.size();
+			a.writing.store(false, std::memory_order::release);
+		});
+	}
+}
+
+void update_autosave(sys::state& state) {
+	auto frequency = state.user_settings.autosaves;
+	if(frequency == sys::autosave_frequency::none)
+		return;
+	if(std::chrono::steady_clock::now() - state.autosave_log.last_save < autosave_interval(frequency))
+		return;
+	autosave_now(state);
+}
+
+void finish_autosave(sys::state& state) {
+	auto& a = state.autosave_log;
+	if(state.user_settings.autosaves != sys::autosave_frequency::none) {
+		if(a.writer.joinable()) // so that the last changes are not skipped for a write still in progress
+			a.writer.join();
+		autosave_now(state);
+	}
+	if(a.writer.joinable())
+		a.writer.join();
+}
+
+//
+// loading
+//
+
+bool read_autosave(sys::state& state, std::span<uint8_t const> data) {
+	auto& a = state.autosave_log;
+	if(a.writer.joinable())
+		a.writer.join();
+
+	autosave_file_header header;
+	if(data.size() < sizeof(header))
+		return false;
+	std::memcpy(&header, data.data(), sizeof(header));
+	if(header.magic != autosave_file_magic || header.version != autosave_version || header.base_size > data.size() - sizeof(header))
+		return false;
+	if(!read_board(state, data.subspan(sizeof(header), size_t(header.base_size))))
+		return false;
+
+	// a record that is incomplete or damaged ends the log; it can only be the last one written before a crash
+	auto at = sizeof(header) + size_t(header.base_size);
+	std::vector<uint8_t> raw;
+	while(data.size() - at >= sizeof(autosave_record_header)) {
+		autosave_record_header record;
+		std::memcpy(&record, data.data() + at, sizeof(record));
+		at += sizeof(record);
+		if(record.magic != autosave_record_magic || record.compressed_size > data.size() - at)
+			break;
+		auto frame = data.data() + at;
+		at += record.compressed_size;
+		if(ZSTD_getFrameContentSize(frame, record.compressed_size) != record.raw_size)
+			break;
+		raw.resize(record.raw_size);
+		auto size = ZSTD_decompress(raw.data(), raw.size(), frame, record.compressed_size);
+		if(ZSTD_isError(size) || size != raw.size())
+			break;
+		autosave_delta d;
+		if(!read_autosave_delta(state, std::span<uint8_t const>(raw.data(), raw.size()), d))
+			break;
+		apply_autosave_delta(state, d);
+	}
+
+	state.journal.clear();
+	autosave_board_replaced(state);
+	a.generation = header.generation;
+	return true;
+}
+
+bool load_autosave(sys::state& state) {
+	auto directory = simple_fs::get_or_create_save_game_directory(simple_fs::get_mod_save_dir_name(state.common_fs));
+	std::optional<simple_fs::file> files[2] = { simple_fs::open_file(directory, autosave_slot_names[0]), simple_fs::open_file(directory, autosave_slot_names[1]) };
+	// the newest slot first; should its save be damaged, the older one
+	uint32_t order[2] = { 0, 1 };
+	if(autosave_slot_generation(files[1]) > autosave_slot_generation(files[0]))
+		std::swap(order[0], order[1]);
+	for(auto i : order) {
+		if(!files[i])
+			continue;
+		auto contents = simple_fs::view_contents(*files[i]);
+		if(read_autosave(state, std::span<uint8_t const>(reinterpret_cast<uint8_t const*>(contents.data), size_t(contents.file_size))))
+			return true;
+	}
+	return false;
+}
+
+} // namespace circuit
@@ -0,0 +1,90 @@
+#pragma once
+#include <vector>
+#include <span>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <stdint.h>
+#include "unordered_dense.h"
+#include "circuit.hpp"
+
+// the autosave
+//
+// an autosave lives in one of two slot files. a slot holds a full board save (see board_save.hpp) followed by an
+// append-only log of delta records. for the deltas the board is divided into the chunks of the spatial index, and a
+// part belongs to the chunk holding its position (the start of a wire, the top left corner of a module instance).
+// every edit marks the chunks of the parts it places and removes, and a delta record lists the chunks marked since the
+// previous record with every part now in them, along with the module definitions added since and the board inputs if
+// they changed. a record therefore costs as much as the edits it covers, whatever the size of the board
+//
+// once the log has grown larger than the save it follows, the next autosave compacts it: a fresh full save is written
+// to the other slot under a higher generation, and records are appended there from then on. loading takes the newest
+// slot that holds a valid save and applies its records in order up to the first incomplete one, so a crash while
+// writing loses at most the record being written, and a crash during a compaction leaves the previous slot intact
+//
+// the game thread only gathers what is to be written, holding the ui lock while it does, as the board editing
+// functions do. compressing it and writing the file happen on a background
+// thread, and while a write is in progress the next autosave is put off, with the marked chunks accumulating
+
+namespace circuit {
+
+constexpr inline uint32_t autosave_file_magic = 0x56534141; // "AASV"
+constexpr inline uint32_t autosave_record_magic = 0x54444141; // "AADT"
+constexpr inline uint32_t autosave_version = 1;
+
+struct autosave_file_header {
+	uint32_t magic = autosave_file_magic;
+	uint32_t version = autosave_version;
+	uint64_t generation = 0;
+	uint64_t base_size = 0; // of the board save that follows; the records come after it
+};
+struct autosave_record_header {
+	uint32_t magic = autosave_record_magic;
+	uint32_t raw_size = 0;
+	uint32_t compressed_size = 0; // of the zstd frame that follows
+	uint32_t reserved = 0;
+};
+
+class autosave_log {
+public:
+	ankerl::unordered_dense::set<uint32_t> dirty_chunks; // see pack_chunk
+	uint32_t saved_definitions = 0; // the module definitions already written to the slot
+	bool inputs_dirty = false;
+	bool needs_compaction = true; // nothing has been written for the board in its current form
+
+	uint64_t generation = 0; // of the slot being written to; the slot is the generation modulo two
+	std::chrono::steady_clock::time_point last_save = std::chrono::steady_clock::now();
+
+	// the background write; the sizes are updated by it, and are only read by the game thread once it has finished
+	std::thread writer;
+	std::atomic<bool> writing = false;
+	uint64_t base_size = 0;
+	uint64_t log_size = 0;
+
+	~autosave_log() {
+		if(writer.joinable())
+			writer.join();
+	}
+};
+
+// called by the board editing functions
+void autosave_part_changed(sys::state& state, board_item part);
+void autosave_inputs_changed(sys::state& state);
+void autosave_board_replaced(sys::state& state); // for edits that bypass the above, such as loading a board
+
+// called by the game loop between ticks: starts an autosave when one is due under the user's settings
+void update_autosave(sys::state& state);
+// starts an autosave whatever the settings; does nothing if nothing has changed or the previous one is still writing
+void autosave_now(sys::state& state);
+// when quitting: writes what has changed since the last autosave, if autosaving is on, and waits for it
+void finish_autosave(sys::state& state);
+
+// the delta record for the changes marked since the last one, which it clears; exposed for testing
+std::vector<uint8_t> write_autosave_delta(sys::state& state);
+// replaces the board with the one in the contents of a slot file; returns false, leaving the board untouched, if the
+// save at its start is not valid. must only be called from the thread that owns the game state
+bool read_autosave(sys::state& state, std::span<uint8_t const> data);
+// from the save game directory; the game loop calls this as it starts, when autosaving is on
+bool load_autosave(sys::state& state);
+
+} // namespace circuit
@@ -0,0 +1,390 @@
+#include <cstring>
+#include <array>
+#include <atomic>
+#include <algorithm>
+#include "zstd.h"
+#include "board_save.hpp"
+#include "module.hpp"
+#include "netlist.hpp"
+#include "spatial_index.hpp"
+#include "simulation.hpp"
+#include "journal.hpp"
+#include "autosave.hpp"
+#include "board_renderer.hpp"
+#include "stools.hpp"
+#include "simple_fs.hpp"
+#include "parallel_tools.hpp"
+#include "system_state.hpp"
+
+namespace circuit {
+
+constexpr inline uint64_t max_module_definitions_size = uint64_t(1) << 28;
+
+uint32_t board_section_element_size(board_section s) {
+	switch(s) {
+	case board_section::diode_x:
+	case board_section::diode_y:
+	case board_section::enable_high_x:
+	case board_section::enable_high_y:
+	case board_section::enable_low_x:
+	case board_section::enable_low_y:
+	case board_section::wire_start_x:
+	case board_section::wire_start_y:
+	case board_section::wire_end_x:
+	case board_section::wire_end_y:
+	case board_section::module_instance_x:
+	case board_section::module_instance_y:
+		return sizeof(int16_t);
+	case board_section::diode_orientation:
+	case board_section::enable_high_orientation:
+	case board_section::enable_low_orientation:
+	case board_section::wire_color:
+	case board_section::module_definitions:
+	case board_section::board_input_value:
+		return sizeof(uint8_t);
+	case board_section::module_instance_definition:
+	case board_section::board_input_point:
+		return sizeof(uint32_t);
+	case board_section::count:
+		break;
+	}
+	return 0;
+}
+
+template<typename T, typename F>
+void fill_board_column(board_column& c, uint32_t count, F&& get) {
+	static_assert(sizeof(T) == 1 || sizeof(T) == 2 || sizeof(T) == 4);
+	c.present = true;
+	c.element_size = uint32_t(sizeof(T));
+	c.element_count = count;
+	c.raw.resize(size_t(count) * sizeof(T));
+	for(uint32_t i = 0; i < count; ++i) {
+		T v = get(i);
+		std::memcpy(c.raw.data() + size_t(i) * sizeof(T), &v, sizeof(T));
+	}
+}
+
+template<typename T>
+T board_column_value(board_column const& c, uint32_t i) {
+	T v;
+	std::memcpy(&v, c.raw.data() + size_t(i) * sizeof(T), sizeof(T));
+	return v;
+}
+
+bool module_definition_is_valid(module_definition const& def) {
+	for(auto& m : def.components) {
+		if(uint8_t(m.orientation) > sys::max_orientation || uint8_t(m.type) > uint8_t(sys::basic_component_type::enable_low_transistor))
+			return false;
+	}
+	for(auto& w : def.wires) {
+		if(uint8_t(w.color) > sys::max_wire_color)
+			return false;
+	}
+	return !def.ports.empty() && def.ports.size() <= max_module_ports && def.width >= 1 && def.height >= 1;
+}
+
+// each definition is stored as the board it captured; the compiled block is rebuilt on loading
+void write_module_definitions(sys::state& state, board_column& c) {
+	serialization::out_buffer out;
+	out.write(uint32_t(state.modules.definitions.size()));
+	for(auto& def : state.modules.definitions) {
+		out.write_variable(def.components.data(), def.components.size());
+		out.write_variable(def.wires.data(), def.wires.size());
+		out.write_variable(def.ports.data(), def.ports.size());
+		out.write(def.width);
+		out.write(def.height);
+	}
+	out.finalize();
+	c.present = true;
+	c.element_size = 1;
+	c.element_count = out.size();
+	c.raw.assign(reinterpret_cast<uint8_t const*>(out.data()), reinterpret_cast<uint8_t const*>(out.data()) + out.size());
+}
+
+bool read_module_definitions(board_column const& c, std::vector<module_definition>& defs) {
+	if(!c.present)
+		return true;
+	serialization::in_buffer in(reinterpret_cast<char const*>(c.raw.data()), c.raw.size());
+	auto count = in.read<uint32_t>();
+	for(uint32_t i = 0; i < count; ++i) {
+		auto& def = defs.emplace_back();
+		auto components = in.read_variable<module_component>();
+		auto wires = in.read_variable<module_wire>();
+		auto ports = in.read_variable<module_port>();
+		def.width = in.read<int16_t>();
+		def.height = in.read<int16_t>();
+		if(in.view_read_position() > in.view_size())
+			return false;
+		def.components.assign(components.begin(), components.end());
+		def.wires.assign(wires.begin(), wires.end());
+		def.ports.assign(ports.begin(), ports.end());
+		if(!module_definition_is_valid(def))
+			return false;
+	}
+	return true;
+}
+
+board_snapshot snapshot_board(sys::state& state) {
+	auto& w = state.world;
+	board_snapshot result;
+	auto column = [&](board_section s) -> board_column& { return result.columns[size_t(s)]; };
+
+	auto diodes = w.diode_size();
+	fill_board_column<int16_t>(column(board_section::diode_x), diodes, [&](uint32_t i) { return w.diode_get_x(dcon::diode_id{ dcon::diode_id::value_base_t(i) }); });
+	fill_board_column<int16_t>(column(board_section::diode_y), diodes, [&](uint32_t i) { return w.diode_get_y(dcon::diode_id{ dcon::diode_id::value_base_t(i) }); });
+	fill_board_column<uint8_t>(column(board_section::diode_orientation), diodes, [&](uint32_t i) { return uint8_t(w.diode_get_orientation(dcon::diode_id{ dcon::diode_id::value_base_t(i) })); });
+
+	auto highs = w.enable_high_transistor_size();
+	fill_board_column<int16_t>(column(board_section::enable_high_x), highs, [&](uint32_t i) { return w.enable_high_transistor_get_x(dcon::enable_high_transistor_id{ dcon::enable_high_transistor_id::value_base_t(i) }); });
+	fill_board_column<int16_t>(column(board_section::enable_high_y), highs, [&](uint32_t i) { return w.enable_high_transistor_get_y(dcon::enable_high_transistor_id{ dcon::enable_high_transistor_id::value_base_t(i) }); });
+	fill_board_column<uint8_t>(column(board_section::enable_high_orientation), highs, [&](uint32_t i) { return uint8_t(w.enable_high_transistor_get_orientation(dcon::enable_high_transistor_id{ dcon::enable_high_transistor_id::value_base_t(i) })); });
+
+	auto lows = w.enable_low_transistor_size();
+	fill_board_column<int16_t>(column(board_section::enable_low_x), lows, [&](uint32_t i) { return w.enable_low_transistor_get_x(dcon::enable_low_transistor_id{ dcon::enable_low_transistor_id::value_base_t(i) }); });
+	fill_board_column<int16_t>(column(board_section::enable_low_y), lows, [&](uint32_t i) { return w.enable_low_transistor_get_y(dcon::enable_low_transistor_id{ dcon::enable_low_transistor_id::value_base_t(i) }); });
+	fill_board_column<uint8_t>(column(board_section::enable_low_orientation), lows, [&](uint32_t i) { return uint8_t(w.enable_low_transistor_get_orientation(dcon::enable_low_transistor_id{ dcon::enable_low_transistor_id::value_base_t(i) })); });
+
+	auto wires = w.wire_segment_size();
+	fill_board_column<int16_t>(column(board_section::wire_start_x), wires, [&](uint32_t i) { return w.wire_segment_get_start_x(dcon::wire_segment_id{ dcon::wire_segment_id::value_base_t(i) }); });
+	fill_board_column<int16_t>(column(board_section::wire_start_y), wires, [&](uint32_t i) { return w.wire_segment_get_start_y(dcon::wire_segment_id{ dcon::wire_segment_id::value_base_t(i) }); });
+	fill_board_column<int16_t>(column(board_section::wire_end_x), wires, [&](uint32_t i) { return w.wire_segment_get_end_x(dcon::wire_segment_id{ dcon::wire_segment_id::value_base_t(i) }); });
+	fill_board_column<int16_t>(column(board_section::wire_end_y), wires, [&](uint32_t i) { return w.wire_segment_get_end_y(dcon::wire_segment_id{ dcon::wire_segment_id::value_base_t(i) }); });
+	fill_board_column<uint8_t>(column(board_section::wire_color), wires, [&](uint32_t i) { return uint8_t(w.wire_segment_get_color(dcon::wire_segment_id{ dcon::wire_segment_id::value_base_t(i) })); });
+
+	auto instances = w.module_instance_size();
+	fill_board_column<int16_t>(column(board_section::module_instance_x), instances, [&](uint32_t i) { return w.module_instance_get_x(dcon::module_instance_id{ dcon::module_instance_id::value_base_t(i) }); });
+	fill_board_column<int16_t>(column(board_section::module_instance_y), instances, [&](uint32_t i) { return w.module_instance_get_y(dcon::module_instance_id{ dcon::module_instance_id::value_base_t(i) }); });
+	fill_board_column<uint32_t>(column(board_section::module_instance_definition), instances, [&](uint32_t i) { return w.module_instance_get_definition(dcon::module_instance_id{ dcon::module_instance_id::value_base_t(i) }); });
+
+	write_module_definitions(state, column(board_section::module_definitions));
+
+	std::vector<std::pair<uint32_t, bool>> inputs(state.simulation.board_inputs.begin(), state.simulation.board_inputs.end());
+	std::sort(inputs.begin(), inputs.end()); // the same board always writes the same file
+	fill_board_column<uint32_t>(column(board_section::board_input_point), uint32_t(inputs.size()), [&](uint32_t i) { return inputs[i].first; });
+	fill_board_column<uint8_t>(column(board_section::board_input_value), uint32_t(inputs.size()), [&](uint32_t i) { return uint8_t(inputs[i].second); });
+	return result;
+}
+
+std::vector<uint8_t> encode_board(board_snapshot& snapshot) {
+	auto& columns = snapshot.columns;
+	concurrency_tools::parallel_for(uint32_t(0), uint32_t(columns.size()), [&](uint32_t i) {
+		auto& c = columns[i];
+		c.compressed.resize(ZSTD_compressBound(c.raw.size()));
+		auto size = ZSTD_compress(c.compressed.data(), c.compressed.size(), c.raw.data(), c.raw.size(), board_compression_level);
+		assert(!ZSTD_isError(size));
+		c.compressed.resize(size);
+	});
+
+	board_file_header header;
+	header.section_count = uint32_t(columns.size());
+	std::vector<board_file_section> table(columns.size());
+	uint64_t offset = sizeof(board_file_header) + sizeof(board_file_section) * table.size();
+	for(size_t i = 0; i < columns.size(); ++i) {
+		table[i].id = uint32_t(i);
+		table[i].element_size = columns[i].element_size;
+		table[i].element_count = columns[i].element_count;
+		table[i].offset = offset;
+		table[i].compressed_size = columns[i].compressed.size();
+		offset += columns[i].compressed.size();
+	}
+
+	std::vector<uint8_t> result(offset);
+	std::memcpy(result.data(), &header, sizeof(header));
+	std::memcpy(result.data() + sizeof(header), table.data(), sizeof(board_file_section) * table.size());
+	for(size_t i = 0; i < columns.size(); ++i)
+		std::memcpy(result.data() + table[i].offset, columns[i].compressed.data(), columns[i].compressed.size());
+	return result;
+}
+
+std::vector<uint8_t> write_board(sys::state& state) {
+	auto snapshot = snapshot_board(state);
+	return encode_board(snapshot);
+}
+
+bool read_board(sys::state& state, std::span<uint8_t const> data) {
+	board_file_header header;
+	if(data.size() < sizeof(header))
+		return false;
+	std::memcpy(&header, data.data(), sizeof(header));
+	if(header.magic != board_file_magic || header.version != board_file_version)
+		return false;
+	if((data.size() - sizeof(header)) / sizeof(board_file_section) < header.section_count)
+		return false;
+	std::vector<board_file_section> table(header.section_count);
+	std::memcpy(table.data(), data.data() + sizeof(header), sizeof(board_file_section) * table.size());
+
+	std::array<board_column, size_t(board_section::count)> columns;
+	std::vector<board_file_section const*> sources(columns.size(), nullptr);
+	for(auto& s : table) {
+		if(s.id >= uint32_t(board_section::count))
+			continue;
+		if(sources[s.id] || s.element_size != board_section_element_size(board_section(s.id)))
+			return false;
+		if(s.offset > data.size() || s.compressed_size > data.size() - s.offset)
+			return false;
+		if(s.id == uint32_t(board_section::module_definitions) ? s.element_count > max_module_definitions_size : s.element_count > uint64_t(board_item::max_index) + 1)
+			return false;
+		sources[s.id] = &s;
+	}
+
+	std::atomic<bool> failed = false;
+	concurrency_tools::parallel_for(uint32_t(0), uint32_t(columns.size()), [&](uint32_t i) {
+		auto s = sources[i];
+		if(!s)
+			return;
+		// the size the zstd frame records for its contents must agree with the table before anything is allocated
+		auto raw_size = s->element_count * s->element_size;
+		if(ZSTD_getFrameContentSize(data.data() + s->offset, size_t(s->compressed_size)) != raw_size) {
+			failed.store(true, std::memory_order::relaxed);
+			return;
+		}
+		auto& c = columns[i];
+		c.present = true;
+		c.element_size = s->element_size;
+		c.element_count = s->element_count;
+		c.raw.resize(size_t(raw_size));
+		auto size = ZSTD_decompress(c.raw.data(), c.raw.size(), data.data() + s->offset, size_t(s->compressed_size));
+		if(ZSTD_isError(size) || size != c.raw.size())
+			failed.store(true, std::memory_order::relaxed);
+	});
+	if(failed.load())
+		return false;
+
+	auto column = [&](board_section s) -> board_column const& { return columns[size_t(s)]; };
+	auto count_of = [&](std::initializer_list<board_section> group, uint32_t& count) {
+		count = uint32_t(column(*group.begin()).element_count);
+		for(auto s : group) {
+			if(column(s).element_count != count)
+				return false;
+		}
+		return true;
+	};
+	uint32_t diodes = 0;
+	uint32_t highs = 0;
+	uint32_t lows = 0;
+	uint32_t wires = 0;
+	uint32_t instances = 0;
+	uint32_t inputs = 0;
+	if(!count_of({ board_section::diode_x, board_section::diode_y, board_section::diode_orientation }, diodes)
+		|| !count_of({ board_section::enable_high_x, board_section::enable_high_y, board_section::enable_high_orientation }, highs)
+		|| !count_of({ board_section::enable_low_x, board_section::enable_low_y, board_section::enable_low_orientation }, lows)
+		|| !count_of({ board_section::wire_start_x, board_section::wire_start_y, board_section::wire_end_x, board_section::wire_end_y, board_section::wire_color }, wires)
+		|| !count_of({ board_section::module_instance_x, board_section::module_instance_y, board_section::module_instance_definition }, instances)
+		|| !count_of({ board_section::board_input_point, board_section::board_input_value }, inputs)) {
+		return false;
+	}
+	if(std::max({ diodes, highs, lows, wires, instances }) > board_item::max_index)
+		return false;
+
+	// everything is checked before the current board is replaced
+	std::vector<module_definition> definitions;
+	if(!read_module_definitions(column(board_section::module_definitions), definitions))
+		return false;
+	for(auto s : { board_section::diode_orientation, board_section::enable_high_orientation, board_section::enable_low_orientation }) {
+		for(auto v : column(s).raw) {
+			if(v > sys::max_orientation)
+				return false;
+		}
+	}
+	for(auto v : column(board_section::wire_color).raw) {
+		if(v > sys::max_wire_color)
+			return false;
+	}
+	for(uint32_t i = 0; i < instances; ++i) {
+		if(board_column_value<uint32_t>(column(board_section::module_instance_definition), i) >= definitions.size())
+			return false;
+	}
+
+	auto& w = state.world;
+	w.diode_resize(0);
+	w.diode_resize(diodes);
+	for(uint32_t i = 0; i < diodes; ++i) {
+		auto id = dcon::diode_id{ dcon::diode_id::value_base_t(i) };
+		w.diode_set_x(id, board_column_value<int16_t>(column(board_section::diode_x), i));
+		w.diode_set_y(id, board_column_value<int16_t>(column(board_section::diode_y), i));
+		w.diode_set_orientation(id, sys::orientation(board_column_value<uint8_t>(column(board_section::diode_orientation), i)));
+		w.diode_set_input_net(id, dcon::net_id{ });
+		w.diode_set_output_net(id, dcon::net_id{ });
+		w.diode_set_driving(id, false);
+	}
+	w.enable_high_transistor_resize(0);
+	w.enable_high_transistor_resize(highs);
+	for(uint32_t i = 0; i < highs; ++i) {
+		auto id = dcon::enable_high_transistor_id{ dcon::enable_high_transistor_id::value_base_t(i) };
+		w.enable_high_transistor_set_x(id, board_column_value<int16_t>(column(board_section::enable_high_x), i));
+		w.enable_high_transistor_set_y(id, board_column_value<int16_t>(column(board_section::enable_high_y), i));
+		w.enable_high_transistor_set_orientation(id, sys::orientation(board_column_value<uint8_t>(column(board_section::enable_high_orientation), i)));
+		w.enable_high_transistor_set_input_net(id, dcon::net_id{ });
+		w.enable_high_transistor_set_control_net(id, dcon::net_id{ });
+		w.enable_high_transistor_set_output_net(id, dcon::net_id{ });
+		w.enable_high_transistor_set_driving(id, false);
+	}
+	w.enable_low_transistor_resize(0);
+	w.enable_low_transistor_resize(lows);
+	for(uint32_t i = 0; i < lows; ++i) {
+		auto id = dcon::enable_low_transistor_id{ dcon::enable_low_transistor_id::value_base_t(i) };
+		w.enable_low_transistor_set_x(id, board_column_value<int16_t>(column(board_section::enable_low_x), i));
+		w.enable_low_transistor_set_y(id, board_column_value<int16_t>(column(board_section::enable_low_y), i));
+		w.enable_low_transistor_set_orientation(id, sys::orientation(board_column_value<uint8_t>(column(board_section::enable_low_orientation), i)));
+		w.enable_low_transistor_set_input_net(id, dcon::net_id{ });
+		w.enable_low_transistor_set_control_net(id, dcon::net_id{ });
+		w.enable_low_transistor_set_output_net(id, dcon::net_id{ });
+		w.enable_low_transistor_set_driving(id, false);
+	}
+	w.wire_segment_resize(0);
+	w.wire_segment_resize(wires);
+	for(uint32_t i = 0; i < wires; ++i) {
+		auto id = dcon::wire_segment_id{ dcon::wire_segment_id::value_base_t(i) };
+		w.wire_segment_set_start_x(id, board_column_value<int16_t>(column(board_section::wire_start_x), i));
+		w.wire_segment_set_start_y(id, board_column_value<int16_t>(column(board_section::wire_start_y), i));
+		w.wire_segment_set_end_x(id, board_column_value<int16_t>(column(board_section::wire_end_x), i));
+		w.wire_segment_set_end_y(id, board_column_value<int16_t>(column(board_section::wire_end_y), i));
+		w.wire_segment_set_color(id, sys::wire_colors(board_column_value<uint8_t>(column(board_section::wire_color), i)));
+		w.wire_segment_set_net(id, dcon::net_id{ });
+	}
+
+	state.modules.definitions = std::move(definitions);
+	for(auto& def : state.modules.definitions)
+		compile_module(def);
+	w.module_instance_resize(0);
+	w.module_instance_resize(instances);
+	for(uint32_t i = 0; i < instances; ++i) {
+		auto id = dcon::module_instance_id{ dcon::module_instance_id::value_base_t(i) };
+		auto definition = board_column_value<uint32_t>(column(board_section::module_instance_definition), i);
+		w.module_instance_set_x(id, board_column_value<int16_t>(column(board_section::module_instance_x), i));
+		w.module_instance_set_y(id, board_column_value<int16_t>(column(board_section::module_instance_y), i));
+		w.module_instance_set_definition(id, definition);
+		w.module_instance_set_state_slot(id, allocate_module_slot(state.modules.definitions[definition], i));
+	}
+
+	auto& sim = state.simulation;
+	sim.board_inputs.clear();
+	for(uint32_t i = 0; i < inputs; ++i)
+		sim.board_inputs.insert_or_assign(board_column_value<uint32_t>(column(board_section::board_input_point), i), board_column_value<uint8_t>(column(board_section::board_input_value), i) != 0);
+	sim.structure_out_of_date = true;
+
+	state.journal.clear();
+	autosave_board_replaced(state);
+	ogl::board_replaced(state);
+	rebuild_netlist(state);
+	rebuild_spatial_index(state);
+	return true;
+}
+
+void save_board(sys::state& state, native_string_view file_name) {
+	auto data = write_board(state);
+	auto directory = simple_fs::get_or_create_save_game_directory(simple_fs::get_mod_save_dir_name(state.common_fs));
+	simple_fs::write_file(directory, file_name, reinterpret_cast<char const*>(data.data()), uint32_t(data.size()));
+}
+
+bool load_board(sys::state& state, native_string_view file_name) {
+	auto directory = simple_fs::get_or_create_save_game_directory(simple_fs::get_mod_save_dir_name(state.common_fs));
+	auto file = simple_fs::open_file(directory, file_name);
+	if(!file)
+		return false;
+	// the file is mapped, so the sections are decompressed straight out of it
+	auto contents = simple_fs::view_contents(*file);
+	return read_board(state, std::span<uint8_t const>(reinterpret_cast<uint8_t const*>(contents.data), size_t(contents.file_size)));
+}
+
+} // namespace circuit
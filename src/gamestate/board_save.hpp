@@ -0,0 +1,80 @@
+#pragma once
+#include <vector>
+#include <array>
+#include <span>
+#include <stdint.h>
+#include "circuit.hpp"
+#include "native_types.hpp"
+
+// the board save format
+//
+// a save is a fixed header, a table of sections and then the sections themselves, each compressed on its own with
+// zstd. parts are stored as columns, as they are in the dcon storage: one section holds the x coordinate of every
+// diode, the next their y coordinate, and so on, so that similar values sit together and compress well. the module
+// definitions are a single section of their own. nets are not saved; they are derived from the parts when the board
+// is loaded
+//
+// sections are compressed and decompressed in parallel, and a save is read straight from the mapped file. a reader
+// skips sections it does not know, and treats those missing from the file as empty
+
+namespace circuit {
+
+struct module_definition;
+
+constexpr inline uint32_t board_file_magic = 0x44524241; // "ABRD"
+constexpr inline uint32_t board_file_version = 1;
+constexpr inline int board_compression_level = 3; // zstd's default
+
+enum class board_section : uint32_t {
+	diode_x = 0, diode_y = 1, diode_orientation = 2,
+	enable_high_x = 3, enable_high_y = 4, enable_high_orientation = 5,
+	enable_low_x = 6, enable_low_y = 7, enable_low_orientation = 8,
+	wire_start_x = 9, wire_start_y = 10, wire_end_x = 11, wire_end_y = 12, wire_color = 13,
+	module_instance_x = 14, module_instance_y = 15, module_instance_definition = 16,
+	module_definitions = 17, // bytes, see write_module_definitions
+	board_input_point = 18, board_input_value = 19,
+	count = 20
+};
+
+struct board_file_header {
+	uint32_t magic = board_file_magic;
+	uint32_t version = board_file_version;
+	uint32_t section_count = 0;
+	uint32_t reserved = 0;
+};
+struct board_file_section {
+	uint32_t id = 0;
+	uint32_t element_size = 0;
+	uint64_t element_count = 0;
+	uint64_t offset = 0; // of the compressed bytes, from the start of the file
+	uint64_t compressed_size = 0;
+};
+
+struct board_column {
+	std::vector<uint8_t> raw;
+	std::vector<uint8_t> compressed;
+	uint64_t element_count = 0;
+	uint32_t element_size = 0;
+	bool present = false;
+};
+// the uncompressed columns of a board; taking one is the only part of saving that reads the game state, so the
+// compression and writing may be left to another thread
+struct board_snapshot {
+	std::array<board_column, size_t(board_section::count)> columns;
+};
+
+board_snapshot snapshot_board(sys::state& state);
+std::vector<uint8_t> encode_board(board_snapshot& snapshot);
+std::vector<uint8_t> write_board(sys::state& state); // both of the above
+// replaces the board with the one saved in data; returns false, leaving the board untouched, if data is not a valid
+// save. must only be called from the thread that owns the game state
+bool read_board(sys::state& state, std::span<uint8_t const> data);
+
+// whether a definition read from a file may be compiled and placed
+bool module_definition_is_valid(module_definition const& def);
+
+// to and from the save game directory
+void save_board(sys::state& state, native_string_view file_name);
+bool load_board(sys::state& state, native_string_view file_name);
+
+} // namespace circuit
@@ -0,0 +1,434 @@
+#include <algorithm>
+#include "circuit.hpp"
+#include "system_state.hpp"
+#include "netlist.hpp"
+#include "spatial_index.hpp"
+#include "module.hpp"
+#include "journal.hpp"
+#include "autosave.hpp"
+#include "board_renderer.hpp"
+
+namespace circuit {
+
+board_item place_component(sys::state& state, sys::basic_component_type type, grid_point p, sys::orientation o) {
+	switch(type) {
+	case sys::basic_component_type::diode:
+	{
+		auto id = state.world.create_diode();
+		state.world.diode_set_x(id, p.x);
+		state.world.diode_set_y(id, p.y);
+		state.world.diode_set_orientation(id, o);
+		state.world.diode_set_input_net(id, dcon::net_id{});
+		state.world.diode_set_output_net(id, dcon::net_id{});
+		state.world.diode_set_driving(id, false);
+		auto item = board_item(item_kind::diode, uint32_t(id.index()));
+		add_to_netlist(state, item);
+		add_to_spatial_index(state, item);
+		command::journal_part_placed(state, item);
+		autosave_part_changed(state, item);
+		ogl::board_part_changed(state, item);
+		return item;
+	}
+	case sys::basic_component_type::enable_high_transistor:
+	{
+		auto id = state.world.create_enable_high_transistor();
+		state.world.enable_high_transistor_set_x(id, p.x);
+		state.world.enable_high_transistor_set_y(id, p.y);
+		state.world.enable_high_transistor_set_orientation(id, o);
+		state.world.enable_high_transistor_set_input_net(id, dcon::net_id{});
+		state.world.enable_high_transistor_set_control_net(id, dcon::net_id{});
+		state.world.enable_high_transistor_set_output_net(id, dcon::net_id{});
+		state.world.enable_high_transistor_set_driving(id, false);
+		auto item = board_item(item_kind::enable_high_transistor, uint32_t(id.index()));
+		add_to_netlist(state, item);
+		add_to_spatial_index(state, item);
+		command::journal_part_placed(state, item);
+		autosave_part_changed(state, item);
+		ogl::board_part_changed(state, item);
+		return item;
+	}
+	case sys::basic_component_type::enable_low_transistor:
+	{
+		auto id = state.world.create_enable_low_transistor();
+		state.world.enable_low_transistor_set_x(id, p.x);
+		state.world.enable_low_transistor_set_y(id, p.y);
+		state.world.enable_low_transistor_set_orientation(id, o);
+		state.world.enable_low_transistor_set_input_net(id, dcon::net_id{});
+		state.world.enable_low_transistor_set_control_net(id, dcon::net_id{});
+		state.world.enable_low_transistor_set_output_net(id, dcon::net_id{});
+		state.world.enable_low_transistor_set_driving(id, false);
+		auto item = board_item(item_kind::enable_low_transistor, uint32_t(id.index()));
+		add_to_netlist(state, item);
+		add_to_spatial_index(state, item);
+		command::journal_part_placed(state, item);
+		autosave_part_changed(state, item);
+		ogl::board_part_changed(state, item);
+		return item;
+	}
+	}
+	assert(false);
+	return board_item{};
+}
+
+board_item place_wire(sys::state& state, grid_point start, grid_point end, sys::wire_colors color) {
+	auto id = state.world.create_wire_segment();
+	state.world.wire_segment_set_start_x(id, start.x);
+	state.world.wire_segment_set_start_y(id, start.y);
+	state.world.wire_segment_set_end_x(id, end.x);
+	state.world.wire_segment_set_end_y(id, end.y);
+	state.world.wire_segment_set_color(id, color);
+	state.world.wire_segment_set_net(id, dcon::net_id{});
+	auto item = board_item(item_kind::wire_segment, uint32_t(id.index()));
+	add_to_netlist(state, item);
+	add_to_spatial_index(state, item);
+	command::journal_part_placed(state, item);
+	autosave_part_changed(state, item);
+	ogl::board_part_changed(state, item);
+	return item;
+}
+
+board_item place_module_instance(sys::state& state, uint32_t definition, grid_point p) {
+	assert(definition < state.modules.definitions.size());
+	auto id = state.world.create_module_instance();
+	state.world.module_instance_set_x(id, p.x);
+	state.world.module_instance_set_y(id, p.y);
+	state.world.module_instance_set_definition(id, definition);
+	state.world.module_instance_set_state_slot(id, allocate_module_slot(state.modules.definitions[definition], uint32_t(id.index())));
+	auto item = board_item(item_kind::module_instance, uint32_t(id.index()));
+	add_to_netlist(state, item);
+	add_to_spatial_index(state, item);
+	command::journal_part_placed(state, item);
+	autosave_part_changed(state, item);
+	ogl::board_part_changed(state, item);
+	return item;
+}
+
+// compactable storage fills the hole left by a deletion with the last object of that kind,
+// so anything that refers to parts by index must be updated through this function
+void remove_item(sys::state& state, board_item item) {
+	assert(item_is_valid(state, item));
+	item = item.part();
+	command::journal_part_removed(state, item);
+	autosave_part_changed(state, item);
+	ogl::board_part_changed(state, item);
+	remove_from_netlist(state, item);
+	remove_from_spatial_index(state, item);
+	if(item.kind() == item_kind::module_instance) {
+		auto id = dcon::module_instance_id{ dcon::module_instance_id::value_base_t(item.index()) };
+		release_module_slot(state, state.modules.definitions[state.world.module_instance_get_definition(id)], state.world.module_instance_get_state_slot(id));
+	}
+	auto last = item_count(state, item.kind()) - 1;
+	if(item.index() != last) {
+		move_in_netlist(state, board_item(item.kind(), last), item);
+		move_in_spatial_index(state, board_item(item.kind(), last), item);
+		if(item.kind() == item_kind::module_instance) {
+			auto last_id = dcon::module_instance_id{ dcon::module_instance_id::value_base_t(last) };
+			auto& def = state.modules.definitions[state.world.module_instance_get_definition(last_id)];
+			def.slot_owner[state.world.module_instance_get_state_slot(last_id)] = item.index();
+		}
+	}
+
+	switch(item.kind()) {
+	case item_kind::diode:
+		state.world.delete_diode(dcon::diode_id{ dcon::diode_id::value_base_t(item.index()) });
+		break;
+	case item_kind::enable_high_transistor:
+		state.world.delete_enable_high_transistor(dcon::enable_high_transistor_id{ dcon::enable_high_transistor_id::value_base_t(item.index()) });
+		break;
+	case item_kind::enable_low_transistor:
+		state.world.delete_enable_low_transistor(dcon::enable_low_transistor_id{ dcon::enable_low_transistor_id::value_base_t(item.index()) });
+		break;
+	case item_kind::wire_segment:
+		state.world.delete_wire_segment(dcon::wire_segment_id{ dcon::wire_segment_id::value_base_t(item.index()) });
+		break;
+	case item_kind::module_instance:
+		state.world.delete_module_instance(dcon::module_instance_id{ dcon::module_instance_id::value_base_t(item.index()) });
+		break;
+	}
+}
+
+void move_item(sys::state& state, board_item item, int16_t dx, int16_t dy) {
+	assert(item_is_valid(state, item));
+	item = item.part();
+	command::journal_part_removed(state, item);
+	autosave_part_changed(state, item);
+	ogl::board_part_changed(state, item);
+	remove_from_netlist(state, item);
+	remove_from_spatial_index(state, item);
+	switch(item.kind()) {
+	case item_kind::diode:
+	{
+		auto id = dcon::diode_id{ dcon::diode_id::value_base_t(item.index()) };
+		state.world.diode_set_x(id, int16_t(state.world.diode_get_x(id) + dx));
+		state.world.diode_set_y(id, int16_t(state.world.diode_get_y(id) + dy));
+	} break;
+	case item_kind::enable_high_transistor:
+	{
+		auto id = dcon::enable_high_transistor_id{ dcon::enable_high_transistor_id::value_base_t(item.index()) };
+		state.world.enable_high_transistor_set_x(id, int16_t(state.world.enable_high_transistor_get_x(id) + dx));
+		state.world.enable_high_transistor_set_y(id, int16_t(state.world.enable_high_transistor_get_y(id) + dy));
+	} break;
+	case item_kind::enable_low_transistor:
+	{
+		auto id = dcon::enable_low_transistor_id{ dcon::enable_low_transistor_id::value_base_t(item.index()) };
+		state.world.enable_low_transistor_set_x(id, int16_t(state.world.enable_low_transistor_get_x(id) + dx));
+		state.world.enable_low_transistor_set_y(id, int16_t(state.world.enable_low_transistor_get_y(id) + dy));
+	} break;
+	case item_kind::wire_segment:
+	{
+		auto id = dcon::wire_segment_id{ dcon::wire_segment_id::value_base_t(item.index()) };
+		state.world.wire_segment_set_start_x(id, int16_t(state.world.wire_segment_get_start_x(id) + dx));
+		state.world.wire_segment_set_start_y(id, int16_t(state.world.wire_segment_get_start_y(id) + dy));
+		state.world.wire_segment_set_end_x(id, int16_t(state.world.wire_segment_get_end_x(id) + dx));
+		state.world.wire_segment_set_end_y(id, int16_t(state.world.wire_segment_get_end_y(id) + dy));
+	} break;
+	case item_kind::module_instance:
+	{
+		auto id = dcon::module_instance_id{ dcon::module_instance_id::value_base_t(item.index()) };
+		state.world.module_instance_set_x(id, int16_t(state.world.module_instance_get_x(id) + dx));
+		state.world.module_instance_set_y(id, int16_t(state.world.module_instance_get_y(id) + dy));
+	} break;
+	}
+	add_to_netlist(state, item);
+	add_to_spatial_index(state, item);
+	command::journal_part_placed(state, item);
+	autosave_part_changed(state, item);
+	ogl::board_part_changed(state, item);
+}
+
+part_description describe_item(sys::state& state, board_item item) {
+	part_description d;
+	d.kind = item.kind();
+	d.position = item_position(state, item);
+	switch(item.kind()) {
+	case item_kind::diode:
+		d.orientation = state.world.diode_get_orientation(dcon::diode_id{ dcon::diode_id::value_base_t(item.index()) });
+		break;
+	case item_kind::enable_high_transistor:
+		d.orientation = state.world.enable_high_transistor_get_orientation(dcon::enable_high_transistor_id{ dcon::enable_high_transistor_id::value_base_t(item.index()) });
+		break;
+	case item_kind::enable_low_transistor:
+		d.orientation = state.world.enable_low_transistor_get_orientation(dcon::enable_low_transistor_id{ dcon::enable_low_transistor_id::value_base_t(item.index()) });
+		break;
+	case item_kind::wire_segment:
+		d.end = pin_position(state, item.part().with_slot(pin_slot(1)));
+		d.color = state.world.wire_segment_get_color(dcon::wire_segment_id{ dcon::wire_segment_id::value_base_t(item.index()) });
+		break;
+	case item_kind::module_instance:
+		d.definition = state.world.module_instance_get_definition(dcon::module_instance_id{ dcon::module_instance_id::value_base_t(item.index()) });
+		break;
+	}
+	return d;
+}
+
+board_item place_described(sys::state& state, part_description const& d) {
+	switch(d.kind) {
+	case item_kind::diode:
+		return place_component(state, sys::basic_component_type::diode, d.position, d.orientation);
+	case item_kind::enable_high_transistor:
+		return place_component(state, sys::basic_component_type::enable_high_transistor, d.position, d.orientation);
+	case item_kind::enable_low_transistor:
+		return place_component(state, sys::basic_component_type::enable_low_transistor, d.position, d.orientation);
+	case item_kind::wire_segment:
+		return place_wire(state, d.position, d.end, d.color);
+	case item_kind::module_instance:
+		return place_module_instance(state, d.definition, d.position);
+	}
+	assert(false);
+	return board_item{};
+}
+
+uint32_t item_count(sys::state& state, item_kind k) {
+	switch(k) {
+	case item_kind::diode:
+		return state.world.diode_size();
+	case item_kind::enable_high_transistor:
+		return state.world.enable_high_transistor_size();
+	case item_kind::enable_low_transistor:
+		return state.world.enable_low_transistor_size();
+	case item_kind::wire_segment:
+		return state.world.wire_segment_size();
+	case item_kind::module_instance:
+		return state.world.module_instance_size();
+	}
+	return 0;
+}
+
+module_definition& instance_definition(sys::state& state, uint32_t index) {
+	return state.modules.definitions[state.world.module_instance_get_definition(dcon::module_instance_id{ dcon::module_instance_id::value_base_t(index) })];
+}
+
+uint32_t item_pin_count(sys::state& state, board_item item) {
+	if(item.kind() == item_kind::module_instance)
+		return uint32_t(instance_definition(state, item.index()).ports.size());
+	return pin_count(item.kind());
+}
+
+bool item_is_valid(sys::state& state, board_item item) {
+	return item.index() < item_count(state, item.kind()) && uint32_t(item.slot()) < std::max(item_pin_count(state, item), 1u);
+}
+
+bool pin_is_driver(sys::state& state, board_item pin) {
+	switch(pin.kind()) {
+	case item_kind::diode:
+	case item_kind::enable_high_transistor:
+	case item_kind::enable_low_transistor:
+		return pin.slot() == pin_slot::output;
+	case item_kind::wire_segment:
+		return false;
+	case item_kind::module_instance:
+		return instance_definition(state, pin.index()).ports[uint32_t(pin.slot())].is_output;
+	}
+	return false;
+}
+
+grid_point item_position(sys::state& state, board_item item) {
+	switch(item.kind()) {
+	case item_kind::diode:
+	{
+		auto id = dcon::diode_id{ dcon::diode_id::value_base_t(item.index()) };
+		return grid_point{ state.world.diode_get_x(id), state.world.diode_get_y(id) };
+	}
+	case item_kind::enable_high_transistor:
+	{
+		auto id = dcon::enable_high_transistor_id{ dcon::enable_high_transistor_id::value_base_t(item.index()) };
+		return grid_point{ state.world.enable_high_transistor_get_x(id), state.world.enable_high_transistor_get_y(id) };
+	}
+	case item_kind::enable_low_transistor:
+	{
+		auto id = dcon::enable_low_transistor_id{ dcon::enable_low_transistor_id::value_base_t(item.index()) };
+		return grid_point{ state.world.enable_low_transistor_get_x(id), state.world.enable_low_transistor_get_y(id) };
+	}
+	case item_kind::wire_segment:
+	{
+		auto id = dcon::wire_segment_id{ dcon::wire_segment_id::value_base_t(item.index()) };
+		return grid_point{ state.world.wire_segment_get_start_x(id), state.world.wire_segment_get_start_y(id) };
+	}
+	case item_kind::module_instance:
+	{
+		auto id = dcon::module_instance_id{ dcon::module_instance_id::value_base_t(item.index()) };
+		return grid_point{ state.world.module_instance_get_x(id), state.world.module_instance_get_y(id) };
+	}
+	}
+	return grid_point{};
+}
+
+grid_point pin_position(sys::state& state, board_item pin) {
+	switch(pin.kind()) {
+	case item_kind::diode:
+	{
+		auto id = dcon::diode_id{ dcon::diode_id::value_base_t(pin.index()) };
+		return component_pin_position(grid_point{ state.world.diode_get_x(id), state.world.diode_get_y(id) }, state.world.diode_get_orientation(id), pin.slot());
+	}
+	case item_kind::enable_high_transistor:
+	{
+		auto id = dcon::enable_high_transistor_id{ dcon::enable_high_transistor_id::value_base_t(pin.index()) };
+		return component_pin_position(grid_point{ state.world.enable_high_transistor_get_x(id), state.world.enable_high_transistor_get_y(id) }, state.world.enable_high_transistor_get_orientation(id), pin.slot());
+	}
+	case item_kind::enable_low_transistor:
+	{
+		auto id = dcon::enable_low_transistor_id{ dcon::enable_low_transistor_id::value_base_t(pin.index()) };
+		return component_pin_position(grid_point{ state.world.enable_low_transistor_get_x(id), state.world.enable_low_transistor_get_y(id) }, state.world.enable_low_transistor_get_orientation(id), pin.slot());
+	}
+	case item_kind::wire_segment:
+	{
+		auto id = dcon::wire_segment_id{ dcon::wire_segment_id::value_base_t(pin.index()) };
+		if(pin.slot() == pin_slot::input)
+			return grid_point{ state.world.wire_segment_get_start_x(id), state.world.wire_segment_get_start_y(id) };
+		else
+			return grid_point{ state.world.wire_segment_get_end_x(id), state.world.wire_segment_get_end_y(id) };
+	}
+	case item_kind::module_instance:
+	{
+		auto id = dcon::module_instance_id{ dcon::module_instance_id::value_base_t(pin.index()) };
+		auto& port = state.modules.definitions[state.world.module_instance_get_definition(id)].ports[uint32_t(pin.slot())];
+		return grid_point{ int16_t(state.world.module_instance_get_x(id) + port.x), int16_t(state.world.module_instance_get_y(id) + port.y) };
+	}
+	}
+	return grid_point{};
+}
+
+dcon::net_id pin_net(sys::state& state, board_item pin) {
+	switch(pin.kind()) {
+	case item_kind::diode:
+	{
+		auto id = dcon::diode_id{ dcon::diode_id::value_base_t(pin.index()) };
+		return pin.slot() == pin_slot::input ? state.world.diode_get_input_net(id) : state.world.diode_get_output_net(id);
+	}
+	case item_kind::enable_high_transistor:
+	{
+		auto id = dcon::enable_high_transistor_id{ dcon::enable_high_transistor_id::value_base_t(pin.index()) };
+		switch(pin.slot()) {
+		case pin_slot::input: return state.world.enable_high_transistor_get_input_net(id);
+		case pin_slot::output: return state.world.enable_high_transistor_get_output_net(id);
+		case pin_slot::control: return state.world.enable_high_transistor_get_control_net(id);
+		}
+		break;
+	}
+	case item_kind::enable_low_transistor:
+	{
+		auto id = dcon::enable_low_transistor_id{ dcon::enable_low_transistor_id::value_base_t(pin.index()) };
+		switch(pin.slot()) {
+		case pin_slot::input: return state.world.enable_low_transistor_get_input_net(id);
+		case pin_slot::output: return state.world.enable_low_transistor_get_output_net(id);
+		case pin_slot::control: return state.world.enable_low_transistor_get_control_net(id);
+		}
+		break;
+	}
+	case item_kind::wire_segment:
+		return state.world.wire_segment_get_net(dcon::wire_segment_id{ dcon::wire_segment_id::value_base_t(pin.index()) });
+	case item_kind::module_instance:
+	{
+		auto id = dcon::module_instance_id{ dcon::module_instance_id::value_base_t(pin.index()) };
+		auto& def = state.modules.definitions[state.world.module_instance_get_definition(id)];
+		return def.instance_port_nets[size_t(state.world.module_instance_get_state_slot(id)) * def.ports.size() + uint32_t(pin.slot())];
+	}
+	}
+	return dcon::net_id{};
+}
+
+void set_pin_net(sys::state& state, board_item pin, dcon::net_id n) {
+	switch(pin.kind()) {
+	case item_kind::diode:
+	{
+		auto id = dcon::diode_id{ dcon::diode_id::value_base_t(pin.index()) };
+		if(pin.slot() == pin_slot::input)
+			state.world.diode_set_input_net(id, n);
+		else
+			state.world.diode_set_output_net(id, n);
+		break;
+	}
+	case item_kind::enable_high_transistor:
+	{
+		auto id = dcon::enable_high_transistor_id{ dcon::enable_high_transistor_id::value_base_t(pin.index()) };
+		switch(pin.slot()) {
+		case pin_slot::input: state.world.enable_high_transistor_set_input_net(id, n); break;
+		case pin_slot::output: state.world.enable_high_transistor_set_output_net(id, n); break;
+		case pin_slot::control: state.world.enable_high_transistor_set_control_net(id, n); break;
+		}
+		break;
+	}
+	case item_kind::enable_low_transistor:
+	{
+		auto id = dcon::enable_low_transistor_id{ dcon::enable_low_transistor_id::value_base_t(pin.index()) };
+		switch(pin.slot()) {
+		case pin_slot::input: state.world.enable_low_transistor_set_input_net(id, n); break;
+		case pin_slot::output: state.world.enable_low_transistor_set_output_net(id, n); break;
+		case pin_slot::control: state.world.enable_low_transistor_set_control_net(id, n); break;
+		}
+		break;
+	}
+	case item_kind::wire_segment:
+		state.world.wire_segment_set_net(dcon::wire_segment_id{ dcon::wire_segment_id::value_base_t(pin.index()) }, n);
+		break;
+	case item_kind::module_instance:
+	{
+		auto id = dcon::module_instance_id{ dcon::module_instance_id::value_base_t(pin.index()) };
+		auto& def = state.modules.definitions[state.world.module_instance_get_definition(id)];
+		def.instance_port_nets[size_t(state.world.module_instance_get_state_slot(id)) * def.ports.size() + uint32_t(pin.slot())] = n;
+		break;
+	}
+	}
+}
+
+} // namespace circuit
@@ -0,0 +1,164 @@
+#pragma once
+#include <stdint.h>
+#include "dcon_generated_ids.hpp"
+#include "constants_dcon.hpp"
+#include "constants.hpp"
+#include "system_state_forward.hpp"
+
+// the persistent board: placed components and wires live in the dcon world as
+// compactable (i.e. always densely packed) objects, one object type per kind of part,
+// so that the simulation can sweep each kind with a flat, branch free loop
+
+namespace circuit {
+
+struct grid_point {
+	int16_t x = 0;
+	int16_t y = 0;
+
+	bool operator==(grid_point const& o) const noexcept = default;
+};
+
+inline uint32_t pack_point(grid_point p) {
+	return (uint32_t(uint16_t(p.x)) << 16) | uint32_t(uint16_t(p.y));
+}
+inline grid_point unpack_point(uint32_t v) {
+	return grid_point{ int16_t(uint16_t(v >> 16)), int16_t(uint16_t(v & 0xFFFF)) };
+}
+
+inline grid_point step(grid_point p, sys::orientation o) {
+	switch(o) {
+	case sys::orientation::right:
+		return grid_point{ int16_t(p.x + 1), p.y };
+	case sys::orientation::down:
+		return grid_point{ p.x, int16_t(p.y + 1) };
+	case sys::orientation::left:
+		return grid_point{ int16_t(p.x - 1), p.y };
+	case sys::orientation::up:
+		return grid_point{ p.x, int16_t(p.y - 1) };
+	}
+	return p;
+}
+inline sys::orientation reverse(sys::orientation o) {
+	return sys::orientation((uint8_t(o) + 2) & 3);
+}
+inline sys::orientation rotate_clockwise(sys::orientation o) {
+	return sys::orientation((uint8_t(o) + 1) & 3);
+}
+inline sys::orientation rotate_counter_clockwise(sys::orientation o) {
+	return sys::orientation((uint8_t(o) + 3) & 3);
+}
+
+enum class item_kind : uint8_t {
+	diode = 0, enable_high_transistor = 1, enable_low_transistor = 2, wire_segment = 3, module_instance = 4
+};
+constexpr inline uint32_t item_kind_count = 5;
+
+// for components: which terminal; for wire segments: 0 is the start and 1 the end of the segment;
+// for module instances: the index of the port
+enum class pin_slot : uint8_t {
+	input = 0, output = 1, control = 2
+};
+constexpr inline uint32_t max_module_ports = 32;
+
+inline uint32_t pin_count(item_kind k) {
+	switch(k) {
+	case item_kind::diode:
+		return 2;
+	case item_kind::enable_high_transistor:
+	case item_kind::enable_low_transistor:
+		return 3;
+	case item_kind::wire_segment:
+		return 2;
+	case item_kind::module_instance: // depends on the definition; see item_pin_count
+		return 0;
+	}
+	return 0;
+}
+
+// a reference to a placed part (or to one of its pins) packed into 32 bits:
+// 3 bits of kind, 5 bits of pin slot, and 24 bits of index into the dcon storage for that kind
+struct board_item {
+	uint32_t value = 0;
+
+	static constexpr uint32_t max_index = (uint32_t(1) << 24) - 1;
+
+	constexpr board_item() noexcept = default;
+	constexpr board_item(item_kind k, uint32_t index, pin_slot s = pin_slot::input) noexcept : value((index << 8) | (uint32_t(s) << 3) | uint32_t(k)) { }
+
+	constexpr item_kind kind() const noexcept {
+		return item_kind(value & 0x07);
+	}
+	constexpr pin_slot slot() const noexcept {
+		return pin_slot((value >> 3) & 0x1F);
+	}
+	constexpr uint32_t index() const noexcept {
+		return value >> 8;
+	}
+	constexpr board_item part() const noexcept {
+		return board_item(kind(), index());
+	}
+	constexpr board_item with_slot(pin_slot s) const noexcept {
+		return board_item(kind(), index(), s);
+	}
+	constexpr bool operator==(board_item const& o) const noexcept = default;
+};
+
+inline item_kind to_item_kind(sys::basic_component_type t) {
+	switch(t) {
+	case sys::basic_component_type::diode:
+		return item_kind::diode;
+	case sys::basic_component_type::enable_high_transistor:
+		return item_kind::enable_high_transistor;
+	case sys::basic_component_type::enable_low_transistor:
+		return item_kind::enable_low_transistor;
+	}
+	return item_kind::diode;
+}
+
+inline grid_point component_pin_position(grid_point p, sys::orientation o, pin_slot s) {
+	switch(s) {
+	case pin_slot::input:
+		return step(p, reverse(o));
+	case pin_slot::output:
+		return step(p, o);
+	case pin_slot::control:
+		return step(p, rotate_counter_clockwise(o));
+	}
+	return p;
+}
+
+// everything needed to place a part again, independent of where it is stored
+struct part_description {
+	grid_point position; // for wires, the start
+	grid_point end; // wires only
+	item_kind kind = item_kind::diode;
+	sys::orientation orientation{ }; // components only
+	sys::wire_colors color{ }; // wires only
+	uint32_t definition = 0; // module instances only
+
+	bool operator==(part_description const& o) const noexcept = default;
+};
+
+// board editing; these must only be called from the thread that owns the game state
+board_item place_component(sys::state& state, sys::basic_component_type type, grid_point p, sys::orientation o);
+board_item place_wire(sys::state& state, grid_point start, grid_point end, sys::wire_colors color);
+board_item place_module_instance(sys::state& state, uint32_t definition, grid_point p);
+void remove_item(sys::state& state, board_item item);
+void move_item(sys::state& state, board_item item, int16_t dx, int16_t dy);
+part_description describe_item(sys::state& state, board_item item);
+board_item place_described(sys::state& state, part_description const& d);
+uint32_t item_count(sys::state& state, item_kind k);
+bool item_is_valid(sys::state& state, board_item item);
+uint32_t item_pin_count(sys::state& state, board_item item);
+// whether the pin drives the net it is on (component outputs and module output ports) rather than reading it;
+// wire endpoints do neither
+bool pin_is_driver(sys::state& state, board_item pin);
+
+// the location of a component (for wires, the start point) and of any individual pin
+grid_point item_position(sys::state& state, board_item item);
+grid_point pin_position(sys::state& state, board_item pin);
+
+dcon::net_id pin_net(sys::state& state, board_item pin);
+void set_pin_net(sys::state& state, board_item pin, dcon::net_id n);
+
+} // namespace circuit
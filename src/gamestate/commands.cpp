@@ -1,6 +1,8 @@
 #include "commands.hpp"
 #include "system_state.hpp"
 #include "game_scene.hpp"
+#include "selection.hpp"
+#include "journal.hpp"
 
 namespace command {
 
@@ -9,45 +11,316 @@ bool is_console_command(command_type t) {
 }
 
 void add_to_command_queue(sys::state& state, command_data& p) {
-	assert(command::can_perform_command(state, p));
-	bool b = state.incoming_commands.try_push(p);
+	if(std::this_thread::get_id() == state.ui_thread) {
+		// the ui thread holds the ui lock while it handles input, so it may check the command against the game state;
+		// and since the game thread needs that lock to empty the queue, the ui thread cannot wait for room: when the
+		// queue is full the command is dropped
+		assert(command::can_perform_command(state, p));
+		bool b = state.incoming_commands.try_push(p);
+	} else {
+		// any other thread (such as a tool generating parts) may not read the game state, and may queue commands that
+		// depend on ones still waiting, such as placing an instance of a module it has just defined, so only the
+		// payload is checked here and the rest when the command is executed. it waits for room instead
+		assert(command::command_is_well_formed(p));
+		while(!state.incoming_commands.try_push(p)) {
+			state.wake_game_thread();
+			std::this_thread::yield();
+		}
+	}
+	state.wake_game_thread();
 }
 
+void place_component(sys::state& state, sys::basic_component_type type, circuit::grid_point p, sys::orientation o) {
+	command_data c{ command_type::place_component };
+	place_component_data data{ p.x, p.y, type, o };
+	c << data;
+	add_to_command_queue(state, c);
+}
+bool can_place_component(sys::state& state, sys::basic_component_type type, circuit::grid_point p, sys::orientation o) {
+	if(uint8_t(type) > uint8_t(sys::basic_component_type::enable_low_transistor))
+		return false;
+	if(uint8_t(o) > sys::max_orientation)
+		return false;
+	return true;
+}
+void execute_place_component(sys::state& state, sys::basic_component_type type, circuit::grid_point p, sys::orientation o) {
+	circuit::place_component(state, type, p, o);
+}
 
+void place_wire(sys::state& state, circuit::grid_point start, circuit::grid_point end, sys::wire_colors color) {
+	command_data c{ command_type::place_wire };
+	place_wire_data data{ start.x, start.y, end.x, end.y, color };
+	c << data;
+	add_to_command_queue(state, c);
+}
+bool can_place_wire(sys::state& state, circuit::grid_point start, circuit::grid_point end, sys::wire_colors color) {
+	if(uint8_t(color) > sys::max_wire_color)
+		return false;
+	if(start == end)
+		return false;
+	return true;
+}
+void execute_place_wire(sys::state& state, circuit::grid_point start, circuit::grid_point end, sys::wire_colors color) {
+	circuit::place_wire(state, start, end, color);
+}
 
+void define_module(sys::state& state, circuit::grid_point top_left, circuit::grid_point bottom_right, std::span<circuit::module_port const> ports) {
+	command_data c{ command_type::define_module };
+	define_module_data data{ top_left.x, top_left.y, bottom_right.x, bottom_right.y, uint8_t(ports.size()) };
+	c << data;
+	c.push_ptr(ports.data(), ports.size());
+	add_to_command_queue(state, c);
+}
+bool can_define_module(sys::state& state, circuit::grid_point top_left, circuit::grid_point bottom_right, std::span<circuit::module_port const> ports) {
+	if(top_left.x > bottom_right.x || top_left.y > bottom_right.y)
+		return false;
+	if(ports.empty() || ports.size() > circuit::max_module_ports)
+		return false;
+	return true;
+}
+void execute_define_module(sys::state& state, circuit::grid_point top_left, circuit::grid_point bottom_right, std::span<circuit::module_port const> ports) {
+	circuit::define_module(state, top_left, bottom_right, ports);
+}
 
-bool can_perform_command(sys::state& state, command_data& c) {
-	switch(c.header.type) {
-	case command_type::invalid:
-		assert(false && "Invalid command received"); // invalid command
-		break;
-	//case command_type::change_nat_focus:
-	//{
-	//	auto& data = c.get_payload<command::national_focus_data>();
-	//	return can_set_national_focus(state, source, data.target_state, data.focus);
-	//}
+void place_module_instance(sys::state& state, uint32_t definition, circuit::grid_point p) {
+	command_data c{ command_type::place_module_instance };
+	place_module_instance_data data{ p.x, p.y, definition };
+	c << data;
+	add_to_command_queue(state, c);
+}
+bool can_place_module_instance(sys::state& state, uint32_t definition, circuit::grid_point p) {
+	return definition < state.modules.definitions.size();
+}
+void execute_place_module_instance(sys::state& state, uint32_t definition, circuit::grid_point p) {
+	circuit::place_module_instance(state, definition, p);
+}
+
+void delete_region(sys::state& state, circuit::grid_point top_left, circuit::grid_point bottom_right) {
+	command_data c{ command_type::delete_region };
+	region_data data{ top_left.x, top_left.y, bottom_right.x, bottom_right.y };
+	c << data;
+	add_to_command_queue(state, c);
+}
+bool can_delete_region(sys::state& state, circuit::grid_point top_left, circuit::grid_point bottom_right) {
+	return top_left.x <= bottom_right.x && top_left.y <= bottom_right.y;
+}
+void execute_delete_region(sys::state& state, circuit::grid_point top_left, circuit::grid_point bottom_right) {
+	circuit::delete_region(state, top_left, bottom_right);
+}
+
+// the region, once offset, must still lie on the board
+bool region_offset_is_valid(circuit::grid_point top_left, circuit::grid_point bottom_right, int16_t dx, int16_t dy) {
+	if(top_left.x > bottom_right.x || top_left.y > bottom_right.y)
+		return false;
+	if(dx == 0 && dy == 0)
+		return false;
+	auto in_range = [](int32_t v) { return INT16_MIN <= v && v <= INT16_MAX; };
+	return in_range(int32_t(top_left.x) + dx) && in_range(int32_t(bottom_right.x) + dx)
+		&& in_range(int32_t(top_left.y) + dy) && in_range(int32_t(bottom_right.y) + dy);
+}
+
+void move_region(sys::state& state, circuit::grid_point top_left, circuit::grid_point bottom_right, int16_t dx, int16_t dy) {
+	command_data c{ command_type::move_region };
+	region_offset_data data{ top_left.x, top_left.y, bottom_right.x, bottom_right.y, dx, dy };
+	c << data;
+	add_to_command_queue(state, c);
+}
+bool can_move_region(sys::state& state, circuit::grid_point top_left, circuit::grid_point bottom_right, int16_t dx, int16_t dy) {
+	return region_offset_is_valid(top_left, bottom_right, dx, dy);
+}
+void execute_move_region(sys::state& state, circuit::grid_point top_left, circuit::grid_point bottom_right, int16_t dx, int16_t dy) {
+	circuit::move_region(state, top_left, bottom_right, dx, dy);
+}
+
+void duplicate_region(sys::state& state, circuit::grid_point top_left, circuit::grid_point bottom_right, int16_t dx, int16_t dy) {
+	command_data c{ command_type::duplicate_region };
+	region_offset_data data{ top_left.x, top_left.y, bottom_right.x, bottom_right.y, dx, dy };
+	c << data;
+	add_to_command_queue(state, c);
+}
+bool can_duplicate_region(sys::state& state, circuit::grid_point top_left, circuit::grid_point bottom_right, int16_t dx, int16_t dy) {
+	return region_offset_is_valid(top_left, bottom_right, dx, dy);
+}
+void execute_duplicate_region(sys::state& state, circuit::grid_point top_left, circuit::grid_point bottom_right, int16_t dx, int16_t dy) {
+	circuit::duplicate_region(state, top_left, bottom_right, dx, dy);
+}
+
+void undo(sys::state& state) {
+	command_data c{ command_type::undo };
+	add_to_command_queue(state, c);
+}
+bool can_undo(sys::state& state) {
+	return !state.journal.undo_entries.empty();
+}
+void execute_undo(sys::state& state) {
+	command::undo_last_change(state);
+}
+
+void redo(sys::state& state) {
+	command_data c{ command_type::redo };
+	add_to_command_queue(state, c);
+}
+bool can_redo(sys::state& state) {
+	return !state.journal.redo_entries.empty();
+}
+void execute_redo(sys::state& state) {
+	command::redo_last_change(state);
+}
+
+
+
+
+// the entries of the dispatch table: each reads the payload of its command and forwards it to the can_ or execute_
+// function above. the payload size has been checked against the table before any of them is called
+
+bool validate_place_component(sys::state& state, command_data& c) {
+	auto& data = c.get_payload<command::place_component_data>();
+	return can_place_component(state, data.type, circuit::grid_point{ data.x, data.y }, data.orientation);
+}
+void dispatch_place_component(sys::state& state, command_data& c) {
+	auto& data = c.get_payload<command::place_component_data>();
+	execute_place_component(state, data.type, circuit::grid_point{ data.x, data.y }, data.orientation);
+}
+
+bool validate_place_wire(sys::state& state, command_data& c) {
+	auto& data = c.get_payload<command::place_wire_data>();
+	return can_place_wire(state, circuit::grid_point{ data.start_x, data.start_y }, circuit::grid_point{ data.end_x, data.end_y }, data.color);
+}
+void dispatch_place_wire(sys::state& state, command_data& c) {
+	auto& data = c.get_payload<command::place_wire_data>();
+	execute_place_wire(state, circuit::grid_point{ data.start_x, data.start_y }, circuit::grid_point{ data.end_x, data.end_y }, data.color);
+}
+
+bool validate_define_module(sys::state& state, command_data& c) {
+	auto& data = c.get_payload<command::define_module_data>();
+	if(!c.check_variable_size_payload<command::define_module_data>(uint32_t(sizeof(circuit::module_port) * data.port_count)))
+		return false;
+	auto ports = std::span<circuit::module_port const>(reinterpret_cast<circuit::module_port const*>(c.payload.data() + sizeof(command::define_module_data)), data.port_count);
+	return can_define_module(state, circuit::grid_point{ data.left, data.top }, circuit::grid_point{ data.right, data.bottom }, ports);
+}
+void dispatch_define_module(sys::state& state, command_data& c) {
+	auto& data = c.get_payload<command::define_module_data>();
+	auto ports = std::span<circuit::module_port const>(reinterpret_cast<circuit::module_port const*>(c.payload.data() + sizeof(command::define_module_data)), data.port_count);
+	execute_define_module(state, circuit::grid_point{ data.left, data.top }, circuit::grid_point{ data.right, data.bottom }, ports);
+}
+
+bool validate_place_module_instance(sys::state& state, command_data& c) {
+	auto& data = c.get_payload<command::place_module_instance_data>();
+	return can_place_module_instance(state, data.definition, circuit::grid_point{ data.x, data.y });
+}
+void dispatch_place_module_instance(sys::state& state, command_data& c) {
+	auto& data = c.get_payload<command::place_module_instance_data>();
+	execute_place_module_instance(state, data.definition, circuit::grid_point{ data.x, data.y });
+}
+
+bool validate_delete_region(sys::state& state, command_data& c) {
+	auto& data = c.get_payload<command::region_data>();
+	return can_delete_region(state, circuit::grid_point{ data.left, data.top }, circuit::grid_point{ data.right, data.bottom });
+}
+void dispatch_delete_region(sys::state& state, command_data& c) {
+	auto& data = c.get_payload<command::region_data>();
+	execute_delete_region(state, circuit::grid_point{ data.left, data.top }, circuit::grid_point{ data.right, data.bottom });
+}
+
+bool validate_move_region(sys::state& state, command_data& c) {
+	auto& data = c.get_payload<command::region_offset_data>();
+	return can_move_region(state, circuit::grid_point{ data.left, data.top }, circuit::grid_point{ data.right, data.bottom }, data.dx, data.dy);
+}
+void dispatch_move_region(sys::state& state, command_data& c) {
+	auto& data = c.get_payload<command::region_offset_data>();
+	execute_move_region(state, circuit::grid_point{ data.left, data.top }, circuit::grid_point{ data.right, data.bottom }, data.dx, data.dy);
+}
+
+bool validate_duplicate_region(sys::state& state, command_data& c) {
+	auto& data = c.get_payload<command::region_offset_data>();
+	return can_duplicate_region(state, circuit::grid_point{ data.left, data.top }, circuit::grid_point{ data.right, data.bottom }, data.dx, data.dy);
+}
+void dispatch_duplicate_region(sys::state& state, command_data& c) {
+	auto& data = c.get_payload<command::region_offset_data>();
+	execute_duplicate_region(state, circuit::grid_point{ data.left, data.top }, circuit::grid_point{ data.right, data.bottom }, data.dx, data.dy);
+}
+
+bool validate_undo(sys::state& state, command_data& c) {
+	return can_undo(state);
+}
+void dispatch_undo(sys::state& state, command_data& c) {
+	execute_undo(state);
+}
+
+bool validate_redo(sys::state& state, command_data& c) {
+	return can_redo(state);
+}
+void dispatch_redo(sys::state& state, command_data& c) {
+	execute_redo(state);
+}
+
+template<typename data_type>
+constexpr command_type_data fixed_size_command(bool (*validate)(sys::state&, command_data&), void (*execute)(sys::state&, command_data&)) {
+	return command_type_data{ uint32_t(sizeof(data_type)), uint32_t(sizeof(data_type)), validate, execute };
+}
+
+constexpr std::array<command_type_data, command_type_count> make_command_type_handlers() {
+	std::array<command_type_data, command_type_count> t{ };
+	t[size_t(command_type::place_component)] = fixed_size_command<place_component_data>(validate_place_component, dispatch_place_component);
+	t[size_t(command_type::place_wire)] = fixed_size_command<place_wire_data>(validate_place_wire, dispatch_place_wire);
+	t[size_t(command_type::define_module)] = command_type_data{
+		uint32_t(sizeof(define_module_data)), uint32_t(sizeof(define_module_data) + sizeof(circuit::module_port) * circuit::max_module_ports),
+		validate_define_module, dispatch_define_module };
+	t[size_t(command_type::place_module_instance)] = fixed_size_command<place_module_instance_data>(validate_place_module_instance, dispatch_place_module_instance);
+	t[size_t(command_type::delete_region)] = fixed_size_command<region_data>(validate_delete_region, dispatch_delete_region);
+	t[size_t(command_type::move_region)] = fixed_size_command<region_offset_data>(validate_move_region, dispatch_move_region);
+	t[size_t(command_type::duplicate_region)] = fixed_size_command<region_offset_data>(validate_duplicate_region, dispatch_duplicate_region);
+	t[size_t(command_type::undo)] = command_type_data{ 0, 0, validate_undo, dispatch_undo };
+	t[size_t(command_type::redo)] = command_type_data{ 0, 0, validate_redo, dispatch_redo };
+	return t;
+}
+constexpr std::array<command_type_data, command_type_count> command_type_handlers = make_command_type_handlers();
+
+// every command fits in the inline payload
+static_assert([]() {
+	for(auto& h : command_type_handlers) {
+		if(h.max_payload_size > command_data::max_payload_size)
+			return false;
 	}
-	return false;
+	return true;
+}());
+
+command_type_data const* command_type_handler(command_type t) {
+	if(size_t(t) >= command_type_handlers.size() || !command_type_handlers[size_t(t)].execute)
+		return nullptr;
+	return &command_type_handlers[size_t(t)];
+}
+
+bool command_is_well_formed(command_data& c) {
+	auto handler = command_type_handler(c.header.type);
+	if(!handler) {
+		assert(c.header.type != command_type::invalid && "Invalid command received"); // invalid command
+		return false;
+	}
+	return c.header.payload_size >= handler->min_payload_size && c.header.payload_size <= handler->max_payload_size;
+}
+
+bool can_perform_command(sys::state& state, command_data& c) {
+	if(!command_is_well_formed(c))
+		return false;
+	return command_type_handlers[size_t(c.header.type)].validate(state, c);
+}
+
+// performs the command without marking it as a tick of its own; see execute_command and execute_pending_commands
+bool perform_command(sys::state& state, command_data& c) {
+	if(!can_perform_command(state, c))
+		return false;
+	journal_begin(state, c);
+	command_type_handlers[size_t(c.header.type)].execute(state, c);
+	journal_end(state);
+	return true;
 }
 
 bool execute_command(sys::state& state, command_data& c) {
 	if(!can_perform_command(state, c))
 		return false;
 	state.tick_start_counter.fetch_add(1, std::memory_order::seq_cst);
-	
-	switch(c.header.type) {
-	case command_type::invalid:
-	{
-		assert(false && "Invalid command received"); // invalid command
-		break;
-	}
-	//case command_type::change_nat_focus:
-	//{
-	//	auto& data = c.get_payload<command::national_focus_data>();
-	//	execute_set_national_focus(state, source_nation, data.target_state, data.focus);
-	//	break;
-	//}
-	}
+	perform_command(state, c);
 	state.tick_end_counter.fetch_add(1, std::memory_order::seq_cst);
 	return true;
 }
@@ -55,17 +328,34 @@ bool execute_command(sys::state& state, command_data& c) {
 
 void execute_pending_commands(sys::state& state) {
 	auto* c = state.incoming_commands.front();
-	bool command_executed = false;
-	while(c) {
-		command_executed = true;
-		execute_command(state, *c);
-		state.incoming_commands.pop();
-		c = state.incoming_commands.front();
-	}
+	if(!c)
+		return;
 
-	if(command_executed) {
-		state.game_state_updated.store(true, std::memory_order::release);
+	// commands edit the board, which the ui thread reads while it handles input, so they run under the ui lock
+	state.yield_ui_lock = true;
+	{
+		std::lock_guard lock(state.ui_lock);
+		// the commands waiting now are executed as one batch, counted as a single tick; commands arriving meanwhile
+		// are left for the next batch. a large batch rebuilds the netlist once at its end rather than updating it
+		// after every command
+		auto batch = state.incoming_commands.size();
+		bool bulk = batch > circuit::bulk_edit_threshold;
+		if(bulk)
+			circuit::suspend_netlist(state);
+		state.tick_start_counter.fetch_add(1, std::memory_order::seq_cst);
+		for(; batch > 0 && c; --batch) {
+			perform_command(state, *c);
+			state.incoming_commands.pop();
+			c = state.incoming_commands.front();
+		}
+		state.tick_end_counter.fetch_add(1, std::memory_order::seq_cst);
+		if(bulk)
+			circuit::resume_netlist(state);
+		state.yield_ui_lock = false;
 	}
+	state.ui_lock_cv.notify_one();
+
+	state.game_state_updated.store(true, std::memory_order::release);
 }
 
 } // namespace command
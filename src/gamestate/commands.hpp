@@ -5,32 +5,117 @@
 #include "constants.hpp"
 #include "container_types.hpp"
 #include "commands_containers.hpp"
+#include "circuit.hpp"
+#include "module.hpp"
 namespace command {
 
 enum class command_type : uint8_t {
 	invalid = 0,
-	
+	place_component = 1,
+	place_wire = 2,
+	define_module = 3,
+	place_module_instance = 4,
+	delete_region = 5,
+	move_region = 6,
+	duplicate_region = 7,
+	undo = 8,
+	redo = 9,
+	// update command_type_count when adding a command
 };
 
+struct place_component_data {
+	int16_t x;
+	int16_t y;
+	sys::basic_component_type type;
+	sys::orientation orientation;
+};
+struct place_wire_data {
+	int16_t start_x;
+	int16_t start_y;
+	int16_t end_x;
+	int16_t end_y;
+	sys::wire_colors color;
+};
+// followed by port_count circuit::module_port
+struct define_module_data {
+	int16_t left;
+	int16_t top;
+	int16_t right;
+	int16_t bottom;
+	uint8_t port_count;
+};
+struct place_module_instance_data {
+	int16_t x;
+	int16_t y;
+	uint32_t definition;
+};
+struct region_data {
+	int16_t left;
+	int16_t top;
+	int16_t right;
+	int16_t bottom;
+};
+struct region_offset_data {
+	int16_t left;
+	int16_t top;
+	int16_t right;
+	int16_t bottom;
+	int16_t dx;
+	int16_t dy;
+};
+
+
+constexpr inline uint32_t command_type_count = 10; // one more than the highest command_type
 
+// a row of the dispatch table, which is indexed by command_type: the bounds on the size of the payload and the
+// functions that check and perform the command
 struct command_type_data {
-	uint32_t min_payload_size;
-	uint32_t max_payload_size;
-	command_type_data(uint32_t _min_payload_size, uint32_t _max_payload_size) {
-		min_payload_size = _min_payload_size;
-		max_payload_size = _max_payload_size;
-	}
+	uint32_t min_payload_size = 0;
+	uint32_t max_payload_size = 0;
+	bool (*validate)(sys::state& state, command_data& c) = nullptr;
+	void (*execute)(sys::state& state, command_data& c) = nullptr;
 };
+// null for values that are not commands
+command_type_data const* command_type_handler(command_type t);
 
+void place_component(sys::state& state, sys::basic_component_type type, circuit::grid_point p, sys::orientation o);
+bool can_place_component(sys::state& state, sys::basic_component_type type, circuit::grid_point p, sys::orientation o);
 
-static ankerl::unordered_dense::map<command::command_type, command::command_type_data> command_type_handlers = {
-	//{command_type::change_nat_focus, command_type_data{ sizeof(command::national_focus_data), sizeof(command::national_focus_data) } },
-};
+void place_wire(sys::state& state, circuit::grid_point start, circuit::grid_point end, sys::wire_colors color);
+bool can_place_wire(sys::state& state, circuit::grid_point start, circuit::grid_point end, sys::wire_colors color);
+
+// port positions are in board coordinates
+void define_module(sys::state& state, circuit::grid_point top_left, circuit::grid_point bottom_right, std::span<circuit::module_port const> ports);
+bool can_define_module(sys::state& state, circuit::grid_point top_left, circuit::grid_point bottom_right, std::span<circuit::module_port const> ports);
+
+void place_module_instance(sys::state& state, uint32_t definition, circuit::grid_point p);
+bool can_place_module_instance(sys::state& state, uint32_t definition, circuit::grid_point p);
+
+// act on every part lying entirely within the rectangle
+void delete_region(sys::state& state, circuit::grid_point top_left, circuit::grid_point bottom_right);
+bool can_delete_region(sys::state& state, circuit::grid_point top_left, circuit::grid_point bottom_right);
+
+void move_region(sys::state& state, circuit::grid_point top_left, circuit::grid_point bottom_right, int16_t dx, int16_t dy);
+bool can_move_region(sys::state& state, circuit::grid_point top_left, circuit::grid_point bottom_right, int16_t dx, int16_t dy);
+
+void duplicate_region(sys::state& state, circuit::grid_point top_left, circuit::grid_point bottom_right, int16_t dx, int16_t dy);
+bool can_duplicate_region(sys::state& state, circuit::grid_point top_left, circuit::grid_point bottom_right, int16_t dx, int16_t dy);
+
+// take back or reapply the most recent change to the board (see journal.hpp); nothing happens if there is none
+void undo(sys::state& state);
+bool can_undo(sys::state& state);
+
+void redo(sys::state& state);
+bool can_redo(sys::state& state);
 
+// the senders above may be called from any thread; a thread other than the ui thread waits while the queue is full,
+// and its commands are only checked against the game state when they are executed
 // returns true if the command was performed, false if not
 bool execute_command(sys::state& state, command_data& c);
 void execute_pending_commands(sys::state& state);
 bool can_perform_command(sys::state& state, command_data& c);
+// whether the command is of a known type with a payload of the right size, which needs no access to the game state
+bool command_is_well_formed(command_data& c);
 
 
 } // namespace command
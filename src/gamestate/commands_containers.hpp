@@ -1,4 +1,7 @@
 #pragma once
+#include <array>
+#include <cstring>
+#include <type_traits>
 
 
 namespace command {
@@ -10,9 +13,13 @@ struct cmd_header {
 	command_type type;
 };
 
+// the payload is stored inline, so that pushing a command into the queue and executing it never allocates; every
+// command must fit in max_payload_size bytes (see make_command_type_handlers)
 struct command_data {
+	static constexpr uint32_t max_payload_size = 256;
+
 	cmd_header header{};
-	std::vector<uint8_t> payload;
+	alignas(8) std::array<uint8_t, max_payload_size> payload;
 	command_data() {
 	};
 	command_data(command_type _type) {
@@ -23,24 +30,21 @@ struct command_data {
 	friend command_data& operator << (command_data& msg, data_type& data) {
 
 		static_assert(std::is_standard_layout<data_type>::value, "Data type is too complex");
-		size_t curr_size = msg.payload.size();
-		msg.payload.resize(msg.payload.size() + sizeof(data_type));
-
-		std::memcpy(msg.payload.data() + curr_size, &data, sizeof(data_type));
+		static_assert(sizeof(data_type) <= max_payload_size, "Data type is larger than max_payload_size");
+		assert(msg.header.payload_size + sizeof(data_type) <= max_payload_size);
 
-		msg.header.payload_size = (uint32_t)msg.payload.size();
+		std::memcpy(msg.payload.data() + msg.header.payload_size, &data, sizeof(data_type));
+		msg.header.payload_size += uint32_t(sizeof(data_type));
 
 		return msg;
 	}
 	// adds data from pointer to the payload
 	template<typename data_type>
 	void push_ptr(data_type* ptr, size_t size) {
-		size_t curr_size = payload.size();
-		payload.resize(payload.size() + sizeof(data_type) * size);
-
-		std::memcpy(payload.data() + curr_size, ptr, sizeof(data_type) * size);
+		assert(header.payload_size + sizeof(data_type) * size <= max_payload_size);
 
-		header.payload_size = (uint32_t)payload.size();
+		std::memcpy(payload.data() + header.payload_size, ptr, sizeof(data_type) * size);
+		header.payload_size += uint32_t(sizeof(data_type) * size);
 	}
 
 
@@ -49,44 +53,30 @@ struct command_data {
 	friend command_data& operator >> (command_data& msg, data_type& data) {
 
 		static_assert(std::is_standard_layout<data_type>::value, "Data type is too complex");
+		assert(msg.header.payload_size >= sizeof(data_type));
 
-		size_t i = msg.payload.size() - sizeof(data_type);
-		std::memcpy(&data, msg.payload.data() + i, sizeof(data_type));
-		msg.payload.resize(i);
-
-		msg.header.payload_size = (uint32_t)msg.payload.size();
+		msg.header.payload_size -= uint32_t(sizeof(data_type));
+		std::memcpy(&data, msg.payload.data() + msg.header.payload_size, sizeof(data_type));
 
 		return msg;
-
-
-
 	}
-	// Makes a copy of the data and returns it
-	/*template<typename data_type>
-	data_type copy_payload() const {
-
-		static_assert(std::is_standard_layout<data_type>::value, "Data type is too complex");
-		static_assert(sizeof(data_type) <= MAX_PAYLOAD_SIZE, "data type used is larger than MAX_PAYLOAD_SIZE. Did you forget to add it?");
-
-		data_type output{ };
-		std::memcpy(&output, payload.data() + (payload.size() - sizeof(data_type)), sizeof(data_type));
-		return output;
-	}*/
-	// returns a reference to the payload of the desired type, starting from the start of the vector
+	// returns a reference to the payload of the desired type, starting from the start of the buffer
 	template<typename data_type>
 	data_type& get_payload() {
 		static_assert(std::is_standard_layout<data_type>::value, "Data type is too complex");
+		static_assert(alignof(data_type) <= 8, "Data type is overaligned");
 		uint8_t* ptr = payload.data();
 		return reinterpret_cast<data_type&>(*ptr);
 	}
 	// Checks if the payload of the given type has an additional variable payload of size "expected_size" (in bytes). Returns true if that is the case, false otherwise
 	template<typename data_type>
 	bool check_variable_size_payload(uint32_t expected_size) {
-		return expected_size == (payload.size() - sizeof(data_type));
+		return header.payload_size >= sizeof(data_type) && expected_size == (header.payload_size - sizeof(data_type));
 	}
 
 };
 static_assert(sizeof(command_data) == sizeof(command_data::header) + sizeof(command_data::payload));
+static_assert(std::is_trivially_copyable_v<command_data>);
 
 }
 
@@ -3,6 +3,9 @@
 #include "user_interactions.hpp"
 #include "alice_ui.hpp"
 #include "opengl_wrapper.hpp"
+#include "board_renderer.hpp"
+#include "commands.hpp"
+#include "selection.hpp"
 
 namespace game_scene {
 
@@ -10,6 +13,8 @@ void in_game_hotkeys(sys::state& state, sys::virtual_key keycode, sys::key_modif
 void do_nothing_hotkeys(sys::state& state, sys::virtual_key keycode, sys::key_modifiers mod);
 void render_module_contents(sys::state& state);
 void in_game_scroll(sys::state& state, int32_t x, int32_t y, sys::key_modifiers mod, float amount);
+void select_board_region(sys::state& state, int32_t x, int32_t y, sys::key_modifiers mod);
+void refresh_selection(sys::state& state);
 
 sys::virtual_key replace_keycodes_identity(sys::state& state, sys::virtual_key keycode, sys::key_modifiers mod) {
 	return keycode;
@@ -42,9 +47,9 @@ void switch_scene(sys::state& state, scene_id ui_scene) {
 			.id = scene_id::in_game_basic,
 
 			.get_root = [](sys::state& state) { return state.ui_state.root.get(); },
-			.allow_drag_selection = false,
-			.on_drag_start = do_nothing_screen,
-			.drag_selection = do_nothing_screen,
+			.allow_drag_selection = true,
+			.on_drag_start = start_dragging,
+			.drag_selection = select_board_region,
 			.lbutton_up = do_nothing,
 			.keycode_mapping = replace_keycodes_identity,
 			.handle_hotkeys = in_game_hotkeys,
@@ -52,7 +57,7 @@ void switch_scene(sys::state& state, scene_id ui_scene) {
 			.recalculate_mouse_probe = recalculate_mouse_probe_identity,
 			.recalculate_tooltip_probe = recalculate_mouse_probe_identity,
 			.on_scroll = in_game_scroll,
-			.on_game_state_update = do_nothing,
+			.on_game_state_update = refresh_selection,
 		};
 		// move scene ui windows to front here
 
@@ -98,6 +103,8 @@ void render_module_contents(sys::state& state) {
 	glUniform1f(state.open_gl.ui_shader_border_size_uniform, float(state.zoom));
 
 	glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+
+	ogl::render_board(state);
 }
 
 void in_game_scroll(sys::state& state, int32_t x, int32_t y, sys::key_modifiers mod, float amount) {
@@ -155,6 +162,33 @@ void ui_lbutton(sys::state& state, sys::key_modifiers mod) {
 }
 
 
+// converts a window position to the nearest point of the board grid
+circuit::grid_point screen_to_grid(sys::state& state, int32_t x, int32_t y) {
+	auto half_x = int32_t(float(state.x_size) / state.user_settings.ui_scale) / 2;
+	auto half_y = int32_t(float(state.y_size) / state.user_settings.ui_scale) / 2;
+	auto board_x = float(x) / state.user_settings.ui_scale + float(state.x_offset - half_x);
+	auto board_y = float(y) / state.user_settings.ui_scale + float(state.y_offset - half_y);
+	return circuit::grid_point{ int16_t(std::round(board_x / float(state.zoom))), int16_t(std::round(board_y / float(state.zoom))) };
+}
+
+// called with the corner opposite x_drag_start, y_drag_start once a drag on the board ends; x, y is the lower right one
+void select_board_region(sys::state& state, int32_t x, int32_t y, sys::key_modifiers mod) {
+	state.has_selection = true;
+	state.selection_top_left = screen_to_grid(state, state.x_drag_start, state.y_drag_start);
+	state.selection_bottom_right = screen_to_grid(state, x, y);
+	circuit::select_region(state, state.selection_top_left, state.selection_bottom_right, state.selected_items);
+}
+
+void clear_selection(sys::state& state) {
+	state.has_selection = false;
+	state.selected_items.clear();
+}
+
+void refresh_selection(sys::state& state) {
+	if(state.has_selection)
+		circuit::select_region(state, state.selection_top_left, state.selection_bottom_right, state.selected_items);
+}
+
 void on_rbutton_down(sys::state& state, int32_t x, int32_t y, sys::key_modifiers mod) {
 	// Lose focus on text
 	state.ui_state.set_focus_target(state, nullptr);
@@ -165,6 +199,10 @@ void on_rbutton_down(sys::state& state, int32_t x, int32_t y, sys::key_modifiers
 		return;
 	}
 	// otherwise ...
+	if(std::holds_alternative<sys::wire>(state.active_component_tool)) {
+		// abandon the wire currently being drawn
+		state.active_component_tool = sys::wire{ };
+	}
 }
 
 void on_lbutton_down(sys::state& state, int32_t x, int32_t y, sys::key_modifiers mod) {
@@ -175,6 +213,31 @@ void on_lbutton_down(sys::state& state, int32_t x, int32_t y, sys::key_modifiers
 
 	// otherwise ...
 	state.ui_state.set_focus_target(state, nullptr);
+
+	if(state.current_scene.id != scene_id::in_game_basic)
+		return;
+
+	auto p = screen_to_grid(state, x, y);
+	if(std::holds_alternative<sys::basic_component_type>(state.active_component_tool)) {
+		auto type = std::get<sys::basic_component_type>(state.active_component_tool);
+		if(command::can_place_component(state, type, p, state.current_orientation))
+			command::place_component(state, type, p, state.current_orientation);
+	} else if(std::holds_alternative<sys::wire>(state.active_component_tool)) {
+		auto& w = std::get<sys::wire>(state.active_component_tool);
+		if(!w.start) {
+			w.start = sys::wire::position{ p.x, p.y };
+		} else {
+			auto start = circuit::grid_point{ w.start->x, w.start->y };
+			if(command::can_place_wire(state, start, p, state.current_wire_color))
+				command::place_wire(state, start, p, state.current_wire_color);
+			// continue drawing from the end of the segment just placed
+			w.start = sys::wire::position{ p.x, p.y };
+		}
+	} else {
+		// with no tool, dragging over the board selects the parts in the rectangle
+		clear_selection(state);
+		state.current_scene.on_drag_start(state, x, y, mod);
+	}
 }
 
 void on_lbutton_up_ui_click_hold_and_release(sys::state& state, int32_t x, int32_t y, sys::key_modifiers mod) {
@@ -264,12 +327,70 @@ sys::virtual_key replace_keycodes(sys::state& state, sys::virtual_key keycode, s
 }
 
 
+// delete removes the selected parts, ctrl+d places a copy of them beside the selection, which then moves to the copy,
+// and shift with an arrow key moves them a cell at a time; returns whether the key was used
+bool selection_hotkeys(sys::state& state, sys::virtual_key keycode, sys::key_modifiers mod) {
+	auto tl = state.selection_top_left;
+	auto br = state.selection_bottom_right;
+	auto offset_selection = [&](int16_t dx, int16_t dy) {
+		state.selection_top_left = circuit::grid_point{ int16_t(tl.x + dx), int16_t(tl.y + dy) };
+		state.selection_bottom_right = circuit::grid_point{ int16_t(br.x + dx), int16_t(br.y + dy) };
+	};
+
+	if(keycode == sys::virtual_key::DELETE_KEY && mod == sys::key_modifiers::modifiers_none) {
+		if(command::can_delete_region(state, tl, br))
+			command::delete_region(state, tl, br);
+		clear_selection(state);
+		return true;
+	}
+	if(keycode == sys::virtual_key::D && mod == sys::key_modifiers::modifiers_ctrl) {
+		auto dx = int16_t(br.x - tl.x + 1);
+		if(command::can_duplicate_region(state, tl, br, dx, 0)) {
+			command::duplicate_region(state, tl, br, dx, 0);
+			offset_selection(dx, 0);
+		}
+		return true;
+	}
+	if(mod == sys::key_modifiers::modifiers_shift) {
+		int16_t dx = 0;
+		int16_t dy = 0;
+		if(keycode == sys::virtual_key::LEFT)
+			dx = -1;
+		else if(keycode == sys::virtual_key::RIGHT)
+			dx = 1;
+		else if(keycode == sys::virtual_key::UP)
+			dy = -1;
+		else if(keycode == sys::virtual_key::DOWN)
+			dy = 1;
+		else
+			return false;
+		if(command::can_move_region(state, tl, br, dx, dy)) {
+			command::move_region(state, tl, br, dx, dy);
+			offset_selection(dx, dy);
+		}
+		return true;
+	}
+	return false;
+}
+
 void in_game_hotkeys(sys::state& state, sys::virtual_key keycode, sys::key_modifiers mod) {
 	if(state.ui_state.root->impl_on_key_down(state, keycode, mod) != ui::message_result::consumed) {
 		uint32_t ctrl_group = 0;
 		if(keycode == sys::virtual_key::ESCAPE) {
 			alice_ui::display_at_front<alice_ui::make_main_menu_base>(state);
 		}
+		if(state.has_selection && selection_hotkeys(state, keycode, mod))
+			return;
+		if(keycode == sys::virtual_key::Z && mod == sys::key_modifiers::modifiers_ctrl) {
+			if(command::can_undo(state))
+				command::undo(state);
+			return;
+		}
+		if(keycode == sys::virtual_key::Y && mod == sys::key_modifiers::modifiers_ctrl) {
+			if(command::can_redo(state))
+				command::redo(state);
+			return;
+		}
 		if(keycode == sys::virtual_key::A)
 			keycode = sys::virtual_key::LEFT;
 		if(keycode == sys::virtual_key::W)
@@ -306,6 +427,11 @@ void in_game_hotkeys(sys::state& state, sys::virtual_key keycode, sys::key_modif
 			state.y_offset = 0;
 			state.x_offset = 0;
 		}
+		if(keycode == sys::virtual_key::R) {
+			state.current_orientation = (int32_t(mod) & int32_t(sys::key_modifiers::modifiers_shift)) != 0
+				? circuit::rotate_counter_clockwise(state.current_orientation)
+				: circuit::rotate_clockwise(state.current_orientation);
+		}
 
 		sound::play_interface_sound(state, sound::get_click_sound(state), state.user_settings.interface_volume * state.user_settings.master_volume);
 	}
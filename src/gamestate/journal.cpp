@@ -0,0 +1,174 @@
+#include <cstring>
+#include <optional>
+#include "journal.hpp"
+#include "commands.hpp"
+#include "selection.hpp"
+#include "spatial_index.hpp"
+#include "netlist.hpp"
+#include "system_state.hpp"
+
+namespace command {
+
+void journal::clear() {
+	log.clear();
+	undo_entries.clear();
+	redo_entries.clear();
+	removed.clear();
+	placed.clear();
+	recording = false;
+}
+
+void journal_write_varint(std::vector<uint8_t>& out, uint32_t v) {
+	while(v >= 0x80) {
+		out.push_back(uint8_t(v | 0x80));
+		v >>= 7;
+	}
+	out.push_back(uint8_t(v));
+}
+void journal_write_coordinate(std::vector<uint8_t>& out, int16_t v) {
+	journal_write_varint(out, uint32_t((int32_t(v) << 1) ^ (int32_t(v) >> 31)));
+}
+
+void journal_write_part(std::vector<uint8_t>& out, circuit::part_description const& d) {
+	journal_write_varint(out, uint32_t(d.kind));
+	journal_write_coordinate(out, d.position.x);
+	journal_write_coordinate(out, d.position.y);
+	switch(d.kind) {
+	case circuit::item_kind::diode:
+	case circuit::item_kind::enable_high_transistor:
+	case circuit::item_kind::enable_low_transistor:
+		journal_write_varint(out, uint32_t(d.orientation));
+		break;
+	case circuit::item_kind::wire_segment:
+		journal_write_coordinate(out, d.end.x);
+		journal_write_coordinate(out, d.end.y);
+		journal_write_varint(out, uint32_t(d.color));
+		break;
+	case circuit::item_kind::module_instance:
+		journal_write_varint(out, d.definition);
+		break;
+	}
+}
+
+void journal_begin(sys::state& state, command_data const& c) {
+	auto& j = state.journal;
+	journal_write_varint(j.log, uint32_t(c.header.type));
+	journal_write_varint(j.log, c.header.payload_size);
+	j.log.insert(j.log.end(), c.payload.begin(), c.payload.begin() + c.header.payload_size);
+	j.removed.clear();
+	j.placed.clear();
+	j.recording = true;
+}
+
+void journal_end(sys::state& state) {
+	auto& j = state.journal;
+	j.recording = false;
+	auto offset = uint32_t(j.log.size());
+	for(auto list : { &j.removed, &j.placed }) {
+		journal_write_varint(j.log, uint32_t(list->size()));
+		for(auto& d : *list)
+			journal_write_part(j.log, d);
+	}
+	if(!j.removed.empty() || !j.placed.empty()) {
+		j.undo_entries.push_back(offset);
+		j.redo_entries.clear();
+	}
+}
+
+void journal_part_placed(sys::state& state, circuit::board_item part) {
+	if(state.journal.recording)
+		state.journal.placed.push_back(circuit::describe_item(state, part));
+}
+void journal_part_removed(sys::state& state, circuit::board_item part) {
+	if(state.journal.recording)
+		state.journal.removed.push_back(circuit::describe_item(state, part));
+}
+
+// parts are found again by what they are rather than where they are stored, as storage indices do not survive
+// removals; when identical parts overlap, any of them will do
+std::optional<circuit::board_item> find_described(sys::state& state, circuit::part_description const& d) {
+	std::vector<circuit::board_item> found;
+	circuit::items_in_rect(state, d.position, d.position, found);
+	for(auto item : found) {
+		if(circuit::describe_item(state, item) == d)
+			return item;
+	}
+	return std::nullopt;
+}
+
+// applies the change recorded at offset forwards (removing what it removed and placing what it placed) or backwards
+void journal_apply_change(sys::state& state, uint32_t offset, bool forwards) {
+	auto& j = state.journal;
+	std::vector<circuit::part_description> removed;
+	std::vector<circuit::part_description> placed;
+	journal_reader r{ std::span<uint8_t const>(j.log), offset };
+	r.change(removed, placed);
+	assert(!r.failed);
+
+	auto& take = forwards ? removed : placed;
+	auto& put = forwards ? placed : removed;
+	// applying a change is not itself a change to be recorded
+	auto was_recording = j.recording;
+	j.recording = false;
+	bool bulk = take.size() + put.size() > circuit::bulk_edit_threshold;
+	if(bulk)
+		circuit::suspend_netlist(state);
+	for(auto& d : take) {
+		auto item = find_described(state, d);
+		assert(item);
+		if(item)
+			circuit::remove_item(state, *item);
+	}
+	for(auto& d : put)
+		circuit::place_described(state, d);
+	if(bulk)
+		circuit::resume_netlist(state);
+	j.recording = was_recording;
+}
+
+void undo_last_change(sys::state& state) {
+	auto& j = state.journal;
+	if(j.undo_entries.empty())
+		return;
+	auto offset = j.undo_entries.back();
+	j.undo_entries.pop_back();
+	journal_apply_change(state, offset, false);
+	j.redo_entries.push_back(offset);
+}
+
+void redo_last_change(sys::state& state) {
+	auto& j = state.journal;
+	if(j.redo_entries.empty())
+		return;
+	auto offset = j.redo_entries.back();
+	j.redo_entries.pop_back();
+	journal_apply_change(state, offset, true);
+	j.undo_entries.push_back(offset);
+}
+
+bool replay_journal(sys::state& state, std::span<uint8_t const> data) {
+	journal_reader r{ data };
+	std::vector<circuit::part_description> removed;
+	std::vector<circuit::part_description> placed;
+	while(!r.at_end()) {
+		auto type = r.varint();
+		auto size = r.varint();
+		if(r.failed || type > 0xFF || size > command_data::max_payload_size || data.size() - r.at < size)
+			return false;
+		command_data c{ command_type(type) };
+		std::memcpy(c.payload.data(), data.data() + r.at, size);
+		c.header.payload_size = size;
+		r.at += size;
+		r.change(removed, placed); // the change is made again by executing the command
+		if(r.failed)
+			return false;
+
+		auto handler = command_type_handler(c.header.type);
+		if(!handler || size < handler->min_payload_size || size > handler->max_payload_size)
+			return false;
+		execute_command(state, c);
+	}
+	return true;
+}
+
+} // namespace command
@@ -0,0 +1,122 @@
+#pragma once
+#include <vector>
+#include <span>
+#include <stdint.h>
+#include "circuit.hpp"
+
+// an append-only log of every command executed, in order. each entry holds the command (its type and payload) and,
+// following it, the change it made to the board: the parts it removed and the parts it placed, each described
+// completely. integers are stored as varints, and coordinates zigzag encoded first, so most entries take a handful of
+// bytes
+//
+// undo and redo apply the change recorded for an entry backwards or forwards, so they cost as much as the change
+// itself, whatever the size of the board. replaying the commands of a log against an empty board reproduces the
+// session that wrote it, including its undos and redos, which are logged as commands of their own
+
+namespace command {
+
+struct command_data;
+
+class journal {
+public:
+	std::vector<uint8_t> log;
+	// offsets into the log of the changes that may be undone, oldest first, and of those undone that may be redone,
+	// most recently undone last
+	std::vector<uint32_t> undo_entries;
+	std::vector<uint32_t> redo_entries;
+
+	// while a command executes: the parts it has removed and placed so far
+	std::vector<circuit::part_description> removed;
+	std::vector<circuit::part_description> placed;
+	bool recording = false;
+
+	void clear();
+};
+
+// the encoding of the log, which the autosave shares (see autosave.hpp)
+void journal_write_varint(std::vector<uint8_t>& out, uint32_t v);
+void journal_write_coordinate(std::vector<uint8_t>& out, int16_t v);
+void journal_write_part(std::vector<uint8_t>& out, circuit::part_description const& d);
+
+// reads from a span of the log; once anything is out of bounds or malformed it sets failed, and reads return zeros
+struct journal_reader {
+	std::span<uint8_t const> data;
+	size_t at = 0;
+	bool failed = false;
+
+	bool at_end() const {
+		return at >= data.size();
+	}
+	uint32_t varint() {
+		uint32_t v = 0;
+		for(uint32_t shift = 0; shift < 32; shift += 7) {
+			if(at >= data.size())
+				break;
+			auto b = data[at++];
+			v |= uint32_t(b & 0x7F) << shift;
+			if((b & 0x80) == 0)
+				return v;
+		}
+		failed = true;
+		return 0;
+	}
+	int16_t coordinate() {
+		auto u = varint();
+		return int16_t(int32_t(u >> 1) ^ -int32_t(u & 1));
+	}
+	circuit::part_description part() {
+		circuit::part_description d;
+		auto kind = varint();
+		if(kind >= circuit::item_kind_count) {
+			failed = true;
+			return d;
+		}
+		d.kind = circuit::item_kind(kind);
+		d.position.x = coordinate();
+		d.position.y = coordinate();
+		switch(d.kind) {
+		case circuit::item_kind::diode:
+		case circuit::item_kind::enable_high_transistor:
+		case circuit::item_kind::enable_low_transistor:
+			d.orientation = sys::orientation(varint());
+			break;
+		case circuit::item_kind::wire_segment:
+			d.end.x = coordinate();
+			d.end.y = coordinate();
+			d.color = sys::wire_colors(varint());
+			break;
+		case circuit::item_kind::module_instance:
+			d.definition = varint();
+			break;
+		}
+		return d;
+	}
+	// reads the parts removed and placed by an entry
+	void change(std::vector<circuit::part_description>& removed, std::vector<circuit::part_description>& placed) {
+		for(auto list : { &removed, &placed }) {
+			list->clear();
+			auto count = varint();
+			for(uint32_t i = 0; i < count && !failed; ++i)
+				list->push_back(part());
+		}
+	}
+};
+
+// called by perform_command around the execution of each command
+void journal_begin(sys::state& state, command_data const& c);
+void journal_end(sys::state& state);
+
+// called by the board editing functions in circuit.cpp
+void journal_part_placed(sys::state& state, circuit::board_item part);
+void journal_part_removed(sys::state& state, circuit::board_item part);
+
+// these must only be called from the thread that owns the game state; they do nothing when there is nothing to undo
+// or redo
+void undo_last_change(sys::state& state);
+void redo_last_change(sys::state& state);
+
+// executes the commands logged in data, in order; returns false if the data is malformed, in which case the commands
+// before the malformed entry have been executed
+bool replay_journal(sys::state& state, std::span<uint8_t const> data);
+
+} // namespace command
@@ -0,0 +1,326 @@
+#include <algorithm>
+#include <string.h>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+#include "lane_simulation.hpp"
+#include "simulation.hpp"
+#include "netlist.hpp"
+#include "system_state.hpp"
+
+namespace circuit {
+
+void compile_lane_program(sys::state& state, lane_program& p, std::span<grid_point const> inputs, std::span<grid_point const> outputs) {
+	update_simulation_structure(state);
+	auto& sim = state.simulation;
+	auto& nl = state.netlist;
+	auto nets = nl.net_count();
+
+	// module instances are flattened: each one gets a private copy of its definition's local nets
+	uint32_t lane_nets = nets;
+	for(uint32_t i = 0; i < state.world.module_instance_size(); ++i) {
+		auto id = dcon::module_instance_id{ dcon::module_instance_id::value_base_t(i) };
+		lane_nets += state.modules.definitions[state.world.module_instance_get_definition(id)].local_net_count;
+	}
+
+	p.net_count = lane_nets;
+	p.has_feedback = false;
+	p.input.clear();
+	p.control.clear();
+	p.output.clear();
+	p.invert_control.clear();
+
+	// the highest level among the drivers of each net; a reader at or below it is on a feedback loop and
+	// has to read the value from the previous pass
+	std::vector<uint32_t> driver_level(nets, 0);
+	std::vector<uint8_t> has_driver(nets, 0);
+	for(uint32_t n = 0; n < nets; ++n) {
+		for(auto pin : nl.pins_of(dcon::net_id{ dcon::net_id::value_base_t(n) })) {
+			if(!pin_is_driver(state, pin))
+				continue;
+			auto l = sim.component_level[simulation_flat_index(sim, pin)];
+			driver_level[n] = has_driver[n] ? std::max(driver_level[n], l) : l;
+			has_driver[n] = 1;
+		}
+	}
+	// the members of a table share the level of its head but are emitted together in the table's evaluation order,
+	// so a net internal to the table the reader belongs to always has its drivers earlier in the same pass
+	auto& lt = sim.tables;
+	uint32_t reader_table = logic_tables::none;
+	auto operand = [&](dcon::net_id n, uint32_t reader_level) {
+		auto i = uint32_t(n.index());
+		if(reader_table != logic_tables::none && lt.net_table[i] == reader_table)
+			return i;
+		if(has_driver[i] && driver_level[i] >= reader_level) {
+			p.has_feedback = true;
+			return lane_nets + i;
+		}
+		return i;
+	};
+
+	// counting sort of the components by level, with the members of a table placed at its head in table order
+	std::vector<uint32_t> level_start(size_t(sim.level_count) + 1, 0);
+	for(uint32_t c = 0; c < sim.component_count; ++c)
+		++level_start[sim.component_level[c] + 1];
+	for(size_t l = 1; l < level_start.size(); ++l)
+		level_start[l] += level_start[l - 1];
+	std::vector<uint32_t> order(sim.component_count);
+	for(uint32_t c = 0; c < sim.component_count; ++c) {
+		if(lt.node(c) != c)
+			continue;
+		if(auto t = lt.component_table[c]; t != logic_tables::none) {
+			auto& table = lt.tables[t];
+			for(uint32_t m = 0; m < table.member_count; ++m)
+				order[level_start[sim.component_level[c]]++] = lt.members[table.first_member + m];
+		} else {
+			order[level_start[sim.component_level[c]]++] = c;
+		}
+	}
+
+	p.input.reserve(sim.component_count);
+	p.control.reserve(sim.component_count);
+	p.output.reserve(sim.component_count);
+	p.invert_control.reserve(sim.component_count);
+	auto ones = 2 * lane_nets;
+	auto push_op = [&](uint32_t input, uint32_t control, uint32_t output, uint8_t invert) {
+		p.input.push_back(input);
+		p.control.push_back(control);
+		p.output.push_back(output);
+		p.invert_control.push_back(invert);
+	};
+	uint32_t next_local_base = nets;
+	for(auto c : order) {
+		auto l = sim.component_level[c];
+		reader_table = lt.component_table[c];
+		if(c < sim.first_enable_high) {
+			auto id = dcon::diode_id{ dcon::diode_id::value_base_t(c) };
+			p.input.push_back(operand(state.world.diode_get_input_net(id), l));
+			p.control.push_back(ones);
+			p.output.push_back(uint32_t(state.world.diode_get_output_net(id).index()));
+			p.invert_control.push_back(0);
+		} else if(c < sim.first_enable_low) {
+			auto id = dcon::enable_high_transistor_id{ dcon::enable_high_transistor_id::value_base_t(c - sim.first_enable_high) };
+			p.input.push_back(operand(state.world.enable_high_transistor_get_input_net(id), l));
+			p.control.push_back(operand(state.world.enable_high_transistor_get_control_net(id), l));
+			p.output.push_back(uint32_t(state.world.enable_high_transistor_get_output_net(id).index()));
+			p.invert_control.push_back(0);
+		} else if(c < sim.first_module) {
+			auto id = dcon::enable_low_transistor_id{ dcon::enable_low_transistor_id::value_base_t(c - sim.first_enable_low) };
+			p.input.push_back(operand(state.world.enable_low_transistor_get_input_net(id), l));
+			p.control.push_back(operand(state.world.enable_low_transistor_get_control_net(id), l));
+			p.output.push_back(uint32_t(state.world.enable_low_transistor_get_output_net(id).index()));
+			p.invert_control.push_back(1);
+		} else {
+			// input ports copy the board net into the local net, then the definition's own operations run,
+			// then output ports copy local nets back out to the board
+			auto id = dcon::module_instance_id{ dcon::module_instance_id::value_base_t(c - sim.first_module) };
+			auto& def = state.modules.definitions[state.world.module_instance_get_definition(id)];
+			auto slot = state.world.module_instance_get_state_slot(id);
+			auto local_nets = def.local_net_count;
+			auto base = next_local_base;
+			next_local_base += local_nets;
+			auto ports = uint32_t(def.ports.size());
+			auto local_operand = [&](uint32_t x) {
+				if(x < local_nets)
+					return base + x;
+				if(x < 2 * local_nets)
+					return lane_nets + base + (x - local_nets);
+				return ones;
+			};
+
+			for(uint32_t q = 0; q < ports; ++q) {
+				auto n = def.instance_port_nets[size_t(slot) * ports + q];
+				if(!def.ports[q].is_output && n)
+					push_op(operand(n, l), ones, base + def.port_nets[q], 0);
+			}
+			for(size_t i = 0; i < def.op_output.size(); ++i)
+				push_op(local_operand(def.op_input[i]), local_operand(def.op_control[i]), base + def.op_output[i], def.op_invert[i]);
+			for(uint32_t q = 0; q < ports; ++q) {
+				auto n = def.instance_port_nets[size_t(slot) * ports + q];
+				if(def.ports[q].is_output && n)
+					push_op(base + def.port_nets[q], ones, uint32_t(n.index()), 0);
+			}
+			p.has_feedback = p.has_feedback || def.has_feedback;
+		}
+	}
+
+	auto net_at = [&](grid_point pt) {
+		auto e = nl.points.first_at(pt);
+		if(e == connection_index::no_entry)
+			return lane_program::no_net;
+		return uint32_t(pin_net(state, nl.points.get(e).pin).index());
+	};
+	p.input_nets.clear();
+	for(auto pt : inputs)
+		p.input_nets.push_back(net_at(pt));
+	p.output_nets.clear();
+	for(auto pt : outputs)
+		p.output_nets.push_back(net_at(pt));
+}
+
+//
+// lane words
+//
+
+inline uint64_t lane_zero(uint64_t) {
+	return 0;
+}
+inline uint64_t lane_ones(uint64_t) {
+	return ~uint64_t(0);
+}
+inline uint64_t lane_and(uint64_t a, uint64_t b) {
+	return a & b;
+}
+inline uint64_t lane_and_not(uint64_t a, uint64_t b) {
+	return a & ~b;
+}
+inline uint64_t lane_or(uint64_t a, uint64_t b) {
+	return a | b;
+}
+inline uint64_t lane_xor(uint64_t a, uint64_t b) {
+	return a ^ b;
+}
+inline bool lane_any(uint64_t a) {
+	return a != 0;
+}
+inline uint64_t lane_from_words(uint64_t, uint64_t const* w) {
+	return w[0];
+}
+inline void lane_to_words(uint64_t a, uint64_t* w) {
+	w[0] = a;
+}
+
+#ifdef __AVX2__
+inline __m256i lane_zero(__m256i) {
+	return _mm256_setzero_si256();
+}
+inline __m256i lane_ones(__m256i) {
+	return _mm256_set1_epi64x(-1);
+}
+inline __m256i lane_and(__m256i a, __m256i b) {
+	return _mm256_and_si256(a, b);
+}
+inline __m256i lane_and_not(__m256i a, __m256i b) {
+	return _mm256_andnot_si256(b, a);
+}
+inline __m256i lane_or(__m256i a, __m256i b) {
+	return _mm256_or_si256(a, b);
+}
+inline __m256i lane_xor(__m256i a, __m256i b) {
+	return _mm256_xor_si256(a, b);
+}
+inline bool lane_any(__m256i a) {
+	return _mm256_testz_si256(a, a) == 0;
+}
+inline __m256i lane_from_words(__m256i, uint64_t const* w) {
+	return _mm256_loadu_si256(reinterpret_cast<__m256i const*>(w));
+}
+inline void lane_to_words(__m256i a, uint64_t* w) {
+	_mm256_storeu_si256(reinterpret_cast<__m256i*>(w), a);
+}
+using sweep_word = __m256i;
+#else
+using sweep_word = uint64_t;
+#endif
+
+// evaluates the program over values (2 * net_count + 1 words); returns the lanes that failed to settle
+template<typename W>
+W run_lane_program(lane_program const& p, W const* stimuli, W* values) {
+	W const zero = lane_zero(W{});
+	auto nets = p.net_count;
+	W* current = values;
+	W* previous = values + nets;
+	values[2 * nets] = lane_ones(W{});
+	std::fill(previous, previous + nets, zero);
+
+	auto const op_count = p.output.size();
+	uint32_t const* input = p.input.data();
+	uint32_t const* control = p.control.data();
+	uint32_t const* output = p.output.data();
+	uint8_t const* invert = p.invert_control.data();
+
+	for(uint32_t pass = 0; pass < lane_program::max_passes; ++pass) {
+		std::fill(current, current + nets, zero);
+		for(size_t i = 0; i < p.input_nets.size(); ++i) {
+			if(p.input_nets[i] != lane_program::no_net)
+				current[p.input_nets[i]] = lane_or(current[p.input_nets[i]], stimuli[i]);
+		}
+		for(size_t i = 0; i < op_count; ++i) {
+			auto a = values[input[i]];
+			auto c = values[control[i]];
+			auto r = invert[i] ? lane_and_not(a, c) : lane_and(a, c);
+			values[output[i]] = lane_or(values[output[i]], r);
+		}
+		if(!p.has_feedback)
+			return zero;
+
+		W changed = zero;
+		for(uint32_t n = 0; n < nets; ++n)
+			changed = lane_or(changed, lane_xor(current[n], previous[n]));
+		if(!lane_any(changed))
+			return zero;
+		if(pass + 1 == lane_program::max_passes)
+			return changed;
+		std::copy(current, current + nets, previous);
+	}
+	return zero;
+}
+
+// bit i of the vector number, for the 64 consecutive vectors starting at base (a multiple of 64)
+uint64_t sweep_stimulus_word(uint32_t i, uint64_t base) {
+	constexpr uint64_t low_patterns[6] = {
+		0xAAAAAAAAAAAAAAAAull, 0xCCCCCCCCCCCCCCCCull, 0xF0F0F0F0F0F0F0F0ull,
+		0xFF00FF00FF00FF00ull, 0xFFFF0000FFFF0000ull, 0xFFFFFFFF00000000ull
+	};
+	if(i < 6)
+		return low_patterns[i];
+	return ((base >> i) & 1) != 0 ? ~uint64_t(0) : uint64_t(0);
+}
+
+sweep_result exhaustive_sweep(sys::state& state, std::span<grid_point const> inputs, std::span<grid_point const> outputs) {
+	sweep_result result;
+	if(inputs.size() > max_sweep_inputs)
+		return result;
+
+	lane_program p;
+	compile_lane_program(state, p, inputs, outputs);
+
+	result.input_count = uint32_t(inputs.size());
+	result.output_count = uint32_t(outputs.size());
+	result.vector_count = uint64_t(1) << inputs.size();
+	auto words = result.words_per_output();
+	result.output_bits.assign(words * outputs.size(), 0);
+	result.unsettled_bits.assign(words, 0);
+
+	constexpr uint32_t words_per_lane = uint32_t(sizeof(sweep_word) / sizeof(uint64_t));
+	std::vector<sweep_word> stimuli(inputs.size());
+	std::vector<sweep_word> values(2 * size_t(p.net_count) + 1);
+	uint64_t scratch[words_per_lane];
+
+	// when there are fewer than 64 vectors, the surplus lanes repeat real ones and are masked off here
+	uint64_t const last_mask = (result.vector_count % 64) != 0 ? (uint64_t(1) << (result.vector_count % 64)) - 1 : ~uint64_t(0);
+
+	for(uint64_t w = 0; w < words; w += words_per_lane) {
+		for(uint32_t i = 0; i < uint32_t(inputs.size()); ++i) {
+			for(uint32_t k = 0; k < words_per_lane; ++k)
+				scratch[k] = sweep_stimulus_word(i, (w + k) * 64);
+			stimuli[i] = lane_from_words(sweep_word{}, scratch);
+		}
+
+		auto unsettled = run_lane_program(p, stimuli.data(), values.data());
+
+		auto store = [&](uint64_t* dest, sweep_word v) {
+			lane_to_words(v, scratch);
+			for(uint32_t k = 0; k < words_per_lane && w + k < words; ++k)
+				dest[w + k] = (w + k + 1 == words) ? (scratch[k] & last_mask) : scratch[k];
+		};
+		store(result.unsettled_bits.data(), unsettled);
+		for(uint32_t j = 0; j < uint32_t(outputs.size()); ++j) {
+			if(p.output_nets[j] != lane_program::no_net)
+				store(result.output_bits.data() + j * words, values[p.output_nets[j]]);
+		}
+	}
+	return result;
+}
+
+} // namespace circuit
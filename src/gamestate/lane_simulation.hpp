@@ -0,0 +1,67 @@
+#pragma once
+#include <vector>
+#include <span>
+#include <stdint.h>
+#include "circuit.hpp"
+
+// bit parallel evaluation of the board, for verifying a design against many input vectors at once
+//
+// every net is given one bit per lane in a machine word (64 lanes in a uint64_t, or 256 in an avx2 register
+// when the build targets avx2), and components become straight line bitwise operations over those words,
+// evaluated in level order. each pass rebuilds the wired-or value of every net from scratch; a board without
+// feedback is exact after a single pass, while one with feedback is iterated until two passes agree.
+// unlike the event driven simulation this always evaluates every component, so it is only worth it when
+// many vectors are evaluated together
+
+namespace circuit {
+
+struct lane_program {
+	// one operation per component (several for a module instance), sorted by level:
+	// values[output] |= values[input] & (values[control] or its complement)
+	// operands index a buffer of 2 * net_count + 1 words: the current pass, the previous pass, then a word of all ones;
+	// net_count covers the board nets followed by the local nets of every module instance
+	std::vector<uint32_t> input;
+	std::vector<uint32_t> control;
+	std::vector<uint32_t> output;
+	std::vector<uint8_t> invert_control;
+
+	std::vector<uint32_t> input_nets;  // the net driven by each stimulus, or no_net if nothing is connected there
+	std::vector<uint32_t> output_nets; // the net sampled by each output, or no_net
+
+	uint32_t net_count = 0;
+	bool has_feedback = false;
+
+	static constexpr uint32_t no_net = 0xFFFFFFFF;
+	static constexpr uint32_t max_passes = 64;
+};
+
+// persistent board inputs (set_board_input) are not applied; only the listed stimuli drive the board
+void compile_lane_program(sys::state& state, lane_program& p, std::span<grid_point const> inputs, std::span<grid_point const> outputs);
+
+struct sweep_result {
+	uint32_t input_count = 0;
+	uint32_t output_count = 0;
+	uint64_t vector_count = 0;
+	// bit v % 64 of word (j * words_per_output() + v / 64) holds output j for input vector v,
+	// where bit i of v is the value of input i
+	std::vector<uint64_t> output_bits;
+	// the vectors for which the board did not settle within lane_program::max_passes
+	std::vector<uint64_t> unsettled_bits;
+
+	uint64_t words_per_output() const {
+		return (vector_count + 63) / 64;
+	}
+	bool output_high(uint32_t j, uint64_t v) const {
+		return ((output_bits[j * words_per_output() + v / 64] >> (v % 64)) & 1) != 0;
+	}
+	bool settled(uint64_t v) const {
+		return ((unsettled_bits[v / 64] >> (v % 64)) & 1) == 0;
+	}
+};
+
+constexpr inline uint32_t max_sweep_inputs = 28;
+
+// evaluates every combination of the given inputs; must be called from the thread that owns the game state
+sweep_result exhaustive_sweep(sys::state& state, std::span<grid_point const> inputs, std::span<grid_point const> outputs);
+
+} // namespace circuit
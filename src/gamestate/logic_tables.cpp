@@ -0,0 +1,269 @@
+#include <algorithm>
+#include <array>
+#include "logic_tables.hpp"
+#include "simulation.hpp"
+#include "netlist.hpp"
+#include "system_state.hpp"
+
+namespace circuit {
+
+struct table_primitive {
+	dcon::net_id input;
+	dcon::net_id control; // none for diodes
+	dcon::net_id output;
+	item_kind kind = item_kind::diode;
+	bool driving = false;
+};
+
+table_primitive logic_table_primitive(sys::state& state, uint32_t c) {
+	auto& sim = state.simulation;
+	table_primitive r;
+	if(c < sim.first_enable_high) {
+		auto id = dcon::diode_id{ dcon::diode_id::value_base_t(c) };
+		r.input = state.world.diode_get_input_net(id);
+		r.output = state.world.diode_get_output_net(id);
+		r.driving = state.world.diode_get_driving(id) != 0;
+	} else if(c < sim.first_enable_low) {
+		auto id = dcon::enable_high_transistor_id{ dcon::enable_high_transistor_id::value_base_t(c - sim.first_enable_high) };
+		r.input = state.world.enable_high_transistor_get_input_net(id);
+		r.control = state.world.enable_high_transistor_get_control_net(id);
+		r.output = state.world.enable_high_transistor_get_output_net(id);
+		r.kind = item_kind::enable_high_transistor;
+		r.driving = state.world.enable_high_transistor_get_driving(id) != 0;
+	} else {
+		auto id = dcon::enable_low_transistor_id{ dcon::enable_low_transistor_id::value_base_t(c - sim.first_enable_low) };
+		r.input = state.world.enable_low_transistor_get_input_net(id);
+		r.control = state.world.enable_low_transistor_get_control_net(id);
+		r.output = state.world.enable_low_transistor_get_output_net(id);
+		r.kind = item_kind::enable_low_transistor;
+		r.driving = state.world.enable_low_transistor_get_driving(id) != 0;
+	}
+	return r;
+}
+
+// checks that the candidate cluster can be tabulated: collects its inputs and reorders the candidate so that every
+// member comes after the members driving the internal nets it reads. fails if a net read by a member is driven both
+// by members and by outside parts, if there are too many inputs, or if the members form a loop
+bool logic_table_analyze(sys::state& state) {
+	auto& sim = state.simulation;
+	auto& nl = state.netlist;
+	auto& lt = sim.tables;
+	auto& cand = lt.candidate;
+
+	++lt.mark_epoch;
+	for(auto m : cand)
+		lt.member_mark[m] = lt.mark_epoch;
+	auto is_member = [&](board_item pin) {
+		return pin.kind() != item_kind::module_instance && lt.member_mark[simulation_flat_index(sim, pin)] == lt.mark_epoch;
+	};
+	// 0: driven only by members (or not at all), 1: driven only by outside parts, 2: both
+	auto classify = [&](dcon::net_id n) {
+		bool inside = false;
+		bool outside = lt.net_has_input[n.index()] != 0;
+		for(auto pin : nl.pins_of(n)) {
+			if(!pin_is_driver(state, pin))
+				continue;
+			if(is_member(pin))
+				inside = true;
+			else
+				outside = true;
+		}
+		return outside ? (inside ? 2 : 1) : 0;
+	};
+
+	std::array<uint32_t, logic_tables::max_members> depends_on{ };
+	lt.candidate_inputs.clear();
+	for(size_t i = 0; i < cand.size(); ++i) {
+		auto p = logic_table_primitive(state, cand[i]);
+		for(auto n : { p.input, p.control }) {
+			if(!n)
+				continue;
+			auto kind = classify(n);
+			if(kind == 2)
+				return false;
+			if(kind == 1) {
+				if(std::find(lt.candidate_inputs.begin(), lt.candidate_inputs.end(), n) == lt.candidate_inputs.end())
+					lt.candidate_inputs.push_back(n);
+				continue;
+			}
+			for(auto pin : nl.pins_of(n)) {
+				if(!pin_is_driver(state, pin))
+					continue;
+				auto j = std::find(cand.begin(), cand.end(), simulation_flat_index(sim, pin)) - cand.begin();
+				depends_on[i] |= uint32_t(1) << j;
+			}
+		}
+	}
+	if(lt.candidate_inputs.size() > logic_tables::max_inputs)
+		return false;
+
+	std::array<uint32_t, logic_tables::max_members> ordered{ };
+	uint32_t placed = 0;
+	for(size_t k = 0; k < cand.size(); ++k) {
+		size_t i = 0;
+		while(i < cand.size() && (((placed >> i) & 1) != 0 || (depends_on[i] & ~placed) != 0))
+			++i;
+		if(i == cand.size())
+			return false;
+		placed |= uint32_t(1) << i;
+		ordered[k] = cand[i];
+	}
+	std::copy(ordered.begin(), ordered.begin() + cand.size(), cand.begin());
+	return true;
+}
+
+// tabulates the analyzed candidate
+void logic_table_build(sys::state& state) {
+	auto& lt = state.simulation.tables;
+	auto& cand = lt.candidate;
+	auto table_index = uint32_t(lt.tables.size());
+
+	logic_table t;
+	t.first_member = uint32_t(lt.members.size());
+	t.first_input = uint32_t(lt.inputs.size());
+	t.first_entry = uint32_t(lt.entries.size());
+	t.member_count = uint8_t(cand.size());
+	t.input_count = uint8_t(lt.candidate_inputs.size());
+	t.head = cand.back();
+
+	// operands: the inputs first, then the members' output nets, then a constant zero for undriven nets
+	std::array<table_primitive, logic_tables::max_members> prims;
+	std::array<dcon::net_id, logic_tables::max_members> outputs;
+	uint32_t output_count = 0;
+	for(size_t i = 0; i < cand.size(); ++i) {
+		prims[i] = logic_table_primitive(state, cand[i]);
+		if(prims[i].driving)
+			t.driving |= uint32_t(1) << i;
+		if(std::find(outputs.begin(), outputs.begin() + output_count, prims[i].output) == outputs.begin() + output_count)
+			outputs[output_count++] = prims[i].output;
+	}
+	auto zero_operand = t.input_count + output_count;
+	auto operand = [&](dcon::net_id n) {
+		if(!n)
+			return uint32_t(zero_operand);
+		auto in = std::find(lt.candidate_inputs.begin(), lt.candidate_inputs.end(), n);
+		if(in != lt.candidate_inputs.end())
+			return uint32_t(in - lt.candidate_inputs.begin());
+		auto out = std::find(outputs.begin(), outputs.begin() + output_count, n);
+		if(out != outputs.begin() + output_count)
+			return uint32_t(t.input_count + (out - outputs.begin()));
+		return uint32_t(zero_operand);
+	};
+	std::array<uint32_t, logic_tables::max_members> op_input;
+	std::array<uint32_t, logic_tables::max_members> op_control;
+	std::array<uint32_t, logic_tables::max_members> op_output;
+	for(size_t i = 0; i < cand.size(); ++i) {
+		op_input[i] = operand(prims[i].input);
+		op_control[i] = prims[i].kind == item_kind::diode ? zero_operand : operand(prims[i].control);
+		op_output[i] = operand(prims[i].output);
+		// whatever a member reads that is not an input is internal
+		for(auto n : { prims[i].input, prims[i].control }) {
+			if(n && std::find(lt.candidate_inputs.begin(), lt.candidate_inputs.end(), n) == lt.candidate_inputs.end())
+				lt.net_table[n.index()] = table_index;
+		}
+	}
+
+	std::array<uint8_t, logic_tables::max_inputs + logic_tables::max_members + 1> values;
+	for(uint32_t index = 0; index < (uint32_t(1) << t.input_count); ++index) {
+		values.fill(0);
+		for(uint32_t i = 0; i < t.input_count; ++i)
+			values[i] = uint8_t((index >> i) & 1);
+		uint32_t entry = 0;
+		for(size_t i = 0; i < cand.size(); ++i) {
+			bool drive = values[op_input[i]] != 0;
+			if(prims[i].kind == item_kind::enable_high_transistor)
+				drive = drive && values[op_control[i]] != 0;
+			else if(prims[i].kind == item_kind::enable_low_transistor)
+				drive = drive && values[op_control[i]] == 0;
+			if(drive) {
+				entry |= uint32_t(1) << i;
+				values[op_output[i]] = 1;
+			}
+		}
+		lt.entries.push_back(entry);
+	}
+
+	for(auto m : cand) {
+		lt.members.push_back(m);
+		lt.component_table[m] = table_index;
+	}
+	lt.inputs.insert(lt.inputs.end(), lt.candidate_inputs.begin(), lt.candidate_inputs.end());
+	lt.tables.push_back(t);
+}
+
+// clusters are grown backwards from the highest levels down: starting from a seed component, the drivers of one of
+// its input nets are absorbed whenever the result can still be tabulated
+void extract_logic_tables(sys::state& state) {
+	auto& sim = state.simulation;
+	auto& nl = state.netlist;
+	auto& lt = sim.tables;
+	auto nets = nl.net_count();
+	if(!lt.enabled)
+		return;
+
+	lt.net_has_input.assign(nets, 0);
+	for(auto& bi : sim.board_inputs) {
+		if(!bi.second)
+			continue;
+		auto n = simulation_net_at(state, unpack_point(bi.first));
+		if(n)
+			lt.net_has_input[n.index()] = 1;
+	}
+	lt.member_mark.assign(sim.component_count, 0);
+	lt.net_mark.assign(nets, 0);
+	lt.mark_epoch = 0;
+
+	lt.seeds.clear();
+	for(uint32_t c = 0; c < sim.first_module; ++c)
+		lt.seeds.push_back(c);
+	std::stable_sort(lt.seeds.begin(), lt.seeds.end(), [&](uint32_t a, uint32_t b) {
+		return sim.component_level[a] > sim.component_level[b];
+	});
+
+	auto& cand = lt.candidate;
+	for(auto seed : lt.seeds) {
+		if(lt.component_table[seed] != logic_tables::none)
+			continue;
+		cand.clear();
+		cand.push_back(seed);
+		if(!logic_table_analyze(state))
+			continue;
+
+		// the net marks are stamped with the seed's epoch so that each net is tried at most once per seed
+		auto seed_epoch = lt.mark_epoch;
+		lt.frontier.assign(lt.candidate_inputs.begin(), lt.candidate_inputs.end());
+		for(auto n : lt.frontier)
+			lt.net_mark[n.index()] = seed_epoch;
+		for(size_t f = 0; f < lt.frontier.size(); ++f) {
+			auto n = lt.frontier[f];
+			if(lt.net_has_input[n.index()])
+				continue;
+			auto before = cand.size();
+			bool absorbable = true;
+			for(auto pin : nl.pins_of(n)) {
+				if(!pin_is_driver(state, pin))
+					continue;
+				if(pin.kind() == item_kind::module_instance || lt.component_table[simulation_flat_index(sim, pin)] != logic_tables::none) {
+					absorbable = false;
+					break;
+				}
+				cand.push_back(simulation_flat_index(sim, pin));
+			}
+			if(!absorbable || cand.size() > logic_tables::max_members || !logic_table_analyze(state)) {
+				cand.resize(before);
+				continue;
+			}
+			for(auto i : lt.candidate_inputs) {
+				if(lt.net_mark[i.index()] != seed_epoch) {
+					lt.net_mark[i.index()] = seed_epoch;
+					lt.frontier.push_back(i);
+				}
+			}
+		}
+
+		if(cand.size() >= logic_tables::min_members && logic_table_analyze(state))
+			logic_table_build(state);
+	}
+}
+
+} // namespace circuit
@@ -0,0 +1,77 @@
+#pragma once
+#include <vector>
+#include <stdint.h>
+#include "dcon_generated_ids.hpp"
+#include "circuit.hpp"
+
+// truth tables for small pieces of glue logic
+//
+// after each resynchronization, the simulation looks for small acyclic clusters of diodes and transistors with
+// few inputs and tabulates them: for every combination of the input nets, the table holds which members of the
+// cluster end up driving their outputs. the cluster is then scheduled and evaluated as a single component, with
+// one indexed load in place of a chain of individual evaluations.
+//
+// the nets of a cluster fall into three groups:
+//   - inputs: read by members and driven only by parts outside the cluster
+//   - internal nets: driven only by members (and by no board input); their values follow from the inputs
+//   - outputs: driven by members (and possibly by outside parts), but read by no member
+// the members still keep their driving flags and the values of internal nets are still maintained, so nothing
+// outside of the scheduler can tell whether a component was evaluated on its own or as part of a table
+
+namespace circuit {
+
+struct logic_table {
+	uint32_t first_member = 0; // into logic_tables::members, in evaluation order; bit i of an entry is member i
+	uint32_t first_input = 0;  // into logic_tables::inputs; bit i of the entry index is input i
+	uint32_t first_entry = 0;  // into logic_tables::entries, 2^input_count of them
+	uint32_t head = 0;         // the member that stands for the whole cluster in the scheduler
+	uint32_t driving = 0;      // the entry that was last applied
+	uint8_t member_count = 0;
+	uint8_t input_count = 0;
+};
+
+struct logic_tables {
+	static constexpr uint32_t none = 0xFFFFFFFF;
+	static constexpr uint32_t max_inputs = 8;
+	static constexpr uint32_t max_members = 32;
+	static constexpr uint32_t min_members = 3; // smaller clusters are cheaper to evaluate directly
+
+	std::vector<logic_table> tables;
+	std::vector<uint32_t> members;
+	std::vector<dcon::net_id> inputs;
+	std::vector<uint32_t> entries;
+	std::vector<uint32_t> component_table; // indexed by component, none for components not in a table
+	std::vector<uint32_t> net_table;       // indexed by net: the table the net is internal to, or none
+	bool enabled = true;
+
+	// scratch space for extraction
+	std::vector<uint32_t> member_mark;
+	std::vector<uint32_t> net_mark;
+	std::vector<uint8_t> net_has_input;
+	std::vector<uint32_t> candidate;
+	std::vector<dcon::net_id> candidate_inputs;
+	std::vector<dcon::net_id> frontier;
+	std::vector<uint32_t> seeds;
+	uint32_t mark_epoch = 0;
+
+	void reset(uint32_t component_count, uint32_t net_count) {
+		tables.clear();
+		members.clear();
+		inputs.clear();
+		entries.clear();
+		component_table.assign(component_count, none);
+		net_table.assign(net_count, none);
+	}
+
+	// the component that represents c in the scheduler
+	uint32_t node(uint32_t c) const {
+		auto t = component_table[c];
+		return t == none ? c : tables[t].head;
+	}
+};
+
+// builds the tables from the current net table, levels and driving flags; called by the simulation as it
+// resynchronizes, after reset and a first levelization
+void extract_logic_tables(sys::state& state);
+
+} // namespace circuit
@@ -0,0 +1,323 @@
+#include <algorithm>
+#include <array>
+#include "module.hpp"
+#include "system_state.hpp"
+
+namespace circuit {
+
+void compile_module(module_definition& def) {
+	assert(def.instance_count() == 0);
+	constexpr uint32_t none = 0xFFFFFFFF;
+
+	// every pin in the definition, joined with the same rules as on the board (see netlist.hpp)
+	struct pin_record {
+		uint32_t point = 0;
+		uint32_t id = 0;
+		sys::wire_colors color = sys::wire_colors::amber;
+		bool is_wire = false;
+	};
+	std::vector<pin_record> pins;
+	uint32_t next_id = 0;
+
+	std::vector<uint32_t> component_pin_base(def.components.size());
+	for(size_t i = 0; i < def.components.size(); ++i) {
+		auto& c = def.components[i];
+		auto kind = to_item_kind(c.type);
+		component_pin_base[i] = next_id;
+		for(uint32_t s = 0; s < pin_count(kind); ++s)
+			pins.push_back(pin_record{ pack_point(component_pin_position(grid_point{ c.x, c.y }, c.orientation, pin_slot(s))), next_id++ });
+	}
+	auto wire_pin_base = next_id;
+	for(auto& w : def.wires) {
+		pins.push_back(pin_record{ pack_point(grid_point{ w.start_x, w.start_y }), next_id++, w.color, true });
+		pins.push_back(pin_record{ pack_point(grid_point{ w.end_x, w.end_y }), next_id++, w.color, true });
+	}
+	auto port_pin_base = next_id;
+	for(auto& p : def.ports)
+		pins.push_back(pin_record{ pack_point(grid_point{ p.x, p.y }), next_id++ });
+
+	std::vector<uint32_t> parent(next_id);
+	for(uint32_t i = 0; i < next_id; ++i)
+		parent[i] = i;
+	auto find = [&](uint32_t x) {
+		while(parent[x] != x) {
+			parent[x] = parent[parent[x]];
+			x = parent[x];
+		}
+		return x;
+	};
+	auto unite = [&](uint32_t a, uint32_t b) {
+		a = find(a);
+		b = find(b);
+		if(a != b)
+			parent[std::max(a, b)] = std::min(a, b);
+	};
+
+	std::sort(pins.begin(), pins.end(), [](pin_record const& a, pin_record const& b) { return a.point < b.point; });
+	for(size_t g = 0; g < pins.size();) {
+		auto end = g;
+		bool has_pin = false;
+		while(end < pins.size() && pins[end].point == pins[g].point) {
+			has_pin = has_pin || !pins[end].is_wire;
+			++end;
+		}
+		if(has_pin) {
+			for(auto i = g + 1; i < end; ++i)
+				unite(pins[g].id, pins[i].id);
+		} else {
+			std::array<uint32_t, sys::max_wire_color + 1> first_of_color;
+			first_of_color.fill(none);
+			for(auto i = g; i < end; ++i) {
+				auto& f = first_of_color[uint8_t(pins[i].color)];
+				if(f == none)
+					f = pins[i].id;
+				else
+					unite(f, pins[i].id);
+			}
+		}
+		g = end;
+	}
+	for(uint32_t i = 0; i < uint32_t(def.wires.size()); ++i)
+		unite(wire_pin_base + 2 * i, wire_pin_base + 2 * i + 1);
+
+	std::vector<uint32_t> root_net(next_id, none);
+	uint32_t local_nets = 0;
+	auto local_net = [&](uint32_t id) {
+		auto r = find(id);
+		if(root_net[r] == none)
+			root_net[r] = local_nets++;
+		return root_net[r];
+	};
+	for(uint32_t i = 0; i < next_id; ++i)
+		local_net(i);
+	def.local_net_count = local_nets;
+	auto const ones = 2 * local_nets;
+
+	// one operation per component, then levelized exactly like the board (see simulation.cpp)
+	auto op_count = uint32_t(def.components.size());
+	std::vector<uint32_t> in(op_count), ctl(op_count), out(op_count);
+	std::vector<uint8_t> inv(op_count);
+	for(uint32_t i = 0; i < op_count; ++i) {
+		auto type = def.components[i].type;
+		auto base = component_pin_base[i];
+		in[i] = local_net(base + uint32_t(pin_slot::input));
+		out[i] = local_net(base + uint32_t(pin_slot::output));
+		ctl[i] = type == sys::basic_component_type::diode ? ones : local_net(base + uint32_t(pin_slot::control));
+		inv[i] = type == sys::basic_component_type::enable_low_transistor ? 1 : 0;
+	}
+
+	std::vector<uint32_t> net_drivers(local_nets, 0);
+	for(uint32_t i = 0; i < op_count; ++i)
+		++net_drivers[out[i]];
+	std::vector<uint32_t> reader_start(size_t(local_nets) + 1, 0);
+	std::vector<uint32_t> indegree(op_count, 0);
+	for(uint32_t i = 0; i < op_count; ++i) {
+		indegree[i] += net_drivers[in[i]];
+		++reader_start[in[i] + 1];
+		if(ctl[i] != ones) {
+			indegree[i] += net_drivers[ctl[i]];
+			++reader_start[ctl[i] + 1];
+		}
+	}
+	for(uint32_t n = 1; n <= local_nets; ++n)
+		reader_start[n] += reader_start[n - 1];
+	std::vector<uint32_t> readers(reader_start[local_nets]);
+	{
+		std::vector<uint32_t> cursor(reader_start.begin(), reader_start.end() - 1);
+		for(uint32_t i = 0; i < op_count; ++i) {
+			readers[cursor[in[i]]++] = i;
+			if(ctl[i] != ones)
+				readers[cursor[ctl[i]]++] = i;
+		}
+	}
+
+	std::vector<uint32_t> level(op_count, 0);
+	std::vector<uint32_t> ready;
+	for(uint32_t i = 0; i < op_count; ++i) {
+		if(indegree[i] == 0)
+			ready.push_back(i);
+	}
+	for(size_t k = 0; k < ready.size(); ++k) {
+		auto i = ready[k];
+		for(auto j = reader_start[out[i]]; j < reader_start[out[i] + 1]; ++j) {
+			auto r = readers[j];
+			level[r] = std::max(level[r], level[i] + 1);
+			if(--indegree[r] == 0)
+				ready.push_back(r);
+		}
+	}
+
+	std::vector<uint32_t> driver_level(local_nets, 0);
+	for(uint32_t i = 0; i < op_count; ++i)
+		driver_level[out[i]] = std::max(driver_level[out[i]], level[i]);
+	def.has_feedback = false;
+	auto operand = [&](uint32_t n, uint32_t reader_level) {
+		if(n != ones && net_drivers[n] != 0 && driver_level[n] >= reader_level) {
+			def.has_feedback = true;
+			return local_nets + n;
+		}
+		return n;
+	};
+
+	std::vector<uint32_t> order(op_count);
+	for(uint32_t i = 0; i < op_count; ++i)
+		order[i] = i;
+	std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return level[a] < level[b]; });
+
+	def.op_input.clear();
+	def.op_control.clear();
+	def.op_output.clear();
+	def.op_invert.clear();
+	for(auto i : order) {
+		def.op_input.push_back(operand(in[i], level[i]));
+		def.op_control.push_back(operand(ctl[i], level[i]));
+		def.op_output.push_back(out[i]);
+		def.op_invert.push_back(inv[i]);
+	}
+	def.port_nets.clear();
+	for(uint32_t p = 0; p < uint32_t(def.ports.size()); ++p)
+		def.port_nets.push_back(local_net(port_pin_base + p));
+}
+
+uint32_t define_module(sys::state& state, grid_point top_left, grid_point bottom_right, std::span<module_port const> ports) {
+	auto inside = [&](grid_point p) {
+		return top_left.x <= p.x && p.x <= bottom_right.x && top_left.y <= p.y && p.y <= bottom_right.y;
+	};
+	auto relative = [&](grid_point p) {
+		return grid_point{ int16_t(p.x - top_left.x), int16_t(p.y - top_left.y) };
+	};
+	auto all_pins_inside = [&](board_item item) {
+		for(uint32_t s = 0; s < item_pin_count(state, item); ++s) {
+			if(!inside(pin_position(state, item.with_slot(pin_slot(s)))))
+				return false;
+		}
+		return inside(item_position(state, item));
+	};
+
+	module_definition def;
+	def.width = int16_t(bottom_right.x - top_left.x + 1);
+	def.height = int16_t(bottom_right.y - top_left.y + 1);
+	for(uint32_t i = 0; i < state.world.diode_size(); ++i) {
+		auto id = dcon::diode_id{ dcon::diode_id::value_base_t(i) };
+		if(all_pins_inside(board_item(item_kind::diode, i))) {
+			auto p = relative(item_position(state, board_item(item_kind::diode, i)));
+			def.components.push_back(module_component{ p.x, p.y, state.world.diode_get_orientation(id), sys::basic_component_type::diode });
+		}
+	}
+	for(uint32_t i = 0; i < state.world.enable_high_transistor_size(); ++i) {
+		auto id = dcon::enable_high_transistor_id{ dcon::enable_high_transistor_id::value_base_t(i) };
+		if(all_pins_inside(board_item(item_kind::enable_high_transistor, i))) {
+			auto p = relative(item_position(state, board_item(item_kind::enable_high_transistor, i)));
+			def.components.push_back(module_component{ p.x, p.y, state.world.enable_high_transistor_get_orientation(id), sys::basic_component_type::enable_high_transistor });
+		}
+	}
+	for(uint32_t i = 0; i < state.world.enable_low_transistor_size(); ++i) {
+		auto id = dcon::enable_low_transistor_id{ dcon::enable_low_transistor_id::value_base_t(i) };
+		if(all_pins_inside(board_item(item_kind::enable_low_transistor, i))) {
+			auto p = relative(item_position(state, board_item(item_kind::enable_low_transistor, i)));
+			def.components.push_back(module_component{ p.x, p.y, state.world.enable_low_transistor_get_orientation(id), sys::basic_component_type::enable_low_transistor });
+		}
+	}
+	for(uint32_t i = 0; i < state.world.wire_segment_size(); ++i) {
+		auto id = dcon::wire_segment_id{ dcon::wire_segment_id::value_base_t(i) };
+		if(all_pins_inside(board_item(item_kind::wire_segment, i))) {
+			auto s = relative(grid_point{ state.world.wire_segment_get_start_x(id), state.world.wire_segment_get_start_y(id) });
+			auto e = relative(grid_point{ state.world.wire_segment_get_end_x(id), state.world.wire_segment_get_end_y(id) });
+			def.wires.push_back(module_wire{ s.x, s.y, e.x, e.y, state.world.wire_segment_get_color(id) });
+		}
+	}
+	// nested instances are flattened into the new definition; their ports become ordinary connection points
+	for(uint32_t i = 0; i < state.world.module_instance_size(); ++i) {
+		auto id = dcon::module_instance_id{ dcon::module_instance_id::value_base_t(i) };
+		if(!all_pins_inside(board_item(item_kind::module_instance, i)))
+			continue;
+		auto& nested = state.modules.definitions[state.world.module_instance_get_definition(id)];
+		auto o = relative(item_position(state, board_item(item_kind::module_instance, i)));
+		for(auto c : nested.components) {
+			c.x = int16_t(c.x + o.x);
+			c.y = int16_t(c.y + o.y);
+			def.components.push_back(c);
+		}
+		for(auto w : nested.wires) {
+			w.start_x = int16_t(w.start_x + o.x);
+			w.start_y = int16_t(w.start_y + o.y);
+			w.end_x = int16_t(w.end_x + o.x);
+			w.end_y = int16_t(w.end_y + o.y);
+			def.wires.push_back(w);
+		}
+	}
+	for(auto p : ports) {
+		auto r = relative(grid_point{ p.x, p.y });
+		def.ports.push_back(module_port{ r.x, r.y, p.is_output });
+	}
+
+	compile_module(def);
+	state.modules.definitions.push_back(std::move(def));
+	return uint32_t(state.modules.definitions.size() - 1);
+}
+
+uint32_t allocate_module_slot(module_definition& def, uint32_t owner) {
+	auto slot = def.instance_count();
+	def.slot_owner.push_back(owner);
+	def.instance_values.resize(def.instance_values.size() + def.local_net_count, 0);
+	def.instance_driving.resize(def.instance_driving.size() + def.ports.size(), 0);
+	def.instance_port_nets.resize(def.instance_port_nets.size() + def.ports.size(), dcon::net_id{});
+	return slot;
+}
+
+void release_module_slot(sys::state& state, module_definition& def, uint32_t slot) {
+	auto last = def.instance_count() - 1;
+	auto nets = size_t(def.local_net_count);
+	auto ports = def.ports.size();
+	if(slot != last) {
+		std::copy_n(def.instance_values.begin() + last * nets, nets, def.instance_values.begin() + slot * nets);
+		std::copy_n(def.instance_driving.begin() + last * ports, ports, def.instance_driving.begin() + slot * ports);
+		std::copy_n(def.instance_port_nets.begin() + last * ports, ports, def.instance_port_nets.begin() + slot * ports);
+		def.slot_owner[slot] = def.slot_owner[last];
+		state.world.module_instance_set_state_slot(dcon::module_instance_id{ dcon::module_instance_id::value_base_t(def.slot_owner[slot]) }, slot);
+	}
+	def.slot_owner.pop_back();
+	def.instance_values.resize(last * nets);
+	def.instance_driving.resize(last * ports);
+	def.instance_port_nets.resize(last * ports);
+}
+
+bool evaluate_module_instance(module_definition& def, uint32_t slot, std::vector<uint8_t> const& net_value) {
+	// instances may be evaluated from several partitions at once
+	thread_local std::vector<uint8_t> scratch;
+
+	auto nets = def.local_net_count;
+	auto ports = uint32_t(def.ports.size());
+	scratch.resize(2 * size_t(nets) + 1);
+	uint8_t* values = scratch.data();
+	uint8_t* current = values;
+	uint8_t* previous = values + nets;
+	values[2 * nets] = 1;
+
+	uint8_t* stored = def.instance_values.data() + size_t(slot) * nets;
+	dcon::net_id const* port_nets = def.instance_port_nets.data() + size_t(slot) * ports;
+	std::copy(stored, stored + nets, previous);
+
+	auto op_count = def.op_output.size();
+	bool settled = false;
+	for(uint32_t pass = 0; pass < module_definition::max_passes; ++pass) {
+		std::fill(current, current + nets, uint8_t(0));
+		for(uint32_t p = 0; p < ports; ++p) {
+			if(!def.ports[p].is_output && port_nets[p] && net_value[port_nets[p].index()] != 0)
+				current[def.port_nets[p]] = 1;
+		}
+		for(size_t i = 0; i < op_count; ++i) {
+			auto c = uint8_t(values[def.op_control[i]] ^ def.op_invert[i]);
+			values[def.op_output[i]] |= uint8_t(values[def.op_input[i]] & c);
+		}
+		if(!def.has_feedback || std::equal(current, current + nets, previous)) {
+			settled = true;
+			break;
+		}
+		std::copy(current, current + nets, previous);
+	}
+	std::copy(current, current + nets, stored);
+	return settled;
+}
+
+} // namespace circuit
@@ -0,0 +1,88 @@
+#pragma once
+#include <vector>
+#include <span>
+#include <stdint.h>
+#include "dcon_generated_ids.hpp"
+#include "circuit.hpp"
+
+// reusable sub-circuits
+//
+// a module definition is a captured piece of board (its components and wires, relative to the module's origin)
+// plus a list of ports. a definition is compiled once into an evaluation block: its own local nets and a
+// levelized list of operations over them, in the same form as the lane program. a placed instance owns nothing
+// but a state slot in its definition: the settled value of every local net, whether each output port is
+// driving, and the board net at each port. the topology is shared by every instance.
+//
+// on the board, instance ports behave like component pins. an input port feeds the value of the board net into
+// the local net at the port, and an output port drives the board net with the value of its local net. whenever
+// an input changes, the whole block of the instance is evaluated, starting from its previous local values so
+// that latches inside the module keep their state
+
+namespace circuit {
+
+struct module_component {
+	int16_t x = 0;
+	int16_t y = 0;
+	sys::orientation orientation = sys::orientation::right;
+	sys::basic_component_type type = sys::basic_component_type::diode;
+};
+struct module_wire {
+	int16_t start_x = 0;
+	int16_t start_y = 0;
+	int16_t end_x = 0;
+	int16_t end_y = 0;
+	sys::wire_colors color = sys::wire_colors::amber;
+};
+struct module_port {
+	int16_t x = 0;
+	int16_t y = 0;
+	bool is_output = false;
+};
+
+struct module_definition {
+	std::vector<module_component> components;
+	std::vector<module_wire> wires;
+	std::vector<module_port> ports;
+	int16_t width = 1;  // the captured rectangle, which is what an instance covers on the board
+	int16_t height = 1;
+
+	// compiled block, one operation per component in level order: values[output] |= values[input] & (values[control]
+	// or its complement); operands index 2 * local_net_count + 1 bytes: this pass, the previous pass, then a constant one
+	std::vector<uint32_t> op_input;
+	std::vector<uint32_t> op_control;
+	std::vector<uint32_t> op_output;
+	std::vector<uint8_t> op_invert;
+	std::vector<uint32_t> port_nets; // the local net at each port
+	uint32_t local_net_count = 0;
+	bool has_feedback = false;
+
+	// instance state, indexed by state slot
+	std::vector<uint8_t> instance_values;         // local_net_count per slot
+	std::vector<uint8_t> instance_driving;        // one per port per slot
+	std::vector<dcon::net_id> instance_port_nets; // one per port per slot
+	std::vector<uint32_t> slot_owner;             // the module_instance occupying each slot
+
+	uint32_t instance_count() const {
+		return uint32_t(slot_owner.size());
+	}
+
+	static constexpr uint32_t max_passes = 64;
+};
+
+struct module_library {
+	std::vector<module_definition> definitions;
+};
+
+// captures every part lying inside the rectangle (inclusive) as a new definition and returns its index;
+// the port positions are given in board coordinates
+uint32_t define_module(sys::state& state, grid_point top_left, grid_point bottom_right, std::span<module_port const> ports);
+void compile_module(module_definition& def);
+
+uint32_t allocate_module_slot(module_definition& def, uint32_t owner);
+// fills the hole with the last slot, updating the instance that owned it
+void release_module_slot(sys::state& state, module_definition& def, uint32_t slot);
+
+// evaluates one instance against the board net values; returns false if the block did not settle
+bool evaluate_module_instance(module_definition& def, uint32_t slot, std::vector<uint8_t> const& net_value);
+
+} // namespace circuit
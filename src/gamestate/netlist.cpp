@@ -0,0 +1,518 @@
+#include <array>
+#include <algorithm>
+#include "netlist.hpp"
+#include "system_state.hpp"
+
+namespace circuit {
+
+//
+// connection index
+//
+
+uint32_t connection_index::add(grid_point p, board_item pin) {
+	uint32_t e = 0;
+	if(!free_entries.empty()) {
+		e = free_entries.back();
+		free_entries.pop_back();
+	} else {
+		e = uint32_t(entries.size());
+		entries.emplace_back();
+	}
+	auto key = pack_point(p);
+	auto it = heads.find(key);
+	entries[e].pin = pin;
+	entries[e].point = key;
+	entries[e].next = it != heads.end() ? it->second : no_entry;
+	heads.insert_or_assign(key, e);
+	return e;
+}
+
+void connection_index::remove(grid_point p, board_item pin) {
+	auto it = heads.find(pack_point(p));
+	if(it == heads.end()) {
+		assert(false);
+		return;
+	}
+	uint32_t prev = no_entry;
+	for(auto e = it->second; e != no_entry; e = entries[e].next) {
+		if(entries[e].pin == pin) {
+			if(prev != no_entry)
+				entries[prev].next = entries[e].next;
+			else if(entries[e].next != no_entry)
+				it->second = entries[e].next;
+			else
+				heads.erase(it);
+			entries[e].next = no_entry;
+			free_entries.push_back(e);
+			return;
+		}
+		prev = e;
+	}
+	assert(false);
+}
+
+void connection_index::replace(grid_point p, board_item from, board_item to) {
+	auto e = find(p, from);
+	assert(e != no_entry);
+	if(e != no_entry)
+		entries[e].pin = to;
+}
+
+uint32_t connection_index::find(grid_point p, board_item pin) const {
+	for(auto e = first_at(p); e != no_entry; e = entries[e].next) {
+		if(entries[e].pin == pin)
+			return e;
+	}
+	return no_entry;
+}
+
+uint32_t connection_index::first_at(grid_point p) const {
+	return first_at(pack_point(p));
+}
+uint32_t connection_index::first_at(uint32_t packed_point) const {
+	auto it = heads.find(packed_point);
+	return it != heads.end() ? it->second : no_entry;
+}
+
+void connection_index::clear() {
+	heads.clear();
+	entries.clear();
+	free_entries.clear();
+}
+
+void connection_index::reserve(size_t count) {
+	heads.reserve(count);
+	entries.reserve(count);
+}
+
+//
+// net maintenance
+//
+
+bool netlist_point_has_component_pin(connection_index const& idx, uint32_t head) {
+	for(auto e = head; e != connection_index::no_entry; e = idx.get(e).next) {
+		if(idx.get(e).pin.kind() != item_kind::wire_segment)
+			return true;
+	}
+	return false;
+}
+
+sys::wire_colors netlist_wire_color(sys::state& state, board_item pin) {
+	return state.world.wire_segment_get_color(dcon::wire_segment_id{ dcon::wire_segment_id::value_base_t(pin.index()) });
+}
+
+// whether two entries sharing a grid point are connected
+bool netlist_joins(sys::state& state, board_item a, board_item b, bool point_has_component_pin) {
+	if(point_has_component_pin)
+		return true;
+	return netlist_wire_color(state, a) == netlist_wire_color(state, b);
+}
+
+// visits every entry physically connected to `start`, calling on_entry once for each
+template<typename F>
+void netlist_flood(sys::state& state, netlist& nl, uint32_t start, F&& on_entry) {
+	++nl.visit_epoch;
+	if(nl.visit_epoch == 0) {
+		std::fill(nl.visit_mark.begin(), nl.visit_mark.end(), 0);
+		nl.visit_epoch = 1;
+	}
+	if(nl.visit_mark.size() < nl.points.capacity())
+		nl.visit_mark.resize(nl.points.capacity(), 0);
+
+	nl.work_stack.clear();
+	nl.work_stack.push_back(start);
+	nl.visit_mark[start] = nl.visit_epoch;
+
+	while(!nl.work_stack.empty()) {
+		auto e = nl.work_stack.back();
+		nl.work_stack.pop_back();
+		auto const& en = nl.points.get(e);
+		on_entry(e);
+
+		auto head = nl.points.first_at(en.point);
+		bool has_pin = netlist_point_has_component_pin(nl.points, head);
+		for(auto o = head; o != connection_index::no_entry; o = nl.points.get(o).next) {
+			if(nl.visit_mark[o] != nl.visit_epoch && netlist_joins(state, en.pin, nl.points.get(o).pin, has_pin)) {
+				nl.visit_mark[o] = nl.visit_epoch;
+				nl.work_stack.push_back(o);
+			}
+		}
+		if(en.pin.kind() == item_kind::wire_segment) {
+			auto other = en.pin.with_slot(en.pin.slot() == pin_slot::input ? pin_slot::output : pin_slot::input);
+			auto oe = nl.points.find(pin_position(state, other), other);
+			if(oe != connection_index::no_entry && nl.visit_mark[oe] != nl.visit_epoch) {
+				nl.visit_mark[oe] = nl.visit_epoch;
+				nl.work_stack.push_back(oe);
+			}
+		}
+	}
+}
+
+dcon::net_id netlist_allocate_net(netlist& nl) {
+	uint32_t i = 0;
+	if(!nl.free_nets.empty()) {
+		i = nl.free_nets.back();
+		nl.free_nets.pop_back();
+		nl.net_size[i] = 0;
+	} else {
+		i = uint32_t(nl.net_size.size());
+		nl.net_size.push_back(0);
+	}
+	auto n = dcon::net_id{ dcon::net_id::value_base_t(i) };
+	nl.changed_nets.push_back(n);
+	return n;
+}
+
+void netlist_release_net(netlist& nl, dcon::net_id n) {
+	assert(nl.net_size[n.index()] == 0);
+	nl.free_nets.push_back(uint32_t(n.index()));
+	nl.changed_nets.push_back(n);
+}
+
+// relabels the smaller of two nets into the larger one; the entries may be any member of their respective nets
+dcon::net_id netlist_merge(sys::state& state, netlist& nl, dcon::net_id a, uint32_t a_entry, dcon::net_id b, uint32_t b_entry) {
+	if(a == b)
+		return a;
+	if(nl.net_size[a.index()] < nl.net_size[b.index()]) {
+		std::swap(a, b);
+		std::swap(a_entry, b_entry);
+	}
+	netlist_flood(state, nl, b_entry, [&](uint32_t e) {
+		set_pin_net(state, nl.points.get(e).pin, a);
+	});
+	nl.net_size[a.index()] += nl.net_size[b.index()];
+	nl.net_size[b.index()] = 0;
+	netlist_release_net(nl, b);
+	nl.changed_nets.push_back(a);
+	return a;
+}
+
+// after entries of net n were removed, relabels any pieces that are no longer connected to the first seed
+void netlist_split(sys::state& state, netlist& nl, dcon::net_id n) {
+	auto& seeds = nl.split_seeds;
+	nl.changed_nets.push_back(n);
+	if(seeds.empty()) {
+		if(nl.net_size[n.index()] == 0)
+			netlist_release_net(nl, n);
+		return;
+	}
+	if(seeds.size() == 1) // a single neighbor cannot have been disconnected from anything
+		return;
+
+	uint32_t kept = 0;
+	netlist_flood(state, nl, seeds[0], [&](uint32_t e) { ++kept; });
+	auto first_epoch = nl.visit_epoch;
+
+	for(size_t i = 1; i < seeds.size(); ++i) {
+		auto s = seeds[i];
+		if(nl.visit_mark[s] == first_epoch)
+			continue;
+		if(pin_net(state, nl.points.get(s).pin) != n) // already split off from an earlier seed
+			continue;
+		auto m = netlist_allocate_net(nl);
+		uint32_t moved = 0;
+		netlist_flood(state, nl, s, [&](uint32_t e) {
+			set_pin_net(state, nl.points.get(e).pin, m);
+			++moved;
+		});
+		nl.net_size[m.index()] = moved;
+	}
+	nl.net_size[n.index()] = kept;
+}
+
+void add_to_netlist(sys::state& state, board_item part) {
+	auto& nl = state.netlist;
+	nl.table_out_of_date = true;
+	if(nl.suspended)
+		return;
+
+	if(part.kind() == item_kind::wire_segment) {
+		dcon::net_id net;
+		uint32_t net_entry = connection_index::no_entry;
+		auto color = netlist_wire_color(state, part);
+		grid_point ends[2];
+		for(uint32_t s = 0; s < 2; ++s) {
+			ends[s] = pin_position(state, part.with_slot(pin_slot(s)));
+			auto head = nl.points.first_at(ends[s]);
+			bool has_pin = netlist_point_has_component_pin(nl.points, head);
+			for(auto o = head; o != connection_index::no_entry; o = nl.points.get(o).next) {
+				auto opin = nl.points.get(o).pin;
+				if(!has_pin && netlist_wire_color(state, opin) != color)
+					continue;
+				auto onet = pin_net(state, opin);
+				if(!net) {
+					net = onet;
+					net_entry = o;
+				} else if(onet != net) {
+					net = netlist_merge(state, nl, net, net_entry, onet, o);
+				}
+			}
+		}
+		if(!net)
+			net = netlist_allocate_net(nl);
+		set_pin_net(state, part, net);
+		nl.points.add(ends[0], part.with_slot(pin_slot::input));
+		nl.points.add(ends[1], part.with_slot(pin_slot::output));
+		nl.net_size[net.index()] += 2;
+		nl.changed_nets.push_back(net);
+	} else {
+		for(uint32_t s = 0; s < item_pin_count(state, part); ++s) {
+			auto pin = part.with_slot(pin_slot(s));
+			auto p = pin_position(state, pin);
+			dcon::net_id net;
+			uint32_t net_entry = connection_index::no_entry;
+			// a component pin joins everything on its point, whatever the wire color
+			for(auto o = nl.points.first_at(p); o != connection_index::no_entry; o = nl.points.get(o).next) {
+				auto onet = pin_net(state, nl.points.get(o).pin);
+				if(!net) {
+					net = onet;
+					net_entry = o;
+				} else if(onet != net) {
+					net = netlist_merge(state, nl, net, net_entry, onet, o);
+				}
+			}
+			if(!net)
+				net = netlist_allocate_net(nl);
+			set_pin_net(state, pin, net);
+			nl.points.add(p, pin);
+			nl.net_size[net.index()] += 1;
+			nl.changed_nets.push_back(net);
+		}
+	}
+}
+
+void remove_from_netlist(sys::state& state, board_item part) {
+	auto& nl = state.netlist;
+	nl.table_out_of_date = true;
+	if(nl.suspended)
+		return;
+
+	if(part.kind() == item_kind::wire_segment) {
+		auto net = pin_net(state, part);
+		grid_point ends[2] = { pin_position(state, part.with_slot(pin_slot::input)), pin_position(state, part.with_slot(pin_slot::output)) };
+		nl.points.remove(ends[0], part.with_slot(pin_slot::input));
+		nl.points.remove(ends[1], part.with_slot(pin_slot::output));
+		nl.net_size[net.index()] -= 2;
+
+		nl.split_seeds.clear();
+		for(auto p : ends) {
+			for(auto o = nl.points.first_at(p); o != connection_index::no_entry; o = nl.points.get(o).next) {
+				if(pin_net(state, nl.points.get(o).pin) == net)
+					nl.split_seeds.push_back(o);
+			}
+		}
+		netlist_split(state, nl, net);
+	} else {
+		for(uint32_t s = 0; s < item_pin_count(state, part); ++s) {
+			auto pin = part.with_slot(pin_slot(s));
+			auto p = pin_position(state, pin);
+			auto net = pin_net(state, pin);
+			nl.points.remove(p, pin);
+			nl.net_size[net.index()] -= 1;
+
+			nl.split_seeds.clear();
+			for(auto o = nl.points.first_at(p); o != connection_index::no_entry; o = nl.points.get(o).next) {
+				if(pin_net(state, nl.points.get(o).pin) == net)
+					nl.split_seeds.push_back(o);
+			}
+			netlist_split(state, nl, net);
+		}
+	}
+}
+
+void move_in_netlist(sys::state& state, board_item from, board_item to) {
+	if(state.netlist.suspended)
+		return;
+	for(uint32_t s = 0; s < item_pin_count(state, from); ++s) {
+		auto pin = from.with_slot(pin_slot(s));
+		state.netlist.points.replace(pin_position(state, pin), pin, to.with_slot(pin_slot(s)));
+	}
+	state.netlist.table_out_of_date = true;
+}
+
+void suspend_netlist(sys::state& state) {
+	++state.netlist.suspended;
+	state.netlist.table_out_of_date = true;
+}
+
+void resume_netlist(sys::state& state) {
+	assert(state.netlist.suspended > 0);
+	if(--state.netlist.suspended == 0)
+		rebuild_netlist(state);
+}
+
+void rebuild_netlist(sys::state& state) {
+	auto& nl = state.netlist;
+	nl.points.clear();
+	nl.net_size.clear();
+	nl.free_nets.clear();
+	nl.changed_nets.clear();
+	nl.visit_mark.clear();
+	nl.visit_epoch = 0;
+	nl.table_out_of_date = true;
+	++nl.rebuild_generation;
+
+	// the index starts empty, so entries are numbered in insertion order and can serve directly as union-find nodes;
+	// wire segments are inserted last, start before end
+	constexpr item_kind insertion_order[] = {
+		item_kind::diode, item_kind::enable_high_transistor, item_kind::enable_low_transistor, item_kind::module_instance, item_kind::wire_segment
+	};
+	static_assert(std::size(insertion_order) == item_kind_count);
+
+	size_t total = 0;
+	for(auto kind : insertion_order) {
+		auto count = item_count(state, kind);
+		for(uint32_t i = 0; i < count; ++i)
+			total += item_pin_count(state, board_item(kind, i));
+	}
+	nl.points.reserve(total);
+
+	for(auto kind : insertion_order) {
+		auto count = item_count(state, kind);
+		for(uint32_t i = 0; i < count; ++i) {
+			auto pins = item_pin_count(state, board_item(kind, i));
+			for(uint32_t s = 0; s < pins; ++s) {
+				auto pin = board_item(kind, i, pin_slot(s));
+				nl.points.add(pin_position(state, pin), pin);
+			}
+		}
+	}
+	assert(nl.points.capacity() == total);
+
+	std::vector<uint32_t> parent(total);
+	for(uint32_t i = 0; i < total; ++i)
+		parent[i] = i;
+	auto find = [&](uint32_t x) {
+		while(parent[x] != x) {
+			parent[x] = parent[parent[x]];
+			x = parent[x];
+		}
+		return x;
+	};
+	auto unite = [&](uint32_t a, uint32_t b) {
+		a = find(a);
+		b = find(b);
+		if(a < b)
+			parent[b] = a;
+		else if(b < a)
+			parent[a] = b;
+	};
+
+	nl.points.for_each_point([&](uint32_t key, uint32_t head) {
+		uint32_t first_pin = connection_index::no_entry;
+		for(auto e = head; e != connection_index::no_entry; e = nl.points.get(e).next) {
+			if(nl.points.get(e).pin.kind() != item_kind::wire_segment) {
+				first_pin = e;
+				break;
+			}
+		}
+		if(first_pin != connection_index::no_entry) {
+			for(auto e = head; e != connection_index::no_entry; e = nl.points.get(e).next)
+				unite(first_pin, e);
+		} else {
+			std::array<uint32_t, sys::max_wire_color + 1> first_of_color;
+			first_of_color.fill(connection_index::no_entry);
+			for(auto e = head; e != connection_index::no_entry; e = nl.points.get(e).next) {
+				auto c = uint8_t(netlist_wire_color(state, nl.points.get(e).pin));
+				if(first_of_color[c] == connection_index::no_entry)
+					first_of_color[c] = e;
+				else
+					unite(first_of_color[c], e);
+			}
+		}
+	});
+
+	auto wire_count = item_count(state, item_kind::wire_segment);
+	auto wire_base = uint32_t(total - size_t(wire_count) * 2);
+	for(uint32_t i = 0; i < wire_count; ++i)
+		unite(wire_base + i * 2, wire_base + i * 2 + 1);
+
+	std::vector<uint32_t> root_net(total, connection_index::no_entry);
+	for(uint32_t e = 0; e < total; ++e) {
+		auto r = find(e);
+		if(root_net[r] == connection_index::no_entry) {
+			root_net[r] = uint32_t(nl.net_size.size());
+			nl.net_size.push_back(0);
+		}
+		set_pin_net(state, nl.points.get(e).pin, dcon::net_id{ dcon::net_id::value_base_t(root_net[r]) });
+		++nl.net_size[root_net[r]];
+	}
+}
+
+void update_net_table(sys::state& state) {
+	auto& nl = state.netlist;
+	if(!nl.table_out_of_date)
+		return;
+
+	auto nets = nl.net_count();
+	auto& offsets = nl.net_pin_offsets;
+	offsets.assign(size_t(nets) + 1, 0);
+
+	// counting sort of every component pin and module port by net: two linear passes, no hashing
+	auto count_pin = [&](dcon::net_id n) {
+		assert(n && uint32_t(n.index()) < nets);
+		++offsets[n.index() + 1];
+	};
+	for(uint32_t i = 0; i < state.world.diode_size(); ++i) {
+		auto id = dcon::diode_id{ dcon::diode_id::value_base_t(i) };
+		count_pin(state.world.diode_get_input_net(id));
+		count_pin(state.world.diode_get_output_net(id));
+	}
+	for(uint32_t i = 0; i < state.world.enable_high_transistor_size(); ++i) {
+		auto id = dcon::enable_high_transistor_id{ dcon::enable_high_transistor_id::value_base_t(i) };
+		count_pin(state.world.enable_high_transistor_get_input_net(id));
+		count_pin(state.world.enable_high_transistor_get_control_net(id));
+		count_pin(state.world.enable_high_transistor_get_output_net(id));
+	}
+	for(uint32_t i = 0; i < state.world.enable_low_transistor_size(); ++i) {
+		auto id = dcon::enable_low_transistor_id{ dcon::enable_low_transistor_id::value_base_t(i) };
+		count_pin(state.world.enable_low_transistor_get_input_net(id));
+		count_pin(state.world.enable_low_transistor_get_control_net(id));
+		count_pin(state.world.enable_low_transistor_get_output_net(id));
+	}
+	for(uint32_t i = 0; i < state.world.module_instance_size(); ++i) {
+		auto id = dcon::module_instance_id{ dcon::module_instance_id::value_base_t(i) };
+		auto& def = state.modules.definitions[state.world.module_instance_get_definition(id)];
+		auto ports = def.ports.size();
+		auto* port_nets = def.instance_port_nets.data() + state.world.module_instance_get_state_slot(id) * ports;
+		for(size_t p = 0; p < ports; ++p)
+			count_pin(port_nets[p]);
+	}
+	for(uint32_t i = 1; i <= nets; ++i)
+		offsets[i] += offsets[i - 1];
+
+	nl.net_pins.resize(offsets[nets]);
+	std::vector<uint32_t> cursor(offsets.begin(), offsets.end() - 1);
+	auto place_pin = [&](dcon::net_id n, board_item pin) {
+		nl.net_pins[cursor[n.index()]++] = pin;
+	};
+	for(uint32_t i = 0; i < state.world.diode_size(); ++i) {
+		auto id = dcon::diode_id{ dcon::diode_id::value_base_t(i) };
+		place_pin(state.world.diode_get_input_net(id), board_item(item_kind::diode, i, pin_slot::input));
+		place_pin(state.world.diode_get_output_net(id), board_item(item_kind::diode, i, pin_slot::output));
+	}
+	for(uint32_t i = 0; i < state.world.enable_high_transistor_size(); ++i) {
+		auto id = dcon::enable_high_transistor_id{ dcon::enable_high_transistor_id::value_base_t(i) };
+		place_pin(state.world.enable_high_transistor_get_input_net(id), board_item(item_kind::enable_high_transistor, i, pin_slot::input));
+		place_pin(state.world.enable_high_transistor_get_output_net(id), board_item(item_kind::enable_high_transistor, i, pin_slot::output));
+		place_pin(state.world.enable_high_transistor_get_control_net(id), board_item(item_kind::enable_high_transistor, i, pin_slot::control));
+	}
+	for(uint32_t i = 0; i < state.world.enable_low_transistor_size(); ++i) {
+		auto id = dcon::enable_low_transistor_id{ dcon::enable_low_transistor_id::value_base_t(i) };
+		place_pin(state.world.enable_low_transistor_get_input_net(id), board_item(item_kind::enable_low_transistor, i, pin_slot::input));
+		place_pin(state.world.enable_low_transistor_get_output_net(id), board_item(item_kind::enable_low_transistor, i, pin_slot::output));
+		place_pin(state.world.enable_low_transistor_get_control_net(id), board_item(item_kind::enable_low_transistor, i, pin_slot::control));
+	}
+	for(uint32_t i = 0; i < state.world.module_instance_size(); ++i) {
+		auto id = dcon::module_instance_id{ dcon::module_instance_id::value_base_t(i) };
+		auto& def = state.modules.definitions[state.world.module_instance_get_definition(id)];
+		auto ports = def.ports.size();
+		auto* port_nets = def.instance_port_nets.data() + state.world.module_instance_get_state_slot(id) * ports;
+		for(size_t p = 0; p < ports; ++p)
+			place_pin(port_nets[p], board_item(item_kind::module_instance, i, pin_slot(p)));
+	}
+
+	nl.table_out_of_date = false;
+}
+
+} // namespace circuit
@@ -0,0 +1,108 @@
+#pragma once
+#include <vector>
+#include <span>
+#include <stdint.h>
+#include <assert.h>
+#include "unordered_dense.h"
+#include "circuit.hpp"
+
+// the netlist collapses the wire graph into nets: every component pin and every wire segment
+// is labeled with the net it belongs to (the *_net properties in the dcon world), and the
+// simulation reads a compact per-net table of component pins instead of walking wires
+//
+// connectivity rules, evaluated per grid point:
+//   - if any component pin sits on the point, everything on that point is connected
+//   - otherwise, wire endpoints on the point connect only to endpoints of the same color
+//   - both endpoints of a wire segment always share a net
+//
+// edits are applied incrementally: placing a part merges the nets it touches (relabeling the
+// smaller of them), and removing a part re-floods only the net it belonged to
+
+namespace circuit {
+
+class connection_index {
+public:
+	static constexpr uint32_t no_entry = 0xFFFFFFFF;
+
+	struct entry {
+		board_item pin;
+		uint32_t point = 0;
+		uint32_t next = no_entry;
+	};
+private:
+	ankerl::unordered_dense::map<uint32_t, uint32_t> heads;
+	std::vector<entry> entries;
+	std::vector<uint32_t> free_entries;
+public:
+	uint32_t add(grid_point p, board_item pin);
+	void remove(grid_point p, board_item pin);
+	void replace(grid_point p, board_item from, board_item to);
+	uint32_t find(grid_point p, board_item pin) const;
+	uint32_t first_at(grid_point p) const;
+	uint32_t first_at(uint32_t packed_point) const;
+	void clear();
+	void reserve(size_t count);
+
+	entry const& get(uint32_t e) const {
+		return entries[e];
+	}
+	uint32_t capacity() const {
+		return uint32_t(entries.size());
+	}
+	template<typename F>
+	void for_each_point(F&& f) const {
+		for(auto& h : heads)
+			f(h.first, h.second);
+	}
+};
+
+struct netlist {
+	connection_index points;
+
+	std::vector<uint32_t> net_size;         // entries (component pins and wire endpoints) per net; zero for unused ids
+	std::vector<uint32_t> free_nets;
+
+	// compiled table: the component pins of each net, in CSR form
+	std::vector<uint32_t> net_pin_offsets;  // net_count() + 1 entries
+	std::vector<board_item> net_pins;
+	bool table_out_of_date = true;
+
+	// nets created, merged or split since the simulation last consumed this list
+	std::vector<dcon::net_id> changed_nets;
+	// bumped whenever every net id is reassigned at once
+	uint32_t rebuild_generation = 0;
+	// during a bulk edit, edits are not tracked individually; the whole netlist is rebuilt once when it ends.
+	// bulk edits may nest, and this counts how deeply
+	uint32_t suspended = 0;
+
+	// scratch space for flood fills
+	std::vector<uint32_t> visit_mark;
+	std::vector<uint32_t> work_stack;
+	std::vector<uint32_t> split_seeds;
+	uint32_t visit_epoch = 0;
+
+	uint32_t net_count() const {
+		return uint32_t(net_size.size());
+	}
+	std::span<board_item const> pins_of(dcon::net_id n) const {
+		assert(!table_out_of_date);
+		return std::span<board_item const>(net_pins.data() + net_pin_offsets[n.index()], net_pins.data() + net_pin_offsets[n.index() + 1]);
+	}
+};
+
+// called by the board editing functions in circuit.cpp
+void add_to_netlist(sys::state& state, board_item part);
+void remove_from_netlist(sys::state& state, board_item part);
+void move_in_netlist(sys::state& state, board_item from, board_item to); // a part's storage index changed
+
+// relabels the whole board from scratch with a single union-find pass (used after loading or bulk edits)
+void rebuild_netlist(sys::state& state);
+// brings the CSR pin table up to date, if any edit has invalidated it
+void update_net_table(sys::state& state);
+
+// brackets an edit touching many parts at once; the net ids read in between are meaningless. pairs may nest, and the
+// netlist is rebuilt when the outermost one is resumed
+void suspend_netlist(sys::state& state);
+void resume_netlist(sys::state& state);
+
+} // namespace circuit
@@ -0,0 +1,88 @@
+#include <algorithm>
+#include "selection.hpp"
+#include "spatial_index.hpp"
+#include "netlist.hpp"
+#include "module.hpp"
+#include "system_state.hpp"
+
+namespace circuit {
+
+bool part_inside(sys::state& state, board_item part, grid_point top_left, grid_point bottom_right) {
+	auto inside = [&](grid_point p) {
+		return top_left.x <= p.x && p.x <= bottom_right.x && top_left.y <= p.y && p.y <= bottom_right.y;
+	};
+	auto p = item_position(state, part);
+	switch(part.kind()) {
+	case item_kind::diode:
+	case item_kind::enable_high_transistor:
+	case item_kind::enable_low_transistor:
+		return inside(p);
+	case item_kind::wire_segment:
+		return inside(p) && inside(pin_position(state, part.with_slot(pin_slot(1))));
+	case item_kind::module_instance:
+	{
+		auto& def = state.modules.definitions[state.world.module_instance_get_definition(dcon::module_instance_id{ dcon::module_instance_id::value_base_t(part.index()) })];
+		return inside(p) && inside(grid_point{ int16_t(p.x + def.width - 1), int16_t(p.y + def.height - 1) });
+	}
+	}
+	return false;
+}
+
+void select_region(sys::state& state, grid_point top_left, grid_point bottom_right, std::vector<board_item>& out) {
+	out.clear();
+	items_in_rect(state, top_left, bottom_right, out);
+	out.erase(std::remove_if(out.begin(), out.end(), [&](board_item part) { return !part_inside(state, part, top_left, bottom_right); }), out.end());
+	std::sort(out.begin(), out.end(), [](board_item a, board_item b) { return a.value < b.value; });
+}
+
+void delete_region(sys::state& state, grid_point top_left, grid_point bottom_right) {
+	std::vector<board_item> parts;
+	select_region(state, top_left, bottom_right, parts);
+	bool bulk = parts.size() > bulk_edit_threshold;
+	if(bulk)
+		suspend_netlist(state);
+	// removing a part moves the last part of its kind into the hole; going from the highest index down, that part is
+	// never one still waiting to be removed
+	for(auto i = parts.size(); i-- > 0; )
+		remove_item(state, parts[i]);
+	if(bulk)
+		resume_netlist(state);
+}
+
+void move_region(sys::state& state, grid_point top_left, grid_point bottom_right, int16_t dx, int16_t dy) {
+	std::vector<board_item> parts;
+	select_region(state, top_left, bottom_right, parts);
+	bool bulk = parts.size() > bulk_edit_threshold;
+	if(bulk)
+		suspend_netlist(state);
+	for(auto part : parts)
+		move_item(state, part, dx, dy);
+	if(bulk)
+		resume_netlist(state);
+}
+
+void duplicate_region(sys::state& state, grid_point top_left, grid_point bottom_right, int16_t dx, int16_t dy) {
+	std::vector<board_item> parts;
+	select_region(state, top_left, bottom_right, parts);
+
+	// everything is read before anything is placed, as placing may reallocate the part storage
+	std::vector<part_description> copies;
+	copies.reserve(parts.size());
+	for(auto part : parts) {
+		auto d = describe_item(state, part);
+		d.position = grid_point{ int16_t(d.position.x + dx), int16_t(d.position.y + dy) };
+		if(d.kind == item_kind::wire_segment)
+			d.end = grid_point{ int16_t(d.end.x + dx), int16_t(d.end.y + dy) };
+		copies.push_back(d);
+	}
+
+	bool bulk = copies.size() > bulk_edit_threshold;
+	if(bulk)
+		suspend_netlist(state);
+	for(auto& d : copies)
+		place_described(state, d);
+	if(bulk)
+		resume_netlist(state);
+}
+
+} // namespace circuit
@@ -0,0 +1,23 @@
+#pragma once
+#include <vector>
+#include <stdint.h>
+#include "circuit.hpp"
+
+// operations on every part lying entirely within a rectangle of the board (inclusive); the selection is found through
+// the spatial index, so its cost follows the number of parts near the rectangle rather than the size of the board
+
+namespace circuit {
+
+// an edit touching more parts than this rebuilds the netlist once at the end instead of updating it part by part
+constexpr inline uint32_t bulk_edit_threshold = 64;
+
+// replaces the contents of out with the parts inside the rectangle, sorted by their packed value
+void select_region(sys::state& state, grid_point top_left, grid_point bottom_right, std::vector<board_item>& out);
+
+// these must only be called from the thread that owns the game state
+void delete_region(sys::state& state, grid_point top_left, grid_point bottom_right);
+void move_region(sys::state& state, grid_point top_left, grid_point bottom_right, int16_t dx, int16_t dy);
+// places a copy of every part in the rectangle offset by dx, dy; the originals are untouched
+void duplicate_region(sys::state& state, grid_point top_left, grid_point bottom_right, int16_t dx, int16_t dy);
+
+} // namespace circuit
@@ -0,0 +1,553 @@
+#include <algorithm>
+#include <bit>
+#include <thread>
+#include "parallel_tools.hpp"
+#include "simulation.hpp"
+#include "netlist.hpp"
+#include "autosave.hpp"
+#include "system_state.hpp"
+
+namespace circuit {
+
+uint32_t simulation_flat_index(simulation const& sim, board_item item) {
+	switch(item.kind()) {
+	case item_kind::diode:
+		return item.index();
+	case item_kind::enable_high_transistor:
+		return sim.first_enable_high + item.index();
+	case item_kind::enable_low_transistor:
+		return sim.first_enable_low + item.index();
+	case item_kind::module_instance:
+		return sim.first_module + item.index();
+	case item_kind::wire_segment:
+		break;
+	}
+	assert(false);
+	return 0;
+}
+
+// calls f(net, driving) for each output of component c
+template<typename F>
+void simulation_for_each_output(sys::state& state, uint32_t c, F&& f) {
+	auto& sim = state.simulation;
+	if(c < sim.first_enable_high) {
+		auto id = dcon::diode_id{ dcon::diode_id::value_base_t(c) };
+		f(state.world.diode_get_output_net(id), state.world.diode_get_driving(id) != 0);
+	} else if(c < sim.first_enable_low) {
+		auto id = dcon::enable_high_transistor_id{ dcon::enable_high_transistor_id::value_base_t(c - sim.first_enable_high) };
+		f(state.world.enable_high_transistor_get_output_net(id), state.world.enable_high_transistor_get_driving(id) != 0);
+	} else if(c < sim.first_module) {
+		auto id = dcon::enable_low_transistor_id{ dcon::enable_low_transistor_id::value_base_t(c - sim.first_enable_low) };
+		f(state.world.enable_low_transistor_get_output_net(id), state.world.enable_low_transistor_get_driving(id) != 0);
+	} else {
+		auto id = dcon::module_instance_id{ dcon::module_instance_id::value_base_t(c - sim.first_module) };
+		auto& def = state.modules.definitions[state.world.module_instance_get_definition(id)];
+		auto ports = def.ports.size();
+		auto base = size_t(state.world.module_instance_get_state_slot(id)) * ports;
+		for(size_t p = 0; p < ports; ++p) {
+			if(def.ports[p].is_output)
+				f(def.instance_port_nets[base + p], def.instance_driving[base + p] != 0);
+		}
+	}
+}
+
+// queues component c (or the table standing for it); if it is at or below current_level, it waits for the next wave
+void simulation_queue(simulation& sim, uint32_t c, uint32_t current_level) {
+	c = sim.tables.node(c);
+	if(sim.queued[c])
+		return;
+	sim.queued[c] = 1;
+	auto l = sim.component_level[c];
+	auto& part = sim.partitions[sim.component_partition[c]];
+	if(current_level < l)
+		part.level_buckets[l].push_back(c);
+	else
+		part.deferred.push_back(c);
+}
+
+// queues every component reading net n
+void simulation_schedule_readers(sys::state& state, dcon::net_id n, uint32_t current_level) {
+	auto& sim = state.simulation;
+	for(auto pin : state.netlist.pins_of(n)) {
+		if(!pin_is_driver(state, pin))
+			simulation_queue(sim, simulation_flat_index(sim, pin), current_level);
+	}
+}
+
+// notes a change for the state digest
+void simulation_note_net(simulation& sim, simulation_partition* part, dcon::net_id n) {
+	if(!sim.digest.enabled)
+		return;
+	auto& blocks = part ? part->changed_net_blocks : sim.digest.changed_net_blocks;
+	auto b = uint32_t(n.index()) >> state_digest::block_bits;
+	if(blocks.empty() || blocks.back() != b)
+		blocks.push_back(b);
+}
+void simulation_note_component(simulation& sim, simulation_partition& part, uint32_t c) {
+	if(!sim.digest.enabled)
+		return;
+	auto b = c >> state_digest::block_bits;
+	if(part.changed_component_blocks.empty() || part.changed_component_blocks.back() != b)
+		part.changed_component_blocks.push_back(b);
+}
+
+// part is the partition doing the evaluation, if any; on its final wave it records every net that changes
+void simulation_apply_delta(sys::state& state, dcon::net_id n, int32_t delta, uint32_t current_level, simulation_partition* part) {
+	auto& sim = state.simulation;
+	auto& count = sim.high_drivers[n.index()];
+	count = uint32_t(int32_t(count) + delta);
+	uint8_t v = count != 0 ? 1 : 0;
+	if(v != sim.net_value[n.index()]) {
+		sim.net_value[n.index()] = v;
+		simulation_note_net(sim, part, n);
+		simulation_schedule_readers(state, n, current_level);
+		if(part && part->final_wave)
+			part->unsettled_nets.push_back(n);
+	}
+}
+
+// looks up the inputs of a table and applies the difference to what its members drive
+void simulation_evaluate_table(sys::state& state, simulation_partition& part, logic_table& t, uint32_t level) {
+	auto& sim = state.simulation;
+	auto& lt = sim.tables;
+
+	uint32_t index = 0;
+	for(uint32_t i = 0; i < t.input_count; ++i)
+		index |= uint32_t(sim.net_value[lt.inputs[t.first_input + i].index()]) << i;
+	auto entry = lt.entries[t.first_entry + index];
+	auto changed = entry ^ t.driving;
+	t.driving = entry;
+
+	// the internal nets are read only by the table itself, which must not queue itself again
+	sim.queued[t.head] = 1;
+	while(changed != 0) {
+		auto i = uint32_t(std::countr_zero(changed));
+		changed &= changed - 1;
+		auto c = lt.members[t.first_member + i];
+		bool drive = ((entry >> i) & 1) != 0;
+		simulation_note_component(sim, part, c);
+		dcon::net_id out;
+		if(c < sim.first_enable_high) {
+			auto id = dcon::diode_id{ dcon::diode_id::value_base_t(c) };
+			state.world.diode_set_driving(id, drive);
+			out = state.world.diode_get_output_net(id);
+		} else if(c < sim.first_enable_low) {
+			auto id = dcon::enable_high_transistor_id{ dcon::enable_high_transistor_id::value_base_t(c - sim.first_enable_high) };
+			state.world.enable_high_transistor_set_driving(id, drive);
+			out = state.world.enable_high_transistor_get_output_net(id);
+		} else {
+			auto id = dcon::enable_low_transistor_id{ dcon::enable_low_transistor_id::value_base_t(c - sim.first_enable_low) };
+			state.world.enable_low_transistor_set_driving(id, drive);
+			out = state.world.enable_low_transistor_get_output_net(id);
+		}
+		simulation_apply_delta(state, out, drive ? 1 : -1, level, &part);
+	}
+	sim.queued[t.head] = 0;
+}
+
+// re-evaluates one component at the given level, applying any change in what it drives
+void simulation_evaluate(sys::state& state, simulation_partition& part, uint32_t c, uint32_t level) {
+	auto& sim = state.simulation;
+	auto high = [&](dcon::net_id n) { return sim.net_value[n.index()] != 0; };
+
+	if(auto t = sim.tables.component_table[c]; t != logic_tables::none) {
+		simulation_evaluate_table(state, part, sim.tables.tables[t], level);
+	} else if(c < sim.first_enable_high) {
+		auto id = dcon::diode_id{ dcon::diode_id::value_base_t(c) };
+		bool drive = high(state.world.diode_get_input_net(id));
+		if(drive != (state.world.diode_get_driving(id) != 0)) {
+			state.world.diode_set_driving(id, drive);
+			simulation_note_component(sim, part, c);
+			simulation_apply_delta(state, state.world.diode_get_output_net(id), drive ? 1 : -1, level, &part);
+		}
+	} else if(c < sim.first_enable_low) {
+		auto id = dcon::enable_high_transistor_id{ dcon::enable_high_transistor_id::value_base_t(c - sim.first_enable_high) };
+		bool drive = high(state.world.enable_high_transistor_get_input_net(id)) && high(state.world.enable_high_transistor_get_control_net(id));
+		if(drive != (state.world.enable_high_transistor_get_driving(id) != 0)) {
+			state.world.enable_high_transistor_set_driving(id, drive);
+			simulation_note_component(sim, part, c);
+			simulation_apply_delta(state, state.world.enable_high_transistor_get_output_net(id), drive ? 1 : -1, level, &part);
+		}
+	} else if(c < sim.first_module) {
+		auto id = dcon::enable_low_transistor_id{ dcon::enable_low_transistor_id::value_base_t(c - sim.first_enable_low) };
+		bool drive = high(state.world.enable_low_transistor_get_input_net(id)) && !high(state.world.enable_low_transistor_get_control_net(id));
+		if(drive != (state.world.enable_low_transistor_get_driving(id) != 0)) {
+			state.world.enable_low_transistor_set_driving(id, drive);
+			simulation_note_component(sim, part, c);
+			simulation_apply_delta(state, state.world.enable_low_transistor_get_output_net(id), drive ? 1 : -1, level, &part);
+		}
+	} else {
+		auto id = dcon::module_instance_id{ dcon::module_instance_id::value_base_t(c - sim.first_module) };
+		auto& def = state.modules.definitions[state.world.module_instance_get_definition(id)];
+		auto slot = state.world.module_instance_get_state_slot(id);
+		evaluate_module_instance(def, slot, sim.net_value);
+		simulation_note_component(sim, part, c); // its local nets may have changed even if its ports have not
+
+		auto ports = def.ports.size();
+		auto base = size_t(slot) * ports;
+		uint8_t const* values = def.instance_values.data() + size_t(slot) * def.local_net_count;
+		for(size_t p = 0; p < ports; ++p) {
+			if(!def.ports[p].is_output)
+				continue;
+			bool drive = values[def.port_nets[p]] != 0;
+			if(drive != (def.instance_driving[base + p] != 0)) {
+				def.instance_driving[base + p] = drive ? 1 : 0;
+				simulation_apply_delta(state, def.instance_port_nets[base + p], drive ? 1 : -1, level, &part);
+			}
+		}
+	}
+}
+
+dcon::net_id simulation_net_at(sys::state& state, grid_point p) {
+	auto e = state.netlist.points.first_at(p);
+	if(e == connection_index::no_entry)
+		return dcon::net_id{};
+	return pin_net(state, state.netlist.points.get(e).pin);
+}
+
+// orders components by the longest chain of drivers in front of them (kahn's algorithm over the net graph);
+// components on feedback loops never run out of predecessors, so they keep the level their acyclic
+// predecessors gave them and the loop is resolved over successive waves instead. a table is ordered as a single
+// component: the nets internal to it are skipped, and its members share the level of its head
+void simulation_levelize(sys::state& state) {
+	auto& sim = state.simulation;
+	auto& nl = state.netlist;
+	auto& lt = sim.tables;
+	auto nets = nl.net_count();
+
+	sim.component_level.assign(sim.component_count, 0);
+	sim.indegree.assign(sim.component_count, 0);
+	sim.net_drivers.assign(nets, 0);
+	sim.ready.clear();
+
+	for(uint32_t i = 0; i < nets; ++i) {
+		for(auto pin : nl.pins_of(dcon::net_id{ dcon::net_id::value_base_t(i) })) {
+			if(pin_is_driver(state, pin))
+				++sim.net_drivers[i];
+		}
+	}
+	for(uint32_t i = 0; i < nets; ++i) {
+		for(auto pin : nl.pins_of(dcon::net_id{ dcon::net_id::value_base_t(i) })) {
+			if(pin_is_driver(state, pin))
+				continue;
+			auto r = simulation_flat_index(sim, pin);
+			if(lt.net_table[i] == logic_tables::none || lt.net_table[i] != lt.component_table[r])
+				sim.indegree[lt.node(r)] += sim.net_drivers[i];
+		}
+	}
+	for(uint32_t c = 0; c < sim.component_count; ++c) {
+		if(sim.indegree[c] == 0 && lt.node(c) == c)
+			sim.ready.push_back(c);
+	}
+	for(size_t i = 0; i < sim.ready.size(); ++i) {
+		auto c = sim.ready[i];
+		auto release_readers = [&](dcon::net_id out, bool) {
+			for(auto pin : nl.pins_of(out)) {
+				if(pin_is_driver(state, pin))
+					continue;
+				auto r = lt.node(simulation_flat_index(sim, pin));
+				if(r == c)
+					continue;
+				sim.component_level[r] = std::max(sim.component_level[r], sim.component_level[c] + 1);
+				if(--sim.indegree[r] == 0)
+					sim.ready.push_back(r);
+			}
+		};
+		if(auto t = lt.component_table[c]; t != logic_tables::none) {
+			auto& table = lt.tables[t];
+			for(uint32_t m = 0; m < table.member_count; ++m)
+				simulation_for_each_output(state, lt.members[table.first_member + m], release_readers);
+		} else {
+			simulation_for_each_output(state, c, release_readers);
+		}
+	}
+
+	uint32_t max_level = 0;
+	for(uint32_t c = 0; c < sim.component_count; ++c) {
+		sim.component_level[c] = sim.component_level[lt.node(c)];
+		max_level = std::max(max_level, sim.component_level[c]);
+	}
+	sim.level_count = max_level + 1;
+}
+
+// groups the components into weakly connected regions, then packs whole regions into partitions
+void simulation_partition_regions(sys::state& state) {
+	auto& sim = state.simulation;
+	auto& nl = state.netlist;
+	constexpr uint32_t none = 0xFFFFFFFF;
+
+	uint32_t partition_count = 1;
+	if(!sim.parallel || sim.component_count < simulation::min_parallel_components) {
+		sim.component_partition.assign(sim.component_count, 0);
+	} else {
+		auto& parent = sim.region_parent;
+		parent.resize(sim.component_count);
+		for(uint32_t c = 0; c < sim.component_count; ++c)
+			parent[c] = c;
+		auto find = [&](uint32_t x) {
+			while(parent[x] != x) {
+				parent[x] = parent[parent[x]];
+				x = parent[x];
+			}
+			return x;
+		};
+		// the root of a region is always its lowest numbered component
+		for(uint32_t i = 0; i < nl.net_count(); ++i) {
+			uint32_t first = none;
+			for(auto pin : nl.pins_of(dcon::net_id{ dcon::net_id::value_base_t(i) })) {
+				auto c = find(simulation_flat_index(sim, pin));
+				if(first == none) {
+					first = c;
+				} else if(c != first) {
+					parent[std::max(c, first)] = std::min(c, first);
+					first = std::min(c, first);
+				}
+			}
+		}
+
+		// the levelization scratch space is free again at this point
+		auto& region_size = sim.indegree;
+		auto& root_partition = sim.ready;
+		region_size.assign(sim.component_count, 0);
+		root_partition.assign(sim.component_count, none);
+		for(uint32_t c = 0; c < sim.component_count; ++c)
+			++region_size[find(c)];
+
+		auto workers = std::max(1u, std::thread::hardware_concurrency());
+		auto target = std::max(simulation::min_partition_components, sim.component_count / (4 * workers));
+		uint32_t fill = 0;
+		partition_count = 0;
+		sim.component_partition.resize(sim.component_count);
+		for(uint32_t c = 0; c < sim.component_count; ++c) {
+			auto r = find(c);
+			if(r == c) {
+				if(partition_count == 0 || fill >= target) {
+					++partition_count;
+					fill = 0;
+				}
+				root_partition[r] = partition_count - 1;
+				fill += region_size[r];
+			}
+			sim.component_partition[c] = root_partition[r];
+		}
+		partition_count = std::max(partition_count, 1u);
+	}
+
+	sim.partitions.resize(partition_count);
+	for(auto& part : sim.partitions) {
+		part.component_count = 0;
+		part.level_buckets.clear();
+		part.deferred.clear();
+	}
+	for(uint32_t c = 0; c < sim.component_count; ++c) {
+		auto& part = sim.partitions[sim.component_partition[c]];
+		++part.component_count;
+		if(part.level_buckets.size() <= sim.component_level[c])
+			part.level_buckets.resize(sim.component_level[c] + 1);
+	}
+}
+
+// brings the simulation up to date after the board has been edited
+void simulation_resync(sys::state& state) {
+	auto& sim = state.simulation;
+	auto& nl = state.netlist;
+
+	update_net_table(state);
+	auto nets = nl.net_count();
+
+	bool had_pending_work = false;
+	for(auto& part : sim.partitions)
+		had_pending_work = had_pending_work || !part.deferred.empty();
+	sim.first_enable_high = state.world.diode_size();
+	sim.first_enable_low = sim.first_enable_high + state.world.enable_high_transistor_size();
+	sim.first_module = sim.first_enable_low + state.world.enable_low_transistor_size();
+	sim.component_count = sim.first_module + state.world.module_instance_size();
+
+	// recounting the drivers is linear in the number of components, but happens only once per batch of edits
+	sim.net_value.resize(nets, 0);
+	sim.high_drivers.assign(nets, 0);
+	for(uint32_t c = 0; c < sim.component_count; ++c) {
+		simulation_for_each_output(state, c, [&](dcon::net_id out, bool driving) {
+			if(driving)
+				++sim.high_drivers[out.index()];
+		});
+	}
+	for(auto& bi : sim.board_inputs) {
+		if(!bi.second)
+			continue;
+		auto n = simulation_net_at(state, unpack_point(bi.first));
+		if(n)
+			++sim.high_drivers[n.index()];
+	}
+
+	// the first levelization only decides the order in which clusters are grown into tables
+	sim.tables.reset(sim.component_count, nets);
+	simulation_levelize(state);
+	extract_logic_tables(state);
+	if(!sim.tables.tables.empty())
+		simulation_levelize(state);
+	simulation_partition_regions(state);
+	sim.queued.assign(sim.component_count, 0);
+	sim.structure_out_of_date = false;
+	sim.digest.stale = true;
+
+	if(had_pending_work || sim.netlist_generation != nl.rebuild_generation) {
+		// queued component indices may no longer be valid, so everything is re-evaluated
+		sim.netlist_generation = nl.rebuild_generation;
+		for(uint32_t c = 0; c < sim.component_count; ++c)
+			simulation_queue(sim, c, ~uint32_t(0));
+	}
+	for(uint32_t i = 0; i < nets; ++i) {
+		uint8_t v = sim.high_drivers[i] != 0 ? 1 : 0;
+		if(v != sim.net_value[i]) {
+			sim.net_value[i] = v;
+			simulation_schedule_readers(state, dcon::net_id{ dcon::net_id::value_base_t(i) }, ~uint32_t(0));
+		}
+	}
+	// new parts and parts whose net was merged or split must be looked at at least once
+	for(auto n : nl.changed_nets) {
+		if(uint32_t(n.index()) < nets)
+			simulation_schedule_readers(state, n, ~uint32_t(0));
+	}
+	nl.changed_nets.clear();
+}
+
+bool net_is_high(sys::state& state, dcon::net_id n) {
+	auto& sim = state.simulation;
+	return n && uint32_t(n.index()) < sim.net_value.size() && sim.net_value[n.index()] != 0;
+}
+
+void set_board_input(sys::state& state, grid_point p, bool high) {
+	auto& sim = state.simulation;
+	auto key = pack_point(p);
+	auto it = sim.board_inputs.find(key);
+	bool was_high = it != sim.board_inputs.end() && it->second;
+	if(was_high == high)
+		return;
+	if(high)
+		sim.board_inputs.insert_or_assign(key, true);
+	else
+		sim.board_inputs.erase(key);
+	autosave_inputs_changed(state);
+
+	sim.snapshot_out_of_date = true;
+	if(state.netlist.table_out_of_date || sim.structure_out_of_date) // will be counted when the simulation next resynchronizes
+		return;
+	auto n = simulation_net_at(state, p);
+	if(n && sim.tables.net_table[n.index()] != logic_tables::none) // the net is no longer driven only by its table
+		sim.structure_out_of_date = true;
+	else if(n)
+		simulation_apply_delta(state, n, high ? 1 : -1, ~uint32_t(0), nullptr);
+}
+
+void update_simulation_structure(sys::state& state) {
+	if(state.netlist.table_out_of_date || state.simulation.structure_out_of_date) {
+		simulation_resync(state);
+		state.simulation.snapshot_out_of_date = true;
+	}
+}
+
+// runs the waves of one partition; partitions share no nets, so they can run concurrently
+void simulation_run_partition(sys::state& state, simulation_partition& part) {
+	auto& sim = state.simulation;
+	part.evaluations = 0;
+	part.waves = 0;
+	part.unsettled_nets.clear();
+
+	while(!part.deferred.empty() && part.waves < sim.settle_budget) {
+		++part.waves;
+		part.final_wave = part.waves == sim.settle_budget;
+
+		uint32_t lowest = uint32_t(part.level_buckets.size());
+		for(auto c : part.deferred) {
+			auto l = sim.component_level[c];
+			part.level_buckets[l].push_back(c);
+			lowest = std::min(lowest, l);
+		}
+		part.deferred.clear();
+
+		for(uint32_t l = lowest; l < uint32_t(part.level_buckets.size()); ++l) {
+			// evaluation only ever schedules into higher levels or the next wave, so this bucket does not grow
+			auto& bucket = part.level_buckets[l];
+			for(auto c : bucket) {
+				sim.queued[c] = 0;
+				++part.evaluations;
+				simulation_evaluate(state, part, c, l);
+			}
+			bucket.clear();
+		}
+	}
+	// if the partition settled on its final wave, what changed during that wave was not an oscillation
+	if(part.deferred.empty())
+		part.unsettled_nets.clear();
+	part.final_wave = false;
+}
+
+void simulate_tick(sys::state& state) {
+	auto& sim = state.simulation;
+	update_simulation_structure(state);
+
+	if(sim.partitions.size() > 1) {
+		concurrency_tools::parallel_for(uint32_t(0), uint32_t(sim.partitions.size()), [&](uint32_t i) {
+			simulation_run_partition(state, sim.partitions[i]);
+		});
+	} else if(sim.partitions.size() == 1) {
+		simulation_run_partition(state, sim.partitions[0]);
+	}
+
+	sim.last_tick_evaluations = 0;
+	sim.last_tick_waves = 0;
+	bool was_oscillating = !sim.oscillating_nets.empty();
+	sim.oscillating_nets.clear();
+	for(auto& part : sim.partitions) {
+		sim.last_tick_evaluations += part.evaluations;
+		sim.last_tick_waves = std::max(sim.last_tick_waves, part.waves);
+		sim.oscillating_nets.insert(sim.oscillating_nets.end(), part.unsettled_nets.begin(), part.unsettled_nets.end());
+	}
+	if(!sim.oscillating_nets.empty()) {
+		std::sort(sim.oscillating_nets.begin(), sim.oscillating_nets.end(), [](dcon::net_id a, dcon::net_id b) { return a.index() < b.index(); });
+		sim.oscillating_nets.erase(std::unique(sim.oscillating_nets.begin(), sim.oscillating_nets.end()), sim.oscillating_nets.end());
+	}
+	if(sim.last_tick_evaluations != 0 || was_oscillating)
+		sim.snapshot_out_of_date = true;
+	if(sim.digest.enabled)
+		update_state_digest(state);
+}
+
+void publish_net_snapshot(sys::state& state, bool force) {
+	auto& sim = state.simulation;
+	if(!sim.snapshot_out_of_date)
+		return;
+	if(!force && sim.snapshots.reader_is_behind())
+		return;
+
+	auto& snap = sim.snapshots.write_buffer();
+	auto nets = uint32_t(sim.net_value.size());
+	snap.net_count = nets;
+	snap.netlist_generation = state.netlist.rebuild_generation;
+	snap.tick = state.tick_end_counter.load(std::memory_order::relaxed);
+	snap.oscillating.assign(sim.oscillating_nets.begin(), sim.oscillating_nets.end());
+	snap.bits.resize((size_t(nets) + 63) / 64);
+	auto full_words = nets / 64;
+	for(uint32_t w = 0; w < full_words; ++w) {
+		uint64_t v = 0;
+		for(uint32_t b = 0; b < 64; ++b)
+			v |= uint64_t(sim.net_value[w * 64 + b] & 1) << b;
+		snap.bits[w] = v;
+	}
+	if(full_words * 64 != nets) {
+		uint64_t v = 0;
+		for(uint32_t b = 0; full_words * 64 + b < nets; ++b)
+			v |= uint64_t(sim.net_value[full_words * 64 + b] & 1) << b;
+		snap.bits[full_words] = v;
+	}
+
+	sim.snapshots.publish();
+	sim.snapshot_out_of_date = false;
+}
+
+net_snapshot const& read_net_snapshot(sys::state& state) {
+	return state.simulation.snapshots.read();
+}
+
+} // namespace circuit
@@ -0,0 +1,156 @@
+#pragma once
+#include <vector>
+#include <atomic>
+#include <stdint.h>
+#include "unordered_dense.h"
+#include "circuit.hpp"
+#include "logic_tables.hpp"
+#include "state_hash.hpp"
+
+// event driven simulation of the board
+//
+// nets are wired-or: a net is high while at least one driver drives it high. a diode drives its output
+// with its input, an enable high transistor with (input & control) and an enable low transistor with
+// (input & !control); module instances drive their output ports (see module.hpp). external drivers (test
+// stimuli, switches) are attached to grid points.
+//
+// components are levelized, i.e. ordered so that (ignoring feedback loops) each one comes after the components
+// driving its inputs. a tick evaluates only the components reading a net whose value changed, sweeping the
+// levels in order, so that its cost follows the activity on the board rather than its size. a change that
+// feeds back to an equal or lower level is deferred to another wave, and waves repeat until the board is quiet
+// (or the per-tick settle budget is used up, in which case the remaining work carries over to the next tick). a
+// loop that never converges, such as a ring oscillator, therefore costs at most the budget each tick, and the
+// nets that changed during the final wave are reported as oscillating; nothing else is scanned to find them
+//
+// the components are split into weakly connected regions (two components are in the same region if any
+// chain of shared nets joins them). every net belongs to exactly one region, so regions never exchange
+// values and are simulated in parallel, each one running its own waves; small regions are grouped into
+// partitions of comparable size so that each parallel task has a useful amount of work
+//
+// small acyclic clusters of diodes and transistors are replaced in the scheduler by truth tables (see
+// logic_tables.hpp); each cluster is levelized, queued and evaluated as one component, its head
+
+namespace circuit {
+
+struct simulation_partition {
+	std::vector<std::vector<uint32_t>> level_buckets;
+	std::vector<uint32_t> deferred;        // components waiting for the next wave
+	std::vector<dcon::net_id> unsettled_nets; // nets changed during the final wave of a tick that ran out of budget
+	// the blocks of the nets and components changed during the tick, while state hashing is enabled
+	std::vector<uint32_t> changed_net_blocks;
+	std::vector<uint32_t> changed_component_blocks;
+	uint32_t component_count = 0;
+	uint32_t evaluations = 0;
+	uint32_t waves = 0;
+	bool final_wave = false;
+};
+
+// the net values as of the end of some tick, packed one bit per net
+struct net_snapshot {
+	std::vector<uint64_t> bits;
+	uint32_t net_count = 0;
+	uint32_t netlist_generation = 0;
+	int64_t tick = 0;
+	std::vector<dcon::net_id> oscillating; // see simulation::oscillating_nets
+
+	bool is_high(dcon::net_id n) const {
+		return n && uint32_t(n.index()) < net_count && ((bits[n.index() / 64] >> (n.index() % 64)) & 1) != 0;
+	}
+};
+
+// triple buffer between the game thread (the only writer) and the ui thread (the only reader): the writer fills
+// its private buffer and swaps it with the shared middle one; the reader swaps the middle one for its own
+// private buffer whenever a newer snapshot has been published. neither side ever waits for the other, and the
+// reader always holds a complete snapshot
+class net_snapshot_exchange {
+	static constexpr uint8_t fresh_bit = 0x04;
+
+	net_snapshot buffers[3];
+	std::atomic<uint8_t> middle = 1;
+	uint8_t write_index = 0;
+	uint8_t read_index = 2;
+public:
+	// game thread
+	net_snapshot& write_buffer() {
+		return buffers[write_index];
+	}
+	void publish() {
+		write_index = uint8_t(middle.exchange(uint8_t(write_index | fresh_bit), std::memory_order::acq_rel) & 0x03);
+	}
+	bool reader_is_behind() const {
+		return (middle.load(std::memory_order::acquire) & fresh_bit) != 0;
+	}
+	// ui thread
+	net_snapshot const& read() {
+		if((middle.load(std::memory_order::relaxed) & fresh_bit) != 0)
+			read_index = uint8_t(middle.exchange(read_index, std::memory_order::acq_rel) & 0x03);
+		return buffers[read_index];
+	}
+};
+
+struct simulation {
+	std::vector<uint8_t> net_value;        // indexed by net
+	std::vector<uint32_t> high_drivers;    // indexed by net
+	ankerl::unordered_dense::map<uint32_t, bool> board_inputs; // packed grid point -> driven high
+
+	// components are numbered diodes first, then enable high and enable low transistors, then module instances
+	uint32_t first_enable_high = 0;
+	uint32_t first_enable_low = 0;
+	uint32_t first_module = 0;
+	uint32_t component_count = 0;
+
+	std::vector<uint32_t> component_level;
+	std::vector<uint32_t> component_partition;
+	std::vector<uint8_t> queued;
+	std::vector<simulation_partition> partitions;
+	uint32_t level_count = 0;
+	bool parallel = true;
+
+	uint32_t netlist_generation = 0;
+
+	// scratch space for levelization
+	std::vector<uint32_t> indegree;
+	std::vector<uint32_t> net_drivers;
+	std::vector<uint32_t> ready;
+	std::vector<uint32_t> region_parent;
+
+	logic_tables tables;
+	// set when something other than a board edit invalidates the levelization or the tables
+	bool structure_out_of_date = false;
+
+	net_snapshot_exchange snapshots;
+	bool snapshot_out_of_date = true;
+
+	state_digest digest;
+
+	// statistics for the last tick
+	uint32_t last_tick_evaluations = 0;
+	uint32_t last_tick_waves = 0;
+	// nets that were still changing when their partition used up its settle budget in the last tick, sorted;
+	// these are the nets of (or directly behind) a loop that does not converge
+	std::vector<dcon::net_id> oscillating_nets;
+
+	// the most waves a partition may run in one tick; unfinished work carries over to the next tick
+	uint32_t settle_budget = 64;
+	// boards with fewer components than this are simulated as a single partition
+	static constexpr uint32_t min_parallel_components = 4096;
+	static constexpr uint32_t min_partition_components = 1024;
+};
+
+bool net_is_high(sys::state& state, dcon::net_id n);
+// the component number (in the ordering described above) of the part a pin belongs to
+uint32_t simulation_flat_index(simulation const& sim, board_item item);
+dcon::net_id simulation_net_at(sys::state& state, grid_point p);
+// drives (or stops driving) whatever is connected at p high; takes effect on the next tick
+void set_board_input(sys::state& state, grid_point p, bool high);
+// recompiles the levelization and driver counts if the board has been edited since the last call
+void update_simulation_structure(sys::state& state);
+// called once per game tick, from the game thread
+void simulate_tick(sys::state& state);
+// publishes the current net values for the ui; unless forced, skips the copy while the ui has not yet picked up
+// the previous snapshot (the game loop forces a final publish before it goes to sleep)
+void publish_net_snapshot(sys::state& state, bool force);
+// ui thread only: the most recently published net values
+net_snapshot const& read_net_snapshot(sys::state& state);
+
+} // namespace circuit
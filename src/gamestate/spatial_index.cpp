@@ -0,0 +1,392 @@
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include "spatial_index.hpp"
+#include "module.hpp"
+#include "system_state.hpp"
+
+namespace circuit {
+
+constexpr int32_t chunk_size = spatial_index::chunk_size;
+
+spatial_index::chunk& spatial_index::get_or_create(int32_t chunk_x, int32_t chunk_y) {
+	auto key = pack_chunk(chunk_x, chunk_y);
+	auto it = chunk_lookup.find(key);
+	if(it != chunk_lookup.end())
+		return chunks[it->second];
+	uint32_t c = 0;
+	if(!free_chunks.empty()) { // a released chunk keeps the capacity of its item list
+		c = free_chunks.back();
+		free_chunks.pop_back();
+		chunks[c].part_cells.fill(0);
+		chunks[c].wire_cells.fill(0);
+	} else {
+		c = uint32_t(chunks.size());
+		chunks.emplace_back();
+	}
+	chunk_lookup.insert_or_assign(key, c);
+	return chunks[c];
+}
+
+spatial_index::chunk* spatial_index::find(int32_t chunk_x, int32_t chunk_y) {
+	auto it = chunk_lookup.find(pack_chunk(chunk_x, chunk_y));
+	return it != chunk_lookup.end() ? &chunks[it->second] : nullptr;
+}
+spatial_index::chunk const* spatial_index::find(int32_t chunk_x, int32_t chunk_y) const {
+	auto it = chunk_lookup.find(pack_chunk(chunk_x, chunk_y));
+	return it != chunk_lookup.end() ? &chunks[it->second] : nullptr;
+}
+
+void spatial_index::release(int32_t chunk_x, int32_t chunk_y) {
+	auto it = chunk_lookup.find(pack_chunk(chunk_x, chunk_y));
+	assert(it != chunk_lookup.end() && chunks[it->second].items.empty());
+	free_chunks.push_back(it->second);
+	chunk_lookup.erase(it);
+}
+
+void spatial_index::clear() {
+	chunk_lookup.clear();
+	chunks.clear();
+	free_chunks.clear();
+	for(auto& r : reported)
+		r.clear();
+	query_epoch = 0;
+}
+
+void spatial_index::begin_query() {
+	++query_epoch;
+	if(query_epoch == 0) {
+		for(auto& r : reported)
+			std::fill(r.begin(), r.end(), 0);
+		query_epoch = 1;
+	}
+}
+
+bool spatial_index::first_report(board_item part) {
+	auto& r = reported[uint32_t(part.kind())];
+	if(part.index() >= r.size())
+		r.resize(part.index() + 1, 0);
+	if(r[part.index()] == query_epoch)
+		return false;
+	r[part.index()] = query_epoch;
+	return true;
+}
+
+// what a part covers: either a rectangle of cells (inclusive) or the line between two grid points
+struct part_shape {
+	grid_point start;
+	grid_point end;
+	bool is_segment = false;
+};
+
+part_shape spatial_shape(sys::state& state, board_item part) {
+	auto p = item_position(state, part);
+	switch(part.kind()) {
+	case item_kind::diode:
+	case item_kind::enable_high_transistor:
+	case item_kind::enable_low_transistor:
+		return part_shape{ p, p, false };
+	case item_kind::wire_segment:
+		return part_shape{ p, pin_position(state, part.with_slot(pin_slot(1))), true };
+	case item_kind::module_instance:
+	{
+		auto& def = state.modules.definitions[state.world.module_instance_get_definition(dcon::module_instance_id{ dcon::module_instance_id::value_base_t(part.index()) })];
+		return part_shape{ p, grid_point{ int16_t(p.x + def.width - 1), int16_t(p.y + def.height - 1) }, false };
+	}
+	}
+	return part_shape{ p, p, false };
+}
+
+// calls f(column, first_cell_y, last_cell_y) for each aligned column of 2^width_bits cells that the segment crosses,
+// limited to the cells from min_x to max_x, with the range of rows whose cells it touches within that column
+template<typename F>
+void for_each_segment_column(grid_point a, grid_point b, int32_t width_bits, int32_t min_x, int32_t max_x, F&& f) {
+	if(a.x > b.x)
+		std::swap(a, b);
+	auto first_x = std::max(int32_t(a.x), min_x);
+	auto last_x = std::min(int32_t(b.x), max_x);
+	auto width = int32_t(1) << width_bits;
+	for(int32_t col = (first_x >> width_bits); first_x <= last_x && col <= (last_x >> width_bits); ++col) {
+		double lo_x = std::max(double(a.x), double(std::max(first_x, col * width)) - 0.5);
+		double hi_x = std::min(double(b.x), double(std::min(last_x, col * width + width - 1)) + 0.5);
+		double lo_y = std::min(a.y, b.y);
+		double hi_y = std::max(a.y, b.y);
+		if(a.x != b.x) {
+			auto y_at = [&](double x) { return double(a.y) + double(b.y - a.y) * (x - double(a.x)) / double(b.x - a.x); };
+			lo_y = std::min(y_at(lo_x), y_at(hi_x));
+			hi_y = std::max(y_at(lo_x), y_at(hi_x));
+		}
+		// a cell is touched if the segment meets its closed square; the slack can only add a cell
+		f(col, int32_t(std::ceil(lo_y - 0.5 - 1e-9)), int32_t(std::floor(hi_y + 0.5 + 1e-9)));
+	}
+}
+
+template<typename F>
+void for_each_chunk_on_segment(grid_point a, grid_point b, F&& f) {
+	for_each_segment_column(a, b, spatial_index::chunk_bits, INT32_MIN, INT32_MAX, [&](int32_t cx, int32_t first_y, int32_t last_y) {
+		for(int32_t cy = (first_y >> spatial_index::chunk_bits); cy <= (last_y >> spatial_index::chunk_bits); ++cy)
+			f(cx, cy);
+	});
+}
+
+template<typename F>
+void for_each_chunk_in_rect(grid_point top_left, grid_point bottom_right, F&& f) {
+	for(int32_t cx = (top_left.x >> spatial_index::chunk_bits); cx <= (bottom_right.x >> spatial_index::chunk_bits); ++cx) {
+		for(int32_t cy = (top_left.y >> spatial_index::chunk_bits); cy <= (bottom_right.y >> spatial_index::chunk_bits); ++cy)
+			f(cx, cy);
+	}
+}
+
+template<typename F>
+void for_each_chunk_of(part_shape const& s, F&& f) {
+	if(s.is_segment)
+		for_each_chunk_on_segment(s.start, s.end, f);
+	else
+		for_each_chunk_in_rect(s.start, s.end, f);
+}
+
+// liang-barsky clipping of the segment against a closed box
+bool segment_touches_box(grid_point a, grid_point b, double left, double top, double right, double bottom) {
+	double t0 = 0.0;
+	double t1 = 1.0;
+	auto clip = [&](double p, double q) {
+		if(p == 0.0)
+			return q >= 0.0;
+		auto r = q / p;
+		if(p < 0.0) {
+			if(r > t1)
+				return false;
+			t0 = std::max(t0, r);
+		} else {
+			if(r < t0)
+				return false;
+			t1 = std::min(t1, r);
+		}
+		return true;
+	};
+	double dx = double(b.x - a.x);
+	double dy = double(b.y - a.y);
+	return clip(-dx, double(a.x) - left) && clip(dx, right - double(a.x)) && clip(-dy, double(a.y) - top) && clip(dy, bottom - double(a.y));
+}
+bool segment_touches_cells(grid_point a, grid_point b, grid_point top_left, grid_point bottom_right) {
+	return segment_touches_box(a, b, top_left.x - 0.5, top_left.y - 0.5, bottom_right.x + 0.5, bottom_right.y + 0.5);
+}
+
+bool segments_intersect(grid_point a, grid_point b, grid_point c, grid_point d) {
+	auto cross = [](grid_point o, grid_point p, grid_point q) {
+		auto v = int64_t(p.x - o.x) * int64_t(q.y - o.y) - int64_t(p.y - o.y) * int64_t(q.x - o.x);
+		return v > 0 ? 1 : (v < 0 ? -1 : 0);
+	};
+	auto within = [](grid_point o, grid_point p, grid_point q) { // q on the line through o and p: is it between them?
+		return std::min(o.x, p.x) <= q.x && q.x <= std::max(o.x, p.x) && std::min(o.y, p.y) <= q.y && q.y <= std::max(o.y, p.y);
+	};
+	auto d1 = cross(c, d, a);
+	auto d2 = cross(c, d, b);
+	auto d3 = cross(a, b, c);
+	auto d4 = cross(a, b, d);
+	if(d1 * d2 < 0 && d3 * d4 < 0)
+		return true;
+	return (d1 == 0 && within(c, d, a)) || (d2 == 0 && within(c, d, b)) || (d3 == 0 && within(a, b, c)) || (d4 == 0 && within(a, b, d));
+}
+
+// sets the bits of the cells of chunk (cx, cy) that the shape covers in a bitmap of that chunk
+void mark_cells(std::array<uint64_t, chunk_size>& rows, int32_t cx, int32_t cy, part_shape const& s) {
+	auto left = cx * chunk_size;
+	auto top = cy * chunk_size;
+	auto mark_row = [&](int32_t y, int32_t from_x, int32_t to_x) {
+		from_x = std::max(from_x, left);
+		to_x = std::min(to_x, left + chunk_size - 1);
+		if(y < top || y >= top + chunk_size || from_x > to_x)
+			return;
+		auto span = uint32_t(to_x - from_x + 1);
+		auto bits = span == 64 ? ~uint64_t(0) : ((uint64_t(1) << span) - 1);
+		rows[y - top] |= bits << (from_x - left);
+	};
+	if(s.is_segment) {
+		for_each_segment_column(s.start, s.end, 0, left, left + chunk_size - 1, [&](int32_t x, int32_t first_y, int32_t last_y) {
+			for(int32_t y = std::max(first_y, top); y <= std::min(last_y, top + chunk_size - 1); ++y)
+				mark_row(y, x, x);
+		});
+	} else {
+		for(int32_t y = std::max(int32_t(s.start.y), top); y <= std::min(int32_t(s.end.y), top + chunk_size - 1); ++y)
+			mark_row(y, s.start.x, s.end.x);
+	}
+}
+void mark_chunk_cells(spatial_index::chunk& c, int32_t cx, int32_t cy, part_shape const& s) {
+	mark_cells(s.is_segment ? c.wire_cells : c.part_cells, cx, cy, s);
+}
+
+void add_to_spatial_index(sys::state& state, board_item part) {
+	part = part.part();
+	auto s = spatial_shape(state, part);
+	for_each_chunk_of(s, [&](int32_t cx, int32_t cy) {
+		auto& c = state.board_index.get_or_create(cx, cy);
+		c.items.push_back(part);
+		mark_chunk_cells(c, cx, cy, s);
+	});
+}
+
+void remove_from_spatial_index(sys::state& state, board_item part) {
+	part = part.part();
+	auto s = spatial_shape(state, part);
+	for_each_chunk_of(s, [&](int32_t cx, int32_t cy) {
+		auto c = state.board_index.find(cx, cy);
+		assert(c);
+		auto pos = std::find(c->items.begin(), c->items.end(), part);
+		assert(pos != c->items.end());
+		*pos = c->items.back();
+		c->items.pop_back();
+		if(c->items.empty()) {
+			state.board_index.release(cx, cy);
+			return;
+		}
+
+		// other parts may share the cells of the removed one, so after clearing them the parts of the same bitmap that
+		// reach into their bounds are marked again
+		std::array<uint64_t, chunk_size> cleared{ };
+		mark_cells(cleared, cx, cy, s);
+		auto& rows = s.is_segment ? c->wire_cells : c->part_cells;
+		int32_t first_row = chunk_size;
+		int32_t last_row = -1;
+		uint64_t columns = 0;
+		for(int32_t y = 0; y < chunk_size; ++y) {
+			if(cleared[y] == 0)
+				continue;
+			rows[y] &= ~cleared[y];
+			first_row = std::min(first_row, y);
+			last_row = y;
+			columns |= cleared[y];
+		}
+		if(columns == 0)
+			return;
+		auto top_left = grid_point{ int16_t(cx * chunk_size + std::countr_zero(columns)), int16_t(cy * chunk_size + first_row) };
+		auto bottom_right = grid_point{ int16_t(cx * chunk_size + std::bit_width(columns) - 1), int16_t(cy * chunk_size + last_row) };
+		for(auto other : c->items) {
+			if((other.kind() == item_kind::wire_segment) != s.is_segment)
+				continue;
+			auto o = spatial_shape(state, other);
+			bool overlaps = o.is_segment
+				? segment_touches_cells(o.start, o.end, top_left, bottom_right)
+				: o.start.x <= bottom_right.x && o.end.x >= top_left.x && o.start.y <= bottom_right.y && o.end.y >= top_left.y;
+			if(overlaps)
+				mark_cells(rows, cx, cy, o);
+		}
+	});
+}
+
+void move_in_spatial_index(sys::state& state, board_item from, board_item to) {
+	from = from.part();
+	to = to.part();
+	for_each_chunk_of(spatial_shape(state, from), [&](int32_t cx, int32_t cy) {
+		auto c = state.board_index.find(cx, cy);
+		assert(c);
+		auto pos = std::find(c->items.begin(), c->items.end(), from);
+		assert(pos != c->items.end());
+		*pos = to;
+	});
+}
+
+void rebuild_spatial_index(sys::state& state) {
+	state.board_index.clear();
+	for(uint32_t k = 0; k < item_kind_count; ++k) {
+		auto count = item_count(state, item_kind(k));
+		for(uint32_t i = 0; i < count; ++i)
+			add_to_spatial_index(state, board_item(item_kind(k), i));
+	}
+}
+
+void items_in_rect(sys::state& state, grid_point top_left, grid_point bottom_right, std::vector<board_item>& out) {
+	auto& index = state.board_index;
+	index.begin_query();
+	auto visit = [&](int32_t cx, int32_t cy) {
+		auto c = index.find(cx, cy);
+		if(!c)
+			return;
+		for(auto part : c->items) {
+			if(!index.first_report(part))
+				continue;
+			auto s = spatial_shape(state, part);
+			bool hit = s.is_segment
+				? segment_touches_cells(s.start, s.end, top_left, bottom_right)
+				: (s.start.x <= bottom_right.x && top_left.x <= s.end.x && s.start.y <= bottom_right.y && top_left.y <= s.end.y);
+			if(hit)
+				out.push_back(part);
+		}
+	};
+	// a rectangle covering more chunk positions than there are occupied chunks is answered from the occupied ones
+	auto columns = int64_t(bottom_right.x >> spatial_index::chunk_bits) - int64_t(top_left.x >> spatial_index::chunk_bits) + 1;
+	auto rows = int64_t(bottom_right.y >> spatial_index::chunk_bits) - int64_t(top_left.y >> spatial_index::chunk_bits) + 1;
+	if(columns * rows > int64_t(index.chunk_count())) {
+		index.for_each_chunk([&](int32_t cx, int32_t cy) {
+			if((top_left.x >> spatial_index::chunk_bits) <= cx && cx <= (bottom_right.x >> spatial_index::chunk_bits)
+				&& (top_left.y >> spatial_index::chunk_bits) <= cy && cy <= (bottom_right.y >> spatial_index::chunk_bits)) {
+				visit(cx, cy);
+			}
+		});
+	} else {
+		for_each_chunk_in_rect(top_left, bottom_right, visit);
+	}
+}
+
+void items_on_segment(sys::state& state, grid_point start, grid_point end, std::vector<board_item>& out) {
+	auto& index = state.board_index;
+	index.begin_query();
+	for_each_chunk_on_segment(start, end, [&](int32_t cx, int32_t cy) {
+		auto c = index.find(cx, cy);
+		if(!c)
+			return;
+		for(auto part : c->items) {
+			if(!index.first_report(part))
+				continue;
+			auto s = spatial_shape(state, part);
+			bool hit = s.is_segment ? segments_intersect(start, end, s.start, s.end) : segment_touches_cells(start, end, s.start, s.end);
+			if(hit)
+				out.push_back(part);
+		}
+	});
+}
+
+uint32_t anchor_chunk(sys::state& state, board_item part) {
+	auto p = item_position(state, part);
+	return pack_chunk(p.x >> spatial_index::chunk_bits, p.y >> spatial_index::chunk_bits);
+}
+
+void parts_in_chunk(sys::state& state, uint32_t chunk, std::vector<board_item>& out) {
+	auto x = int32_t(int16_t(chunk >> 16)) * spatial_index::chunk_size;
+	auto y = int32_t(int16_t(chunk & 0xFFFF)) * spatial_index::chunk_size;
+	out.clear();
+	items_in_rect(state, grid_point{ int16_t(x), int16_t(y) }, grid_point{ int16_t(x + spatial_index::chunk_size - 1), int16_t(y + spatial_index::chunk_size - 1) }, out);
+	out.erase(std::remove_if(out.begin(), out.end(), [&](board_item part) { return anchor_chunk(state, part) != chunk; }), out.end());
+	std::sort(out.begin(), out.end(), [](board_item a, board_item b) { return a.value < b.value; });
+}
+
+bool cell_has_part(sys::state& state, grid_point p) {
+	auto c = state.board_index.find(p.x >> spatial_index::chunk_bits, p.y >> spatial_index::chunk_bits);
+	return c && ((c->part_cells[p.y & (chunk_size - 1)] >> (p.x & (chunk_size - 1))) & 1) != 0;
+}
+bool cell_has_wire(sys::state& state, grid_point p) {
+	auto c = state.board_index.find(p.x >> spatial_index::chunk_bits, p.y >> spatial_index::chunk_bits);
+	return c && ((c->wire_cells[p.y & (chunk_size - 1)] >> (p.x & (chunk_size - 1))) & 1) != 0;
+}
+
+std::optional<board_item> item_at(sys::state& state, grid_point p) {
+	auto c = state.board_index.find(p.x >> spatial_index::chunk_bits, p.y >> spatial_index::chunk_bits);
+	if(!c)
+		return std::nullopt;
+	bool has_part = ((c->part_cells[p.y & (chunk_size - 1)] >> (p.x & (chunk_size - 1))) & 1) != 0;
+	bool has_wire = ((c->wire_cells[p.y & (chunk_size - 1)] >> (p.x & (chunk_size - 1))) & 1) != 0;
+	if(!has_part && !has_wire)
+		return std::nullopt;
+	for(auto part : c->items) {
+		auto s = spatial_shape(state, part);
+		if(has_part) {
+			if(!s.is_segment && s.start.x <= p.x && p.x <= s.end.x && s.start.y <= p.y && p.y <= s.end.y)
+				return part;
+		} else if(s.is_segment && segment_touches_cells(s.start, s.end, p, p)) {
+			return part;
+		}
+	}
+	return std::nullopt;
+}
+
+} // namespace circuit
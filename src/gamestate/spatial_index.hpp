@@ -0,0 +1,90 @@
+#pragma once
+#include <vector>
+#include <array>
+#include <optional>
+#include <stdint.h>
+#include "unordered_dense.h"
+#include "circuit.hpp"
+
+// a sparse grid over the board for hit-testing: the board is divided into square chunks, and every chunk that
+// contains anything lists the parts overlapping it. a component covers the cell it is placed on, a module instance
+// the rectangle captured by its definition, and a wire segment every cell that the line between its endpoints
+// passes through (a cell being the unit square centered on its grid point)
+//
+// chunks are allocated when the first part reaches into them and released when the last one leaves, so an index of
+// a sparse board costs memory in proportion to what has been built, not to the area it spans. besides its list of
+// parts, each chunk keeps occupancy bitmaps of its cells, which answer whether a cell is covered without looking
+// at any part
+//
+// queries visit only the chunks they overlap and test the parts listed there exactly, so their cost follows the
+// number of parts near the query rather than the size of the board. the index is only modified by the board
+// editing functions, which run while the game thread holds the ui lock. the queries also write to scratch shared by
+// all callers, so every query, on either thread, must be made holding the ui lock too
+
+namespace circuit {
+
+class spatial_index {
+public:
+	static constexpr int32_t chunk_bits = 6;
+	static constexpr int32_t chunk_size = int32_t(1) << chunk_bits; // cells per side; a bitmap row is one word
+	static_assert(chunk_size == 64);
+
+	struct chunk {
+		std::vector<board_item> items;
+		// one word per row, one bit per cell: the cells covered by components and module instances, and by wires
+		std::array<uint64_t, chunk_size> part_cells{ };
+		std::array<uint64_t, chunk_size> wire_cells{ };
+	};
+private:
+	ankerl::unordered_dense::map<uint32_t, uint32_t> chunk_lookup; // packed chunk coordinate -> chunk
+	std::vector<chunk> chunks;
+	std::vector<uint32_t> free_chunks;
+
+	// per kind, per index: the query that last reported the part, so that a part spanning several chunks is reported once
+	std::vector<uint32_t> reported[item_kind_count];
+	uint32_t query_epoch = 0;
+public:
+	chunk& get_or_create(int32_t chunk_x, int32_t chunk_y);
+	chunk* find(int32_t chunk_x, int32_t chunk_y);
+	chunk const* find(int32_t chunk_x, int32_t chunk_y) const;
+	void release(int32_t chunk_x, int32_t chunk_y); // the chunk must be empty
+	void clear();
+
+	void begin_query();
+	bool first_report(board_item part);
+
+	uint32_t chunk_count() const {
+		return uint32_t(chunk_lookup.size());
+	}
+	template<typename F>
+	void for_each_chunk(F&& f) const {
+		for(auto& c : chunk_lookup)
+			f(int32_t(int16_t(c.first >> 16)), int32_t(int16_t(c.first & 0xFFFF)));
+	}
+};
+
+inline uint32_t pack_chunk(int32_t chunk_x, int32_t chunk_y) {
+	return (uint32_t(uint16_t(chunk_x)) << 16) | uint32_t(uint16_t(chunk_y));
+}
+
+// called by the board editing functions in circuit.cpp
+void add_to_spatial_index(sys::state& state, board_item part);
+void remove_from_spatial_index(sys::state& state, board_item part);
+void move_in_spatial_index(sys::state& state, board_item from, board_item to); // a part's storage index changed
+void rebuild_spatial_index(sys::state& state);
+
+// the queries append the parts they find to out, each part once, in no particular order
+void items_in_rect(sys::state& state, grid_point top_left, grid_point bottom_right, std::vector<board_item>& out);
+void items_on_segment(sys::state& state, grid_point start, grid_point end, std::vector<board_item>& out);
+// the chunk a part belongs to when the board is handled a chunk at a time, as by the autosave and the board renderer:
+// that of its position (the start of a wire, the top left corner of a module instance), packed as by pack_chunk
+uint32_t anchor_chunk(sys::state& state, board_item part);
+// replaces the contents of out with the parts belonging to the chunk, sorted by their packed value
+void parts_in_chunk(sys::state& state, uint32_t chunk, std::vector<board_item>& out);
+// whether any component or module instance, or any wire, covers the cell; constant time
+bool cell_has_part(sys::state& state, grid_point p);
+bool cell_has_wire(sys::state& state, grid_point p);
+// the part under a cell for clicking on: components and module instances take precedence over wires
+std::optional<board_item> item_at(sys::state& state, grid_point p);
+
+} // namespace circuit
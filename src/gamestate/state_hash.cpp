@@ -0,0 +1,163 @@
+#include <algorithm>
+#include "blake2.h"
+#include "state_hash.hpp"
+#include "simulation.hpp"
+#include "module.hpp"
+#include "parallel_tools.hpp"
+#include "system_state.hpp"
+
+namespace circuit {
+
+constexpr uint32_t digest_block_size = uint32_t(1) << state_digest::block_bits;
+
+uint32_t digest_block_count(uint32_t n) {
+	return (n + digest_block_size - 1) >> state_digest::block_bits;
+}
+
+state_hash hash_net_block(simulation const& sim, uint32_t b) {
+	auto first = size_t(b) << state_digest::block_bits;
+	auto count = std::min(size_t(digest_block_size), sim.net_value.size() - first);
+	state_hash h;
+	blake2b(h.data(), h.size(), sim.net_value.data() + first, count, nullptr, 0);
+	return h;
+}
+
+// the driving flag of each component, in order; a module instance contributes the driving flag of each of its ports
+// followed by the values of its local nets
+state_hash hash_component_block(sys::state& state, uint32_t b, std::vector<uint8_t>& scratch) {
+	auto& sim = state.simulation;
+	auto first = b << state_digest::block_bits;
+	auto last = std::min(first + digest_block_size, sim.component_count);
+	scratch.clear();
+	for(auto c = first; c < last; ++c) {
+		if(c < sim.first_enable_high) {
+			scratch.push_back(state.world.diode_get_driving(dcon::diode_id{ dcon::diode_id::value_base_t(c) }));
+		} else if(c < sim.first_enable_low) {
+			scratch.push_back(state.world.enable_high_transistor_get_driving(dcon::enable_high_transistor_id{ dcon::enable_high_transistor_id::value_base_t(c - sim.first_enable_high) }));
+		} else if(c < sim.first_module) {
+			scratch.push_back(state.world.enable_low_transistor_get_driving(dcon::enable_low_transistor_id{ dcon::enable_low_transistor_id::value_base_t(c - sim.first_enable_low) }));
+		} else {
+			auto id = dcon::module_instance_id{ dcon::module_instance_id::value_base_t(c - sim.first_module) };
+			auto& def = state.modules.definitions[state.world.module_instance_get_definition(id)];
+			auto slot = size_t(state.world.module_instance_get_state_slot(id));
+			auto driving = def.instance_driving.data() + slot * def.ports.size();
+			auto values = def.instance_values.data() + slot * def.local_net_count;
+			scratch.insert(scratch.end(), driving, driving + def.ports.size());
+			scratch.insert(scratch.end(), values, values + def.local_net_count);
+		}
+	}
+	state_hash h;
+	blake2b(h.data(), h.size(), scratch.data(), scratch.size(), nullptr, 0);
+	return h;
+}
+
+state_hash hash_block_digests(simulation const& sim, std::vector<state_hash> const& net_blocks, std::vector<state_hash> const& component_blocks) {
+	blake2b_state s;
+	blake2b_init(&s, sizeof(state_hash));
+	uint32_t counts[2] = { uint32_t(sim.net_value.size()), sim.component_count };
+	blake2b_update(&s, counts, sizeof(counts));
+	blake2b_update(&s, net_blocks.data(), net_blocks.size() * sizeof(state_hash));
+	blake2b_update(&s, component_blocks.data(), component_blocks.size() * sizeof(state_hash));
+	state_hash h;
+	blake2b_final(&s, h.data(), h.size());
+	return h;
+}
+
+void enable_state_hashing(sys::state& state, bool enabled) {
+	auto& d = state.simulation.digest;
+	d.enabled = enabled;
+	d.stale = true;
+	d.changed_net_blocks.clear();
+	for(auto& part : state.simulation.partitions) {
+		part.changed_net_blocks.clear();
+		part.changed_component_blocks.clear();
+	}
+}
+
+void update_state_digest(sys::state& state) {
+	auto& sim = state.simulation;
+	auto& d = sim.digest;
+	auto net_blocks = digest_block_count(uint32_t(sim.net_value.size()));
+	auto component_blocks = digest_block_count(sim.component_count);
+
+	// the blocks to rehash: net blocks first, then component blocks offset by the number of net blocks
+	std::vector<uint32_t> dirty;
+	if(d.stale || d.net_blocks.size() != net_blocks || d.component_blocks.size() != component_blocks) {
+		d.net_blocks.resize(net_blocks);
+		d.component_blocks.resize(component_blocks);
+		dirty.resize(net_blocks + component_blocks);
+		for(uint32_t i = 0; i < dirty.size(); ++i)
+			dirty[i] = i;
+		d.stale = false;
+	} else {
+		d.net_block_dirty.assign(net_blocks, 0);
+		d.component_block_dirty.assign(component_blocks, 0);
+		auto mark = [&](std::vector<uint32_t> const& blocks, std::vector<uint8_t>& marks, uint32_t offset) {
+			for(auto b : blocks) {
+				if(b < marks.size() && !marks[b]) {
+					marks[b] = 1;
+					dirty.push_back(b + offset);
+				}
+			}
+		};
+		mark(d.changed_net_blocks, d.net_block_dirty, 0);
+		for(auto& part : sim.partitions) {
+			mark(part.changed_net_blocks, d.net_block_dirty, 0);
+			mark(part.changed_component_blocks, d.component_block_dirty, net_blocks);
+		}
+	}
+	d.changed_net_blocks.clear();
+	for(auto& part : sim.partitions) {
+		part.changed_net_blocks.clear();
+		part.changed_component_blocks.clear();
+	}
+
+	auto rehash = [&](uint32_t i, std::vector<uint8_t>& scratch) {
+		if(dirty[i] < net_blocks)
+			d.net_blocks[dirty[i]] = hash_net_block(sim, dirty[i]);
+		else
+			d.component_blocks[dirty[i] - net_blocks] = hash_component_block(state, dirty[i] - net_blocks, scratch);
+	};
+	if(dirty.size() > 4) {
+		concurrency_tools::parallel_for(uint32_t(0), uint32_t(dirty.size()), [&](uint32_t i) {
+			std::vector<uint8_t> scratch;
+			rehash(i, scratch);
+		});
+	} else {
+		std::vector<uint8_t> scratch;
+		for(uint32_t i = 0; i < dirty.size(); ++i)
+			rehash(i, scratch);
+	}
+	d.current = hash_block_digests(sim, d.net_blocks, d.component_blocks);
+}
+
+state_hash const& current_state_hash(sys::state& state) {
+	assert(state.simulation.digest.enabled);
+	return state.simulation.digest.current;
+}
+
+state_hash full_state_hash(sys::state& state) {
+	auto& sim = state.simulation;
+	std::vector<state_hash> net_blocks(digest_block_count(uint32_t(sim.net_value.size())));
+	std::vector<state_hash> component_blocks(digest_block_count(sim.component_count));
+	std::vector<uint8_t> scratch;
+	for(uint32_t b = 0; b < net_blocks.size(); ++b)
+		net_blocks[b] = hash_net_block(sim, b);
+	for(uint32_t b = 0; b < component_blocks.size(); ++b)
+		component_blocks[b] = hash_component_block(state, b, scratch);
+	return hash_block_digests(sim, net_blocks, component_blocks);
+}
+
+int64_t run_lockstep(sys::state& reference, sys::state& candidate, uint32_t ticks) {
+	enable_state_hashing(reference, true);
+	enable_state_hashing(candidate, true);
+	for(uint32_t t = 0; t < ticks; ++t) {
+		simulate_tick(reference);
+		simulate_tick(candidate);
+		if(current_state_hash(reference) != current_state_hash(candidate))
+			return int64_t(t);
+	}
+	return -1;
+}
+
+} // namespace circuit
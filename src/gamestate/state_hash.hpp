@@ -0,0 +1,54 @@
+#pragma once
+#include <vector>
+#include <array>
+#include <stdint.h>
+#include "circuit.hpp"
+
+// digests of the simulation state
+//
+// to check that two ways of simulating a board agree, such as the serial and the parallel scheduler, or evaluation
+// with and without logic tables, every tick can be summarized by a BLAKE2b digest of what the simulation leaves
+// behind: the value of every net, whether each component is driving its output, and the local nets and port drivers
+// of every module instance. the scheduler's own bookkeeping is left out. two runs that start from the same board and
+// receive the same inputs have equal digests after a tick exactly when they have reached the same state (barring a
+// collision), so comparing digests tick by tick finds the first tick at which an optimized kernel departs from a
+// reference one
+//
+// the nets, and separately the components, are divided into blocks of consecutive indices, each with a digest of its
+// own, and the digest of the state is that of the block digests in order. while hashing is enabled the simulation
+// notes the block of every net and component it changes, so a tick only rehashes the blocks it touched and costs in
+// proportion to the activity on the board. a resynchronization renumbers everything and is followed by a full rehash
+
+namespace circuit {
+
+using state_hash = std::array<uint8_t, 32>;
+
+struct state_digest {
+	static constexpr uint32_t block_bits = 12; // 4096 nets or components to a block
+
+	bool enabled = false;
+	bool stale = true; // every block must be rehashed
+	state_hash current{ }; // as of the end of the last tick
+
+	std::vector<state_hash> net_blocks;
+	std::vector<state_hash> component_blocks;
+	// changes made outside of a partition, such as by set_board_input; partitions keep their own lists
+	std::vector<uint32_t> changed_net_blocks;
+	std::vector<uint8_t> net_block_dirty;
+	std::vector<uint8_t> component_block_dirty;
+};
+
+// turning hashing on rehashes everything at the end of the next tick
+void enable_state_hashing(sys::state& state, bool enabled);
+// called at the end of simulate_tick while hashing is enabled
+void update_state_digest(sys::state& state);
+// the digest as of the end of the last tick; hashing must be enabled
+state_hash const& current_state_hash(sys::state& state);
+// hashes the whole state from scratch, leaving the incremental digest alone; for checking it
+state_hash full_state_hash(sys::state& state);
+
+// enables hashing on both states and advances them together, one simulate_tick each at a time; returns the number of
+// the first tick (counting from zero) after which their digests differ, or -1 if they agree after every tick
+int64_t run_lockstep(sys::state& reference, sys::state& candidate, uint32_t ticks);
+
+} // namespace circuit
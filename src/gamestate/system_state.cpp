@@ -304,6 +304,7 @@ void state::render() { // called to render the frame may (and should) delay retu
 
 		ui_state.drag_and_drop_image.render(*this, int32_t((x_size / user_settings.ui_scale) / 2) - win_x_size / 2 + 5 + 18, int32_t(y_size / user_settings.ui_scale) - win_y_size + 5);
 	}
+	ogl::flush_sprites(*this);
 
 	//if(ui_state.fps_counter) {
 	//	if(ui_state.fps_counter->is_visible()) {
@@ -314,6 +315,8 @@ void state::render() { // called to render the frame may (and should) delay retu
 }
 
 void state::on_create() {
+	ui_thread = std::this_thread::get_id();
+
 	// lua
 
 	ui_state.default_header_font = text::name_into_font_id(*this, "vic_22");
@@ -677,6 +680,7 @@ void state::save_user_settings() const {
 	US_SAVE(zoom_speed);
 	US_SAVE(mute_on_focus_lost);
 	US_SAVE(locale);
+	US_SAVE(autosaves);
 #undef US_SAVE
 
 	simple_fs::write_file(settings_location, NATIVE("user_settings.dat"), &buffer[0], uint32_t(ptr - buffer));
@@ -705,6 +709,7 @@ void state::load_user_settings() {
 			US_LOAD(zoom_speed);
 			US_LOAD(mute_on_focus_lost);
 			US_LOAD(locale);
+			US_LOAD(autosaves);
 #undef US_LOAD
 		} while(false);
 
@@ -724,6 +729,8 @@ void state::load_user_settings() {
 		if(!std::isfinite(user_settings.zoom_speed)) user_settings.zoom_speed = 15.0f;
 		user_settings.zoom_speed = std::clamp(user_settings.zoom_speed, 15.f, 25.f);
 
+		if(uint8_t(user_settings.autosaves) > uint8_t(autosave_frequency::often)) user_settings.autosaves = autosave_frequency::regularly;
+
 	}
 
 	user_settings.locale[15] = 0;
@@ -799,44 +806,96 @@ void state::single_game_tick() {
 
 	tick_start_counter.fetch_add(1, std::memory_order::seq_cst);
 
-	// do business
+	circuit::simulate_tick(*this);
 
 	tick_end_counter.fetch_add(1, std::memory_order::seq_cst);
+	circuit::publish_net_snapshot(*this, false);
 	game_state_updated.store(true, std::memory_order::release);
 }
 
 
+void state::wake_game_thread() {
+	{
+		std::lock_guard lock(game_thread_lock);
+		game_thread_wakeup = true;
+	}
+	game_thread_cv.notify_one();
+}
+
+void state::set_tick_rate(int32_t rate) {
+	if(rate != unlimited_tick_rate)
+		rate = std::clamp(rate, 0, max_tick_rate);
+	ticks_per_second.store(rate, std::memory_order::release);
+	wake_game_thread();
+}
+
 void state::game_loop() {
-	static int32_t game_speed[] = {
-		0,		// speed 0
-		2000,	// speed 1 -- 2 seconds
-		750,		// speed 2 -- 0.75 seconds
-		250, 	// speed 3 -- 0.25 seconds
-		125,		// speed 4 -- 0.125 seconds
+	using clock = std::chrono::steady_clock;
+	// while stopped the thread only wakes for commands and speed changes; this timeout just bounds the delay for
+	// pause sources that do not wake it (such as a scene's enforced pause)
+	constexpr auto idle_timeout = std::chrono::milliseconds(100);
+
+	auto next_tick = clock::now();
+	bool clock_running = false;
+
+	auto sleep_until = [&](clock::time_point t) {
+		std::unique_lock lock(game_thread_lock);
+		game_thread_cv.wait_until(lock, t, [&]() { return game_thread_wakeup; });
+		game_thread_wakeup = false;
 	};
 
-	while(quit_signaled.load(std::memory_order::acquire) == false) {
+	// the board the last session left, from the newest autosave slot holding a valid save; under the ui lock, as the
+	// window may already be drawing
+	if(user_settings.autosaves != autosave_frequency::none) {
+		yield_ui_lock = true;
 		{
-			command::execute_pending_commands(*this);
+			std::lock_guard lock(ui_lock);
+			circuit::load_autosave(*this);
+			yield_ui_lock = false;
 		}
+		ui_lock_cv.notify_one();
+	}
+
+	while(quit_signaled.load(std::memory_order::acquire) == false) {
+		command::execute_pending_commands(*this);
+		circuit::update_autosave(*this);
 
-		auto speed = actual_game_speed.load(std::memory_order::acquire);
+		auto rate = ticks_per_second.load(std::memory_order::acquire);
 		auto upause = ui_pause.load(std::memory_order::acquire);
-			
-		if(speed <= 0 || upause || internally_paused || current_scene.enforced_pause) {
-			std::this_thread::sleep_for(std::chrono::milliseconds(15));
+
+		if(rate == 0 || upause || internally_paused || current_scene.enforced_pause) {
+			clock_running = false;
+			circuit::publish_net_snapshot(*this, true);
+			sleep_until(clock::now() + idle_timeout);
+		} else if(rate == unlimited_tick_rate) {
+			clock_running = false;
+			for(uint32_t i = 0; i < max_unlimited_batch && !incoming_commands.front(); ++i)
+				single_game_tick();
+			circuit::publish_net_snapshot(*this, true);
+			last_update = clock::now();
 		} else {
-			auto entry_time = std::chrono::steady_clock::now();
-			auto ms_count = std::chrono::duration_cast<std::chrono::milliseconds>(entry_time - last_update).count();
-			if(speed >= 5 || ms_count >= game_speed[speed]) { /*enough time has passed*/
-				last_update = entry_time;
+			auto period = std::chrono::nanoseconds(1'000'000'000 / rate);
+			auto now = clock::now();
+			if(!clock_running) {
+				next_tick = now;
+				clock_running = true;
+			}
+			// run every tick that has come due since the last wakeup, up to the catch-up budget
+			uint32_t ran = 0;
+			while(next_tick <= now && ran < max_catch_up_ticks) {
 				single_game_tick();
-			} else {
-				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+				next_tick += period;
+				++ran;
 			}
+			if(next_tick <= now) // too far behind: drop the backlog rather than running ever longer bursts
+				next_tick = now + period;
+			if(ran != 0)
+				last_update = now;
+			circuit::publish_net_snapshot(*this, true);
+			sleep_until(next_tick);
 		}
-
 	}
+	circuit::finish_autosave(*this);
 }
 
 } // namespace sys
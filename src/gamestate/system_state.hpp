@@ -5,6 +5,7 @@
 #include <atomic>
 #include <chrono>
 #include <condition_variable>
+#include <thread>
 
 #include "window.hpp"
 #include "sound.hpp"
@@ -13,12 +14,19 @@
 #include "constants.hpp"
 #include "asvg.hpp"
 #include "uitemplate.hpp"
-#include "SPSCQueue.h"
+#include "mpsc_queue.hpp"
 #include "text.hpp"
 #include "game_scene.hpp"
 #include "graphics/opengl_wrapper.hpp"
+#include "graphics/board_renderer.hpp"
 #include "gui/ui_state.hpp"
 #include "commands.hpp"
+#include "netlist.hpp"
+#include "spatial_index.hpp"
+#include "simulation.hpp"
+#include "module.hpp"
+#include "journal.hpp"
+#include "autosave.hpp"
 
 
 // this header will eventually contain the highest-level objects
@@ -38,10 +46,17 @@ struct user_settings_s {
 	float zoom_speed = 20.f;
 	bool mute_on_focus_lost = true;
 	char locale[16] = "en-US";
+	autosave_frequency autosaves = autosave_frequency::regularly;
 };
 
 struct alignas(64) state {
 	dcon::data_container world; // Holds data regarding the game world. Also contains user locales.
+	circuit::netlist netlist; // connectivity of the board in world, maintained by the functions in circuit.hpp
+	circuit::spatial_index board_index; // the parts of the board in world by location, for hit-testing
+	circuit::simulation simulation; // logic levels of the nets, advanced once per tick
+	circuit::module_library modules; // definitions of the module instances placed in world
+	command::journal journal; // every command executed, with the change each made to the board, for undo and replay
+	circuit::autosave_log autosave_log; // what has changed on the board since it was last autosaved
 
 	// scenario data
 	std::vector<char> key_data;
@@ -70,6 +85,13 @@ struct alignas(64) state {
 	game_scene::scene_properties current_scene;
 	component_type active_component_tool = std::monostate{};
 	wire_colors current_wire_color = wire_colors::amber;
+	orientation current_orientation = orientation::right;
+	// the rectangle last drag selected on the board and the parts entirely inside it; the parts are refreshed
+	// whenever the game state updates
+	bool has_selection = false;
+	circuit::grid_point selection_top_left;
+	circuit::grid_point selection_bottom_right;
+	std::vector<circuit::board_item> selected_items;
 	int32_t x_offset = 0;
 	int32_t y_offset = 0;
 	int32_t zoom = 8;
@@ -85,9 +107,10 @@ struct alignas(64) state {
 
 	// synchronization data (between main update logic and ui thread)
 	std::atomic<bool> game_state_updated = false;                    // game state -> ui signal
-	std::atomic<int32_t> actual_game_speed = 0;                      // ui -> game state message
+	std::atomic<int32_t> ticks_per_second = 0;                       // ui -> game state message; 0 stops the clock (see set_tick_rate)
 	std::atomic<bool> quit_signaled = false;                         // ui -> game state signal
-	rigtorp::SPSCQueue<command::command_data> incoming_commands;          // ui or network -> local gamestate
+	concurrency_tools::mpsc_queue<command::command_data> incoming_commands; // ui, tools or network -> local gamestate
+	std::thread::id ui_thread; // see command::add_to_command_queue
 	std::atomic<bool> ui_pause = false;                              // force pause by an important message being open
 
 	std::atomic<int64_t> tick_start_counter;
@@ -98,6 +121,16 @@ struct alignas(64) state {
 	std::chrono::time_point<std::chrono::steady_clock> last_update = std::chrono::steady_clock::now();
 	bool internally_paused = false; // should NOT be set from the ui context (but may be read)
 
+	// the game thread sleeps on this between ticks and while stopped; wake_game_thread interrupts the sleep
+	std::mutex game_thread_lock;
+	std::condition_variable game_thread_cv;
+	bool game_thread_wakeup = false;
+
+	static constexpr int32_t unlimited_tick_rate = -1;
+	static constexpr int32_t max_tick_rate = 100'000;
+	static constexpr uint32_t max_catch_up_ticks = 16; // a late wakeup runs at most this many overdue ticks; the rest are dropped
+	static constexpr uint32_t max_unlimited_batch = 256; // ticks run between command checks at the unlimited rate
+
 	// common data for the window
 	int32_t x_size = 0;
 	int32_t y_size = 0;
@@ -110,6 +143,7 @@ struct alignas(64) state {
 
 	// graphics data
 	ogl::data open_gl;
+	ogl::board_renderer board_render; // the parts of the board in world as uploaded for drawing
 
 #ifdef DIRECTX_11
 	directx::data directx;
@@ -145,6 +179,9 @@ struct alignas(64) state {
 	void single_game_tick();
 	// this function runs the internal logic of the game. It will return *only* after a quit notification is sent to it
 	void game_loop();
+	// may be called from any thread; the rate is in ticks per second, 0 to stop or unlimited_tick_rate to run as fast as possible
+	void set_tick_rate(int32_t rate);
+	void wake_game_thread();
 
 
 	std::string_view to_string_view(dcon::text_key tag) const;
@@ -0,0 +1,305 @@
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include "board_renderer.hpp"
+#include "spatial_index.hpp"
+#include "module.hpp"
+#include "simple_fs.hpp"
+#include "system_state.hpp"
+
+namespace ogl {
+
+constexpr uint32_t initial_board_capacity = uint32_t(1) << 16;
+
+void board_part_changed(sys::state& state, circuit::board_item part) {
+	state.board_render.dirty_chunks.insert(circuit::anchor_chunk(state, part));
+}
+void board_replaced(sys::state& state) {
+	state.board_render.dirty_chunks.clear();
+	state.board_render.all_dirty = true;
+}
+
+void load_board_renderer(sys::state& state) {
+	auto& r = state.board_render;
+	auto root = simple_fs::get_root(state.common_fs);
+	auto board_fshader = simple_fs::open_file(root, NATIVE("assets/shaders/board_f_shader.glsl"));
+	auto board_vshader = simple_fs::open_file(root, NATIVE("assets/shaders/board_v_shader.glsl"));
+	if(bool(board_fshader) && bool(board_vshader)) {
+		auto vertex_content = simple_fs::view_contents(*board_vshader);
+		auto fragment_content = simple_fs::view_contents(*board_fshader);
+		r.program = create_program(std::string_view(vertex_content.data, vertex_content.file_size), std::string_view(fragment_content.data, fragment_content.file_size));
+		r.origin_uniform = glGetUniformLocation(r.program, "origin");
+		r.zoom_uniform = glGetUniformLocation(r.program, "zoom");
+		r.screen_size_uniform = glGetUniformLocation(r.program, "screen_size");
+	} else {
+		notify_user_of_fatal_opengl_error("Unable to open a board shader file");
+	}
+
+	glGenBuffers(1, &r.buffer);
+	glBindBuffer(GL_ARRAY_BUFFER, r.buffer);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(board_instance) * initial_board_capacity, nullptr, GL_DYNAMIC_DRAW);
+	r.capacity = initial_board_capacity;
+	glGenBuffers(1, &r.command_buffer);
+
+	glGenVertexArrays(1, &r.vao);
+	glBindVertexArray(r.vao);
+	// only instance attributes; the corners of each quad come from gl_VertexID
+	glBindVertexBuffer(0, r.buffer, 0, sizeof(board_instance));
+	glVertexBindingDivisor(0, 1);
+	glEnableVertexAttribArray(0);
+	glEnableVertexAttribArray(1);
+	glVertexAttribIFormat(0, 4, GL_SHORT, offsetof(board_instance, x0));
+	glVertexAttribIFormat(1, 2, GL_UNSIGNED_INT, offsetof(board_instance, kind));
+	glVertexAttribBinding(0, 0);
+	glVertexAttribBinding(1, 0);
+	glBindVertexArray(state.open_gl.global_square_vao);
+}
+
+board_instance make_board_instance(sys::state& state, circuit::board_item part) {
+	auto d = circuit::describe_item(state, part);
+	board_instance b{ d.position.x, d.position.y, d.position.x, d.position.y, uint32_t(d.kind), 0 };
+	switch(d.kind) {
+	case circuit::item_kind::diode:
+	case circuit::item_kind::enable_high_transistor:
+	case circuit::item_kind::enable_low_transistor:
+		b.style = uint32_t(d.orientation);
+		break;
+	case circuit::item_kind::wire_segment:
+		b.x1 = d.end.x;
+		b.y1 = d.end.y;
+		b.style = uint32_t(d.color);
+		break;
+	case circuit::item_kind::module_instance:
+	{
+		auto& def = state.modules.definitions[d.definition];
+		b.x1 = int16_t(d.position.x + def.width - 1);
+		b.y1 = int16_t(d.position.y + def.height - 1);
+	} break;
+	}
+	return b;
+}
+
+uint32_t block_class(uint32_t count) {
+	uint32_t c = 0;
+	while((uint32_t(1) << (c + board_renderer::min_block_bits)) < count)
+		++c;
+	return c;
+}
+uint32_t block_size(uint32_t c) {
+	return uint32_t(1) << (c + board_renderer::min_block_bits);
+}
+
+// makes room for at least the given number of instances, keeping the blocks already uploaded
+void reserve_board_instances(board_renderer& r, uint32_t count) {
+	if(count <= r.capacity)
+		return;
+	auto capacity = std::max(count, r.capacity * 2);
+	GLuint buffer = 0;
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+	glBufferData(GL_COPY_WRITE_BUFFER, sizeof(board_instance) * capacity, nullptr, GL_DYNAMIC_DRAW);
+	if(r.used != 0) {
+		glBindBuffer(GL_COPY_READ_BUFFER, r.buffer);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, sizeof(board_instance) * r.used);
+	}
+	glDeleteBuffers(1, &r.buffer);
+	r.buffer = buffer;
+	r.capacity = capacity;
+	glBindVertexArray(r.vao);
+	glBindVertexBuffer(0, r.buffer, 0, sizeof(board_instance));
+}
+
+uint32_t allocate_board_block(board_renderer& r, uint32_t c) {
+	if(!r.free_blocks[c].empty()) {
+		auto first = r.free_blocks[c].back();
+		r.free_blocks[c].pop_back();
+		return first;
+	}
+	reserve_board_instances(r, r.used + block_size(c));
+	auto first = r.used;
+	r.used += block_size(c);
+	return first;
+}
+
+// rebuilds the block of a chunk from the parts belonging to it, which must be in r.parts
+void update_board_block(sys::state& state, uint32_t chunk) {
+	auto& r = state.board_render;
+	auto existing = r.blocks.find(chunk);
+	if(r.parts.empty()) {
+		if(existing != r.blocks.end()) {
+			r.free_blocks[block_class(existing->second.capacity)].push_back(existing->second.first);
+			r.blocks.erase(existing);
+		}
+		return;
+	}
+
+	// the wires first, so that the components and module instances can be drawn over them
+	r.instances.clear();
+	for(auto part : r.parts) {
+		if(part.kind() == circuit::item_kind::wire_segment)
+			r.instances.push_back(make_board_instance(state, part));
+	}
+	auto wire_count = uint32_t(r.instances.size());
+	for(auto part : r.parts) {
+		if(part.kind() != circuit::item_kind::wire_segment)
+			r.instances.push_back(make_board_instance(state, part));
+	}
+
+	board_chunk_block b;
+	b.wire_count = wire_count;
+	b.part_count = uint32_t(r.instances.size()) - wire_count;
+	b.left = std::numeric_limits<int16_t>::max();
+	b.top = std::numeric_limits<int16_t>::max();
+	b.right = std::numeric_limits<int16_t>::min();
+	b.bottom = std::numeric_limits<int16_t>::min();
+	for(auto& i : r.instances) {
+		b.left = std::min({ b.left, i.x0, i.x1 });
+		b.top = std::min({ b.top, i.y0, i.y1 });
+		b.right = std::max({ b.right, i.x0, i.x1 });
+		b.bottom = std::max({ b.bottom, i.y0, i.y1 });
+	}
+
+	auto c = block_class(uint32_t(r.instances.size()));
+	if(existing != r.blocks.end() && block_class(existing->second.capacity) == c) {
+		b.first = existing->second.first;
+	} else {
+		if(existing != r.blocks.end())
+			r.free_blocks[block_class(existing->second.capacity)].push_back(existing->second.first);
+		b.first = allocate_board_block(r, c);
+	}
+	b.capacity = block_size(c);
+	r.blocks.insert_or_assign(chunk, b);
+
+	auto chunk_x = int32_t(int16_t(chunk >> 16));
+	auto chunk_y = int32_t(int16_t(chunk & 0xFFFF));
+	r.reach = std::max({ r.reach,
+		chunk_x - (int32_t(b.left) >> circuit::spatial_index::chunk_bits), (int32_t(b.right) >> circuit::spatial_index::chunk_bits) - chunk_x,
+		chunk_y - (int32_t(b.top) >> circuit::spatial_index::chunk_bits), (int32_t(b.bottom) >> circuit::spatial_index::chunk_bits) - chunk_y });
+
+	glBindBuffer(GL_ARRAY_BUFFER, r.buffer);
+	glBufferSubData(GL_ARRAY_BUFFER, sizeof(board_instance) * b.first, sizeof(board_instance) * r.instances.size(), r.instances.data());
+}
+
+void rebuild_board_blocks(sys::state& state) {
+	auto& r = state.board_render;
+	r.blocks.clear();
+	for(auto& f : r.free_blocks)
+		f.clear();
+	r.used = 0;
+	r.reach = 0;
+
+	// every part with its chunk, grouped by chunk
+	std::vector<std::pair<uint32_t, circuit::board_item>> anchored;
+	for(uint32_t k = 0; k < circuit::item_kind_count; ++k) {
+		auto count = circuit::item_count(state, circuit::item_kind(k));
+		for(uint32_t i = 0; i < count; ++i) {
+			auto part = circuit::board_item(circuit::item_kind(k), i);
+			anchored.emplace_back(circuit::anchor_chunk(state, part), part);
+		}
+	}
+	std::sort(anchored.begin(), anchored.end(), [](auto& a, auto& b) { return a.first < b.first || (a.first == b.first && a.second.value < b.second.value); });
+
+	uint32_t total = 0;
+	for(size_t i = 0; i < anchored.size(); ) {
+		auto j = i;
+		while(j < anchored.size() && anchored[j].first == anchored[i].first)
+			++j;
+		total += block_size(block_class(uint32_t(j - i)));
+		i = j;
+	}
+	reserve_board_instances(r, total);
+
+	for(size_t i = 0; i < anchored.size(); ) {
+		r.parts.clear();
+		auto j = i;
+		for(; j < anchored.size() && anchored[j].first == anchored[i].first; ++j)
+			r.parts.push_back(anchored[j].second);
+		update_board_block(state, anchored[i].first);
+		i = j;
+	}
+}
+
+void render_board(sys::state& state) {
+	auto& r = state.board_render;
+	if(r.all_dirty) {
+		rebuild_board_blocks(state);
+		r.all_dirty = false;
+	} else {
+		for(auto chunk : r.dirty_chunks) {
+			circuit::parts_in_chunk(state, chunk, r.parts);
+			update_board_block(state, chunk);
+		}
+	}
+	r.dirty_chunks.clear();
+
+	auto screen_width = float(state.x_size) / state.user_settings.ui_scale;
+	auto screen_height = float(state.y_size) / state.user_settings.ui_scale;
+	auto origin_x = float(state.x_offset - int32_t(screen_width) / 2);
+	auto origin_y = float(state.y_offset - int32_t(screen_height) / 2);
+	auto zoom = float(state.zoom);
+
+	// the cells in view; a part may reach a cell beyond the bounds of its chunk, to the pins of a component
+	auto left = int32_t(std::floor(origin_x / zoom)) - 1;
+	auto top = int32_t(std::floor(origin_y / zoom)) - 1;
+	auto right = int32_t(std::ceil((origin_x + screen_width) / zoom)) + 1;
+	auto bottom = int32_t(std::ceil((origin_y + screen_height) / zoom)) + 1;
+
+	// the visible chunks: those in view, and those a part reaches into view from, are looked up by their coordinates,
+	// unless there are more of them than there are blocks to test
+	r.visible.clear();
+	auto in_view = [&](board_chunk_block const& b) {
+		return !(b.right < left || b.left > right || b.bottom < top || b.top > bottom);
+	};
+	constexpr int32_t bits = circuit::spatial_index::chunk_bits;
+	auto chunk_left = std::max((left >> bits) - r.reach, int32_t(INT16_MIN) >> bits);
+	auto chunk_top = std::max((top >> bits) - r.reach, int32_t(INT16_MIN) >> bits);
+	auto chunk_right = std::min((right >> bits) + r.reach, int32_t(INT16_MAX) >> bits);
+	auto chunk_bottom = std::min((bottom >> bits) + r.reach, int32_t(INT16_MAX) >> bits);
+	if(int64_t(chunk_right - chunk_left + 1) * int64_t(chunk_bottom - chunk_top + 1) < int64_t(r.blocks.size())) {
+		for(int32_t cx = chunk_left; cx <= chunk_right; ++cx) {
+			for(int32_t cy = chunk_top; cy <= chunk_bottom; ++cy) {
+				auto it = r.blocks.find(circuit::pack_chunk(cx, cy));
+				if(it != r.blocks.end() && in_view(it->second))
+					r.visible.push_back(it->second);
+			}
+		}
+	} else {
+		for(auto& [chunk, b] : r.blocks) {
+			if(in_view(b))
+				r.visible.push_back(b);
+		}
+	}
+
+	// the commands for the wires of the visible chunks, then for their other parts
+	r.commands.clear();
+	uint32_t wire_commands = 0;
+	for(uint32_t pass = 0; pass < 2; ++pass) {
+		for(auto& b : r.visible) {
+			auto count = pass == 0 ? b.wire_count : b.part_count;
+			if(count != 0)
+				r.commands.push_back(draw_arrays_command{ 4, count, 0, pass == 0 ? b.first : b.first + b.wire_count });
+		}
+		if(pass == 0)
+			wire_commands = uint32_t(r.commands.size());
+	}
+	if(r.commands.empty())
+		return;
+
+	glUseProgram(r.program);
+	glUniform2f(r.origin_uniform, origin_x, origin_y);
+	glUniform1f(r.zoom_uniform, zoom);
+	glUniform2f(r.screen_size_uniform, screen_width, screen_height);
+	glBindVertexArray(r.vao);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, r.command_buffer);
+	glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(draw_arrays_command) * r.commands.size(), r.commands.data(), GL_STREAM_DRAW);
+	if(wire_commands != 0)
+		glMultiDrawArraysIndirect(GL_TRIANGLE_STRIP, nullptr, GLsizei(wire_commands), 0);
+	if(r.commands.size() != wire_commands)
+		glMultiDrawArraysIndirect(GL_TRIANGLE_STRIP, reinterpret_cast<void const*>(sizeof(draw_arrays_command) * wire_commands), GLsizei(r.commands.size() - wire_commands), 0);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	glBindVertexArray(state.open_gl.global_square_vao);
+	glUseProgram(state.open_gl.ui_shader_program);
+}
+
+} // namespace ogl
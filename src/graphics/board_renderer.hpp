@@ -0,0 +1,100 @@
+#pragma once
+#include <vector>
+#include <stdint.h>
+#include "unordered_dense.h"
+#include "opengl_wrapper.hpp"
+#include "circuit.hpp"
+
+// drawing the board
+//
+// every part on the board is drawn from one instance in a buffer that stays on the gpu. the instances are grouped by
+// the chunk of the spatial index a part belongs to (see anchor_chunk), and each chunk owns a block of the buffer,
+// holding its wires and then its components and module instances. the board editing functions mark the chunks of the
+// parts they place and remove, and before a frame is drawn only the blocks of the marked chunks are rebuilt and
+// uploaded, so an edit costs as much as the chunks it touches, whatever the size of the board
+//
+// each chunk also keeps the bounds of what it draws. a frame looks up the chunks in view (widened by the farthest any
+// chunk's parts reach beyond it), tests their bounds against the view and writes an indirect draw command for each
+// chunk that passes, and then draws all the wires with one multi-draw and all the other parts with a second, so that
+// panning and zooming costs two draw calls and work in proportion to the chunks in view. only when the view spans more
+// chunks than the board holds are all of them tested instead
+//
+// the marking happens on the game thread, in the command batches that hold the ui lock. the drawing happens on the ui
+// thread, also under the ui lock, and reads the board while it rebuilds the marked blocks; this is safe only because
+// every game thread query of the spatial index, including the autosave gather, holds the lock as well, as the queries
+// share their scratch
+
+namespace ogl {
+
+struct board_instance {
+	// in grid points: the start and end of a wire, the top left and bottom right cells of a module instance, and the
+	// position of a component twice
+	int16_t x0 = 0;
+	int16_t y0 = 0;
+	int16_t x1 = 0;
+	int16_t y1 = 0;
+	uint32_t kind = 0; // circuit::item_kind
+	uint32_t style = 0; // the orientation of a component, the color of a wire
+};
+static_assert(sizeof(board_instance) == 16);
+
+struct board_chunk_block {
+	uint32_t first = 0; // instance in the buffer
+	uint32_t capacity = 0; // a power of two, at least min_block
+	uint32_t wire_count = 0;
+	uint32_t part_count = 0; // drawn after the wires
+	// the cells drawn on
+	int16_t left = 0;
+	int16_t top = 0;
+	int16_t right = 0;
+	int16_t bottom = 0;
+};
+
+// the layout glMultiDrawArraysIndirect reads
+struct draw_arrays_command {
+	GLuint count = 4;
+	GLuint instance_count = 0;
+	GLuint first = 0;
+	GLuint base_instance = 0;
+};
+
+class board_renderer {
+public:
+	static constexpr uint32_t min_block_bits = 6;
+	static constexpr uint32_t block_classes = 19; // up to 2^24 instances in a chunk, the most board_item can number
+
+	ankerl::unordered_dense::set<uint32_t> dirty_chunks; // see circuit::pack_chunk
+	bool all_dirty = true;
+
+	ankerl::unordered_dense::map<uint32_t, board_chunk_block> blocks;
+	// the most chunks by which the bounds of a block have reached beyond its own chunk; never shrinks until the blocks
+	// are rebuilt
+	int32_t reach = 0;
+	std::vector<uint32_t> free_blocks[block_classes]; // the first instance of each, by size class
+	uint32_t capacity = 0; // of the buffer, in instances
+	uint32_t used = 0; // the instances below which the buffer has been divided into blocks
+
+	GLuint program = 0;
+	GLuint origin_uniform = 0;
+	GLuint zoom_uniform = 0;
+	GLuint screen_size_uniform = 0;
+	GLuint vao = 0;
+	GLuint buffer = 0;
+	GLuint command_buffer = 0;
+
+	// reused from frame to frame
+	std::vector<circuit::board_item> parts;
+	std::vector<board_instance> instances;
+	std::vector<board_chunk_block> visible;
+	std::vector<draw_arrays_command> commands;
+};
+
+// called by the board editing functions
+void board_part_changed(sys::state& state, circuit::board_item part);
+void board_replaced(sys::state& state);
+
+void load_board_renderer(sys::state& state);
+// uploads the chunks changed since the last frame and draws the board as the view stands
+void render_board(sys::state& state);
+
+} // namespace ogl
@@ -1,4 +1,7 @@
+#include <algorithm>
+#include <cstring>
 #include "opengl_wrapper.hpp"
+#include "board_renderer.hpp"
 #include "system_state.hpp"
 #include "simple_fs.hpp"
 #include "fonts.hpp"
@@ -426,6 +429,8 @@ void initialize_opengl(sys::state& state) {
 
 	load_shaders(state); // create shaders
 	load_global_squares(state); // create various squares to drive the shaders with
+	load_sprite_batch(state);
+	load_board_renderer(state);
 
 	load_special_icons(state);
 
@@ -527,6 +532,8 @@ void load_shaders(sys::state& state) {
 		state.open_gl.ui_shader_inner_color_uniform = glGetUniformLocation(state.open_gl.ui_shader_program, "inner_color");
 		state.open_gl.ui_shader_subrect_uniform = glGetUniformLocation(state.open_gl.ui_shader_program, "subrect");
 		state.open_gl.ui_shader_border_size_uniform = glGetUniformLocation(state.open_gl.ui_shader_program, "border_size");
+		state.open_gl.ui_shader_batched_uniform = glGetUniformLocation(state.open_gl.ui_shader_program, "batched");
+		state.open_gl.ui_shader_square_vertices_uniform = glGetUniformLocation(state.open_gl.ui_shader_program, "square_vertices");
 	} else {
 		notify_user_of_fatal_opengl_error("Unable to open a necessary shader file");
 	}
@@ -596,6 +603,132 @@ void load_global_squares(sys::state& state) {
 	glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * 16, global_rtl_square_flipped_data, GL_STATIC_DRAW);
 }
 
+// in the order of square_index
+static GLfloat const* const squares_by_index[] = {
+	global_square_data, global_square_flipped_data,
+	global_square_left_data, global_square_left_flipped_data,
+	global_square_right_data, global_square_right_flipped_data,
+	global_rtl_square_data, global_rtl_square_flipped_data,
+	global_rtl_square_left_data, global_rtl_square_left_flipped_data,
+	global_rtl_square_right_data, global_rtl_square_right_flipped_data
+};
+constexpr uint32_t square_count = uint32_t(sizeof(squares_by_index) / sizeof(squares_by_index[0]));
+
+uint32_t square_index(ui::rotation r, bool flipped, bool rtl) {
+	uint32_t rotation = r == ui::rotation::r90_left ? 1 : (r == ui::rotation::r90_right ? 2 : 0);
+	return (rtl ? 6 : 0) + rotation * 2 + (flipped ? 1 : 0);
+}
+
+void load_sprite_batch(sys::state& state) {
+	auto& b = state.open_gl.sprites;
+	glGenBuffers(1, &b.buffer);
+	glBindBuffer(GL_ARRAY_BUFFER, b.buffer);
+	auto flags = GLbitfield(GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT);
+	auto size = GLsizeiptr(sizeof(sprite_instance) * sprite_batch::segment_size * sprite_batch::segment_count);
+	glBufferStorage(GL_ARRAY_BUFFER, size, nullptr, flags);
+	b.mapped = static_cast<sprite_instance*>(glMapBufferRange(GL_ARRAY_BUFFER, 0, size, flags));
+
+	glGenVertexArrays(1, &b.vao);
+	glBindVertexArray(b.vao);
+	// the vertices of the squares are uniforms of the shader, so only the instance attributes come from a buffer
+	glBindVertexBuffer(1, b.buffer, 0, sizeof(sprite_instance));
+	glVertexBindingDivisor(1, 1);
+	for(GLuint i = 2; i <= 6; ++i) {
+		glEnableVertexAttribArray(i);
+		glVertexAttribBinding(i, 1);
+	}
+	glVertexAttribFormat(2, 4, GL_FLOAT, GL_FALSE, offsetof(sprite_instance, d_rect));
+	glVertexAttribFormat(3, 4, GL_FLOAT, GL_FALSE, offsetof(sprite_instance, subrect));
+	glVertexAttribFormat(4, 4, GL_FLOAT, GL_FALSE, offsetof(sprite_instance, inner_color)); // and border_size
+	glVertexAttribIFormat(5, 2, GL_UNSIGNED_INT, offsetof(sprite_instance, subroutines));
+	glVertexAttribIFormat(6, 1, GL_UNSIGNED_INT, offsetof(sprite_instance, square));
+	glBindVertexArray(state.open_gl.global_square_vao);
+
+	// the vertices of each square, as they are in its buffer, so that a batched sprite is split into the same two
+	// triangles as one drawn on its own
+	GLfloat vertices[square_count * 16];
+	for(uint32_t i = 0; i < square_count; ++i) {
+		for(uint32_t j = 0; j < 16; ++j)
+			vertices[i * 16 + j] = squares_by_index[i][j];
+	}
+	glProgramUniform4fv(state.open_gl.ui_shader_program, state.open_gl.ui_shader_square_vertices_uniform, GLsizei(square_count * 4), vertices);
+}
+
+void queue_sprite(sys::state const& state, sprite_instance const& sprite, GLuint texture, GLuint secondary_texture) {
+	auto& b = state.open_gl.sprites;
+	auto compatible = [](GLuint bound, GLuint wanted) { return wanted == 0 || bound == 0 || bound == wanted; };
+	if(b.runs.empty() || !compatible(b.runs.back().texture, texture) || !compatible(b.runs.back().secondary_texture, secondary_texture)) {
+		b.runs.push_back(sprite_run{ uint32_t(b.instances.size()), 0, texture, secondary_texture });
+	} else {
+		auto& run = b.runs.back();
+		if(texture)
+			run.texture = texture;
+		if(secondary_texture)
+			run.secondary_texture = secondary_texture;
+	}
+	++b.runs.back().count;
+	b.instances.push_back(sprite);
+}
+
+// room for count instances in the mapped buffer, which must be at most a segment; returns the first of them
+uint32_t reserve_sprite_space(sprite_batch& b, uint32_t count) {
+	if(b.head + count > (b.segment + 1) * sprite_batch::segment_size) {
+		// everything drawn from the segment being left has been issued
+		b.fences[b.segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		b.segment = (b.segment + 1) % sprite_batch::segment_count;
+		b.head = b.segment * sprite_batch::segment_size;
+		if(b.fences[b.segment]) {
+			while(glClientWaitSync(b.fences[b.segment], GL_SYNC_FLUSH_COMMANDS_BIT, GLuint64(1000000000)) == GL_TIMEOUT_EXPIRED) {
+			}
+			glDeleteSync(b.fences[b.segment]);
+			b.fences[b.segment] = nullptr;
+		}
+	}
+	auto first = b.head;
+	b.head += count;
+	return first;
+}
+
+void flush_sprites(sys::state const& state) {
+	auto& b = state.open_gl.sprites;
+	if(b.instances.empty())
+		return;
+
+	glBindVertexArray(b.vao);
+	glUniform1i(state.open_gl.ui_shader_batched_uniform, 1);
+	// the queue is copied a segment at a time, and each run drawn from the copies it is in
+	auto run = b.runs.begin();
+	uint32_t run_done = 0; // instances of *run already drawn
+	for(uint32_t start = 0; start < uint32_t(b.instances.size()); start += sprite_batch::segment_size) {
+		auto count = std::min(uint32_t(b.instances.size()) - start, sprite_batch::segment_size);
+		auto first = reserve_sprite_space(b, count);
+		std::memcpy(b.mapped + first, b.instances.data() + start, sizeof(sprite_instance) * count);
+		while(run != b.runs.end() && run->first + run_done < start + count) {
+			auto drawn = std::min(run->count - run_done, start + count - (run->first + run_done));
+			if(run->secondary_texture) {
+				glActiveTexture(GL_TEXTURE1);
+				glBindTexture(GL_TEXTURE_2D, run->secondary_texture);
+			}
+			if(run->texture) {
+				glActiveTexture(GL_TEXTURE0);
+				glBindTexture(GL_TEXTURE_2D, run->texture);
+			}
+			glDrawArraysInstancedBaseInstance(GL_TRIANGLE_FAN, 0, 4, GLsizei(drawn), GLuint(first + run->first + run_done - start));
+			run_done += drawn;
+			if(run_done == run->count) {
+				++run;
+				run_done = 0;
+			}
+		}
+	}
+	glUniform1i(state.open_gl.ui_shader_batched_uniform, 0);
+	glActiveTexture(GL_TEXTURE0);
+	glBindVertexArray(state.open_gl.global_square_vao);
+
+	b.instances.clear();
+	b.runs.clear();
+}
+
 void bind_vertices_by_rotation(sys::state const& state, ui::rotation r, bool flipped, bool rtl) {
 	switch(r) {
 	case ui::rotation::upright:
@@ -625,15 +758,11 @@ void render_colored_rect(
 	float red, float green, float blue,
 	ui::rotation r, bool flipped, bool rtl
 ) {
-	glBindVertexArray(state.open_gl.global_square_vao);
-	bind_vertices_by_rotation(state, r, flipped, rtl);
-	glUniform4f(state.open_gl.ui_shader_d_rect_uniform, x, y, width, height);
-	GLuint subroutines[2] = { map_color_modification_to_index(color_modification::none), parameters::solid_color };
-	glUniform2ui(state.open_gl.ui_shader_subroutines_index_uniform, subroutines[0], subroutines[1]);
-	glUniform3f(state.open_gl.ui_shader_inner_color_uniform, red, green, blue);
-	//glUniformSubroutinesuiv(GL_FRAGMENT_SHADER, 2, subroutines); // must set all subroutines in one call
-	glLineWidth(2.0f);
-	glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+	queue_sprite(state, sprite_instance{
+		.d_rect = { x, y, width, height },
+		.inner_color = { red, green, blue },
+		.subroutines = { map_color_modification_to_index(color_modification::none), parameters::solid_color },
+		.square = square_index(r, flipped, rtl) }, 0, 0);
 }
 
 void render_alpha_colored_rect(
@@ -641,16 +770,11 @@ void render_alpha_colored_rect(
 	float x, float y, float width, float height,
 	float red, float green, float blue, float alpha
 ) {
-	glBindVertexArray(state.open_gl.global_square_vao);
-	glBindVertexBuffer(0, state.open_gl.global_square_buffer, 0, sizeof(GLfloat) * 4);
-	glUniform4f(state.open_gl.ui_shader_d_rect_uniform, x, y, width, height);
-	GLuint subroutines[2] = { map_color_modification_to_index(color_modification::none), parameters::alpha_color };
-	glUniform2ui(state.open_gl.ui_shader_subroutines_index_uniform, subroutines[0], subroutines[1]);
-	glUniform3f(state.open_gl.ui_shader_inner_color_uniform, red, green, blue);
-	glUniform1f(state.open_gl.ui_shader_border_size_uniform, alpha);
-	//glUniformSubroutinesuiv(GL_FRAGMENT_SHADER, 2, subroutines); // must set all subroutines in one call
-	glLineWidth(2.0f);
-	glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+	queue_sprite(state, sprite_instance{
+		.d_rect = { x, y, width, height },
+		.inner_color = { red, green, blue },
+		.border_size = alpha,
+		.subroutines = { map_color_modification_to_index(color_modification::none), parameters::alpha_color } }, 0, 0);
 }
 
 void render_simple_rect(sys::state const& state, float x, float y, float width, float height, ui::rotation r, bool flipped, bool rtl) {
@@ -661,38 +785,16 @@ void render_simple_rect(sys::state const& state, float x, float y, float width,
 
 void render_textured_rect(sys::state const& state, color_modification enabled, float x, float y, float width, float height,
 		GLuint texture_handle, ui::rotation r, bool flipped, bool rtl) {
-	glBindVertexArray(state.open_gl.global_square_vao);
-
-	bind_vertices_by_rotation(state, r, flipped, rtl);
-
-	glUniform4f(state.open_gl.ui_shader_d_rect_uniform, x, y, width, height);
-	// glUniform4f(state.open_gl.ui_shader_d_rect_uniform, 0, 0, width, height);
-
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, texture_handle);
-
-	GLuint subroutines[2] = {map_color_modification_to_index(enabled), parameters::no_filter};
-	glUniform2ui(state.open_gl.ui_shader_subroutines_index_uniform, subroutines[0], subroutines[1]);
-	//glUniformSubroutinesuiv(GL_FRAGMENT_SHADER, 2, subroutines); // must set all subroutines in one call
-
-	glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+	queue_sprite(state, sprite_instance{
+		.d_rect = { x, y, width, height },
+		.subroutines = { map_color_modification_to_index(enabled), parameters::no_filter },
+		.square = square_index(r, flipped, rtl) }, texture_handle, 0);
 }
 
 void render_textured_rect_direct(sys::state const& state, float x, float y, float width, float height, uint32_t handle) {
-	glBindVertexArray(state.open_gl.global_square_vao);
-
-	glBindVertexBuffer(0, state.open_gl.global_square_buffer, 0, sizeof(GLfloat) * 4);
-
-	glUniform4f(state.open_gl.ui_shader_d_rect_uniform, x, y, width, height);
-
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, handle);
-
-	GLuint subroutines[2] = {parameters::enabled, parameters::no_filter};
-	glUniform2ui(state.open_gl.ui_shader_subroutines_index_uniform, subroutines[0], subroutines[1]);
-	//glUniformSubroutinesuiv(GL_FRAGMENT_SHADER, 2, subroutines); // must set all subroutines in one call
-
-	glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+	queue_sprite(state, sprite_instance{
+		.d_rect = { x, y, width, height },
+		.subroutines = { parameters::enabled, parameters::no_filter } }, handle, 0);
 }
 
 void render_ui_mesh(
@@ -703,6 +805,7 @@ void render_ui_mesh(
 	generic_ui_mesh_triangle_strip& mesh,
 	data_texture& t
 ) {
+	flush_sprites(state);
 	glBindVertexArray(state.open_gl.global_square_vao);
 
 	mesh.bind_buffer();
@@ -719,6 +822,7 @@ void render_ui_mesh(
 
 void render_linegraph(sys::state const& state, color_modification enabled, float x, float y, float width, float height,
 		lines& l) {
+	flush_sprites(state);
 	glBindVertexArray(state.open_gl.global_square_vao);
 
 	l.bind_buffer();
@@ -737,6 +841,7 @@ void render_linegraph(sys::state const& state, color_modification enabled, float
 
 void render_linegraph(sys::state const& state, color_modification enabled, float x, float y, float width, float height, float r, float g, float b,
 		lines& l) {
+	flush_sprites(state);
 	glBindVertexArray(state.open_gl.global_square_vao);
 
 	l.bind_buffer();
@@ -752,6 +857,7 @@ void render_linegraph(sys::state const& state, color_modification enabled, float
 }
 
 void render_linegraph(sys::state const& state, color_modification enabled, float x, float y, float width, float height, float r, float g, float b, float a, lines& l) {
+	flush_sprites(state);
 	glBindVertexArray(state.open_gl.global_square_vao);
 
 	l.bind_buffer();
@@ -768,8 +874,11 @@ void render_linegraph(sys::state const& state, color_modification enabled, float
 	glDrawArrays(GL_LINE_STRIP, 0, static_cast<GLsizei>(l.count));
 }
 
+// the charts are drawn at once rather than queued: their data textures are uploaded when their handles are taken, and
+// a chart may be updated again before a flush
 void render_barchart(sys::state const& state, color_modification enabled, float x, float y, float width, float height,
 		data_texture& t, ui::rotation r, bool flipped, bool rtl) {
+	flush_sprites(state);
 	glBindVertexArray(state.open_gl.global_square_vao);
 
 	bind_vertices_by_rotation(state, r, flipped, rtl);
@@ -787,6 +896,7 @@ void render_barchart(sys::state const& state, color_modification enabled, float
 }
 
 void render_piechart(sys::state const& state, color_modification enabled, float x, float y, float size, data_texture& t) {
+	flush_sprites(state);
 	glBindVertexArray(state.open_gl.global_square_vao);
 
 	glBindVertexBuffer(0, state.open_gl.global_square_buffer, 0, sizeof(GLfloat) * 4);
@@ -803,6 +913,7 @@ void render_piechart(sys::state const& state, color_modification enabled, float
 	glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
 }
 void render_stripchart(sys::state const& state, color_modification enabled, float x, float y, float sizex, float sizey, data_texture& t) {
+	flush_sprites(state);
 	glBindVertexArray(state.open_gl.global_square_vao);
 
 	glBindVertexBuffer(0, state.open_gl.global_square_buffer, 0, sizeof(GLfloat) * 4);
@@ -820,108 +931,56 @@ void render_stripchart(sys::state const& state, color_modification enabled, floa
 }
 void render_bordered_rect(sys::state const& state, color_modification enabled, float border_size, float x, float y, float width,
 		float height, GLuint texture_handle, ui::rotation r, bool flipped, bool rtl) {
-	glBindVertexArray(state.open_gl.global_square_vao);
-
-	bind_vertices_by_rotation(state, r, flipped, rtl);
-
-	glUniform4f(state.open_gl.ui_shader_d_rect_uniform, x, y, width, height);
-	glUniform1f(state.open_gl.ui_shader_border_size_uniform, border_size);
-
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, texture_handle);
-
-	GLuint subroutines[2] = {map_color_modification_to_index(enabled), parameters::frame_stretch};
-	glUniform2ui(state.open_gl.ui_shader_subroutines_index_uniform, subroutines[0], subroutines[1]);
-	//glUniformSubroutinesuiv(GL_FRAGMENT_SHADER, 2, subroutines); // must set all subroutines in one call
-
-	glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+	queue_sprite(state, sprite_instance{
+		.d_rect = { x, y, width, height },
+		.border_size = border_size,
+		.subroutines = { map_color_modification_to_index(enabled), parameters::frame_stretch },
+		.square = square_index(r, flipped, rtl) }, texture_handle, 0);
 }
 
 
 void render_rect_with_repeated_border(sys::state const& state, color_modification enabled, float grid_size, float x, float y, float width,
 		float height, GLuint texture_handle, ui::rotation r, bool flipped, bool rtl) {
-	glBindVertexArray(state.open_gl.global_square_vao);
-	bind_vertices_by_rotation(state, r, flipped, rtl);
-	glUniform4f(state.open_gl.ui_shader_d_rect_uniform, x, y, width, height);
-	glUniform1f(state.open_gl.ui_shader_border_size_uniform, grid_size);
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, texture_handle);
-	GLuint subroutines[2] = { map_color_modification_to_index(enabled), parameters::border_repeat };
-	glUniform2ui(state.open_gl.ui_shader_subroutines_index_uniform, subroutines[0], subroutines[1]);
-	glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+	queue_sprite(state, sprite_instance{
+		.d_rect = { x, y, width, height },
+		.border_size = grid_size,
+		.subroutines = { map_color_modification_to_index(enabled), parameters::border_repeat },
+		.square = square_index(r, flipped, rtl) }, texture_handle, 0);
 }
 
 void render_rect_with_repeated_corner(sys::state const& state, color_modification enabled, float grid_size, float x, float y, float width,
 		float height, GLuint texture_handle, ui::rotation r, bool flipped, bool rtl) {
-	glBindVertexArray(state.open_gl.global_square_vao);
-	bind_vertices_by_rotation(state, r, flipped, rtl);
-	glUniform4f(state.open_gl.ui_shader_d_rect_uniform, x, y, width, height);
-	glUniform1f(state.open_gl.ui_shader_border_size_uniform, grid_size);
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, texture_handle);
-	GLuint subroutines[2] = { map_color_modification_to_index(enabled), parameters::corner_repeat };
-	glUniform2ui(state.open_gl.ui_shader_subroutines_index_uniform, subroutines[0], subroutines[1]);
-	glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+	queue_sprite(state, sprite_instance{
+		.d_rect = { x, y, width, height },
+		.border_size = grid_size,
+		.subroutines = { map_color_modification_to_index(enabled), parameters::corner_repeat },
+		.square = square_index(r, flipped, rtl) }, texture_handle, 0);
 }
 
 void render_masked_rect(sys::state const& state, color_modification enabled, float x, float y, float width, float height,
 		GLuint texture_handle, GLuint mask_texture_handle, ui::rotation r, bool flipped, bool rtl) {
-	glBindVertexArray(state.open_gl.global_square_vao);
-
-	bind_vertices_by_rotation(state, r, flipped, rtl);
-
-	glUniform4f(state.open_gl.ui_shader_d_rect_uniform, x, y, width, height);
-
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, texture_handle);
-	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_2D, mask_texture_handle);
-
-	GLuint subroutines[2] = {map_color_modification_to_index(enabled), parameters::use_mask};
-	glUniform2ui(state.open_gl.ui_shader_subroutines_index_uniform, subroutines[0], subroutines[1]);
-	//glUniformSubroutinesuiv(GL_FRAGMENT_SHADER, 2, subroutines); // must set all subroutines in one call
-
-	glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+	queue_sprite(state, sprite_instance{
+		.d_rect = { x, y, width, height },
+		.subroutines = { map_color_modification_to_index(enabled), parameters::use_mask },
+		.square = square_index(r, flipped, rtl) }, texture_handle, mask_texture_handle);
 }
 
 void render_progress_bar(sys::state const& state, color_modification enabled, float progress, float x, float y, float width,
 		float height, GLuint left_texture_handle, GLuint right_texture_handle, ui::rotation r, bool flipped, bool rtl) {
-	glBindVertexArray(state.open_gl.global_square_vao);
-
-	bind_vertices_by_rotation(state, r, flipped, rtl);
-
-	glUniform4f(state.open_gl.ui_shader_d_rect_uniform, x, y, width, height);
-	glUniform1f(state.open_gl.ui_shader_border_size_uniform, progress);
-
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, left_texture_handle);
-	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_2D, right_texture_handle);
-
-	GLuint subroutines[2] = {map_color_modification_to_index(enabled), parameters::progress_bar};
-	glUniform2ui(state.open_gl.ui_shader_subroutines_index_uniform, subroutines[0], subroutines[1]);
-	//glUniformSubroutinesuiv(GL_FRAGMENT_SHADER, 2, subroutines); // must set all subroutines in one call
-
-	glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+	queue_sprite(state, sprite_instance{
+		.d_rect = { x, y, width, height },
+		.border_size = progress,
+		.subroutines = { map_color_modification_to_index(enabled), parameters::progress_bar },
+		.square = square_index(r, flipped, rtl) }, left_texture_handle, right_texture_handle);
 }
 
 void render_tinted_textured_rect(sys::state const& state, float x, float y, float width, float height, float r, float g, float b,
 		GLuint texture_handle, ui::rotation rot, bool flipped, bool rtl) {
-	glBindVertexArray(state.open_gl.global_square_vao);
-
-	bind_vertices_by_rotation(state, rot, flipped, rtl);
-
-	glUniform3f(state.open_gl.ui_shader_inner_color_uniform, r, g, b);
-	glUniform4f(state.open_gl.ui_shader_d_rect_uniform, x, y, width, height);
-
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, texture_handle);
-
-	GLuint subroutines[2] = {parameters::tint, parameters::no_filter};
-	glUniform2ui(state.open_gl.ui_shader_subroutines_index_uniform, subroutines[0], subroutines[1]);
-	//glUniformSubroutinesuiv(GL_FRAGMENT_SHADER, 2, subroutines); // must set all subroutines in one call
-
-	glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+	queue_sprite(state, sprite_instance{
+		.d_rect = { x, y, width, height },
+		.inner_color = { r, g, b },
+		.subroutines = { parameters::tint, parameters::no_filter },
+		.square = square_index(rot, flipped, rtl) }, texture_handle, 0);
 }
 
 void render_tinted_rect(
@@ -930,125 +989,75 @@ void render_tinted_rect(
 	float r, float g, float b,
 	ui::rotation rot, bool flipped, bool rtl
 ) {
-	glBindVertexArray(state.open_gl.global_square_vao);
-	bind_vertices_by_rotation(state, rot, flipped, rtl);
-	glUniform3f(state.open_gl.ui_shader_inner_color_uniform, r, g, b);
-	glUniform4f(state.open_gl.ui_shader_d_rect_uniform, x, y, width, height);
-	GLuint subroutines[2] = { parameters::tint, parameters::transparent_color };
-	glUniform2ui(state.open_gl.ui_shader_subroutines_index_uniform, subroutines[0], subroutines[1]);
-	glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+	queue_sprite(state, sprite_instance{
+		.d_rect = { x, y, width, height },
+		.inner_color = { r, g, b },
+		.subroutines = { parameters::tint, parameters::transparent_color },
+		.square = square_index(rot, flipped, rtl) }, 0, 0);
 }
 
 void render_tinted_subsprite(sys::state const& state, int frame, int total_frames, float x, float y,
 		float width, float height, float r, float g, float b, GLuint texture_handle, ui::rotation rot, bool flipped,
 		bool rtl) {
-	glBindVertexArray(state.open_gl.global_square_vao);
-
-	bind_vertices_by_rotation(state, rot, flipped, rtl);
-
 	auto const scale = 1.0f / static_cast<float>(total_frames);
-	glUniform3f(state.open_gl.ui_shader_inner_color_uniform, static_cast<float>(frame) * scale, scale, 0.0f);
-	glUniform4f(state.open_gl.ui_shader_subrect_uniform, r, g, b, 0);
-	glUniform4f(state.open_gl.ui_shader_d_rect_uniform, x, y, width, height);
-
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, texture_handle);
-
-	GLuint subroutines[2] = { parameters::alternate_tint, parameters::sub_sprite };
-	glUniform2ui(state.open_gl.ui_shader_subroutines_index_uniform, subroutines[0], subroutines[1]);
-	//glUniformSubroutinesuiv(GL_FRAGMENT_SHADER, 2, subroutines); // must set all subroutines in one call
-
-	glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+	queue_sprite(state, sprite_instance{
+		.d_rect = { x, y, width, height },
+		.subrect = { r, g, b, 0.0f },
+		.inner_color = { static_cast<float>(frame) * scale, scale, 0.0f },
+		.subroutines = { parameters::alternate_tint, parameters::sub_sprite },
+		.square = square_index(rot, flipped, rtl) }, texture_handle, 0);
 }
 
 void render_subsprite(sys::state const& state, color_modification enabled, int frame, int total_frames, float x, float y,
 		float width, float height, GLuint texture_handle, ui::rotation r, bool flipped, bool rtl) {
-	glBindVertexArray(state.open_gl.global_square_vao);
-
-	bind_vertices_by_rotation(state, r, flipped, rtl);
-
 	auto const scale = 1.0f / static_cast<float>(total_frames);
-	glUniform3f(state.open_gl.ui_shader_inner_color_uniform, static_cast<float>(frame) * scale, scale, 0.0f);
-	glUniform4f(state.open_gl.ui_shader_d_rect_uniform, x, y, width, height);
-
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, texture_handle);
-
-	GLuint subroutines[2] = {map_color_modification_to_index(enabled), parameters::sub_sprite};
-	glUniform2ui(state.open_gl.ui_shader_subroutines_index_uniform, subroutines[0], subroutines[1]);
-	//glUniformSubroutinesuiv(GL_FRAGMENT_SHADER, 2, subroutines); // must set all subroutines in one call
-
-	glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+	queue_sprite(state, sprite_instance{
+		.d_rect = { x, y, width, height },
+		.inner_color = { static_cast<float>(frame) * scale, scale, 0.0f },
+		.subroutines = { map_color_modification_to_index(enabled), parameters::sub_sprite },
+		.square = square_index(r, flipped, rtl) }, texture_handle, 0);
 }
 void render_rect_slice(sys::state const& state, float x, float y, float width, float height, GLuint texture_handle, float start_slice, float end_slice) {
-	glBindVertexArray(state.open_gl.global_square_vao);
-
-	bind_vertices_by_rotation(state, ui::rotation::upright, false, false);
-
-	glUniform3f(state.open_gl.ui_shader_inner_color_uniform, start_slice, end_slice - start_slice, 0.0f);
-	glUniform4f(state.open_gl.ui_shader_d_rect_uniform, x + width * start_slice, y, width * (end_slice - start_slice), height);
-
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, texture_handle);
-
-	GLuint subroutines[2] = { map_color_modification_to_index(color_modification::none), parameters::sub_sprite };
-	glUniform2ui(state.open_gl.ui_shader_subroutines_index_uniform, subroutines[0], subroutines[1]);
-	//glUniformSubroutinesuiv(GL_FRAGMENT_SHADER, 2, subroutines); // must set all subroutines in one call
-
-	glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+	queue_sprite(state, sprite_instance{
+		.d_rect = { x + width * start_slice, y, width * (end_slice - start_slice), height },
+		.inner_color = { start_slice, end_slice - start_slice, 0.0f },
+		.subroutines = { map_color_modification_to_index(color_modification::none), parameters::sub_sprite } }, texture_handle, 0);
 }
 
-
 void render_text_icon(sys::state& state, text::embedded_icon ico, float x, float baseline_y, float font_size, text::font& f, ogl::color_modification cmod) {
 	float scale = 1.f;
 	float icon_baseline = baseline_y + (f.retrieve_instance(state, int32_t(font_size)).ascender(state)) - font_size;
 
-	bind_vertices_by_rotation(state, ui::rotation::upright, false, false);
-	glActiveTexture(GL_TEXTURE0);
-
+	GLuint icon = 0;
 	switch(ico) {
 	case text::embedded_icon::check:
-		glBindTexture(GL_TEXTURE_2D, state.open_gl.checkmark_icon_tex);
+		icon = state.open_gl.checkmark_icon_tex;
 		icon_baseline += font_size * 0.1f;
 		break;
 	case text::embedded_icon::xmark:
-	{
-		GLuint false_icon = state.open_gl.cross_icon_tex;
-		glBindTexture(GL_TEXTURE_2D, false_icon);
+		icon = state.open_gl.cross_icon_tex;
 		icon_baseline += font_size * 0.1f;
 		break;
-	} case text::embedded_icon::xmark_desaturated:
-	{
-		GLuint false_icon = state.open_gl.cross_desaturated_icon_tex;
-		glBindTexture(GL_TEXTURE_2D, false_icon);
+	case text::embedded_icon::xmark_desaturated:
+		icon = state.open_gl.cross_desaturated_icon_tex;
 		icon_baseline += font_size * 0.1f;
 		break;
-	} case text::embedded_icon::check_desaturated:
-	{
-		GLuint false_icon = state.open_gl.checkmark_desaturated_icon_tex;
-		glBindTexture(GL_TEXTURE_2D, false_icon);
+	case text::embedded_icon::check_desaturated:
+		icon = state.open_gl.checkmark_desaturated_icon_tex;
 		icon_baseline += font_size * 0.1f;
 		break;
 	}
-	}
 
-	GLuint icon_subroutines[2] = { map_color_modification_to_index(cmod), parameters::no_filter };
-	glUniform2ui(state.open_gl.ui_shader_subroutines_index_uniform, icon_subroutines[0], icon_subroutines[1]);
-	//glUniformSubroutinesuiv(GL_FRAGMENT_SHADER, 2, icon_subroutines); // must set all subroutines in one call
-	glUniform4f(state.open_gl.ui_shader_d_rect_uniform, x, icon_baseline, scale * font_size, scale * font_size);
-	glUniform4f(state.open_gl.ui_shader_subrect_uniform, 0.f, 1.f, 0.f, 1.f);
-	glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+	queue_sprite(state, sprite_instance{
+		.d_rect = { x, icon_baseline, scale * font_size, scale * font_size },
+		.subrect = { 0.f, 1.f, 0.f, 1.f },
+		.subroutines = { map_color_modification_to_index(cmod), parameters::no_filter } }, icon, 0);
 }
 
+// queues a copy of glyph for each glyph of the text, with its rectangle and its place on the atlas filled in
 void text_render(
-	FT_Library lib,
-	GLuint square_buffer,
-	float ui_scale,
-	GLuint ui_shader_subroutines_index_uniform,
-	unsigned int subroutine_1,
-	unsigned int subroutine_2,
-	GLuint ui_shader_d_rect_uniform,
-	GLuint ui_shader_subrect_uniform,
+	sys::state const& state,
+	sprite_instance glyph,
 	const std::vector<text::stored_glyph>& glyph_info,
 	unsigned int glyph_count,
 	float x,
@@ -1056,10 +1065,8 @@ void text_render(
 	float size,
 	text::font& f
 ) {
-	glBindVertexBuffer(0, square_buffer, 0, sizeof(GLfloat) * 4);
-	glUniform2ui(ui_shader_subroutines_index_uniform, subroutine_1, subroutine_2);
-
-	auto& font_instance = f.retrieve_stateless_instance(lib, int32_t(size * ui_scale));
+	auto ui_scale = state.user_settings.ui_scale;
+	auto& font_instance = f.retrieve_stateless_instance(state.font_collection.ft_library, int32_t(size * ui_scale));
 
 	x = std::floor(x * ui_scale);
 	baseline_y = std::floor(baseline_y * ui_scale);
@@ -1086,6 +1093,7 @@ void text_render(
 			pixel_x_off = trunc_pixel_x_off + 1.0f;
 		}
 
+		// may add the glyph to an atlas sheet, which only writes to the part of the sheet no queued glyph samples
 		font_instance.make_glyph(uint16_t(glyphid), subpixel);
 		auto& gso = font_instance.get_glyph(uint16_t(glyphid), subpixel);
 		float x_advance = float(glyph_info[i].x_advance) / text::fixed_to_fp;
@@ -1094,16 +1102,15 @@ void text_render(
 			float x_offset = pixel_x_off + float(gso.bitmap_left);
 			float y_offset = float(-gso.bitmap_top) - float(glyph_info[i].y_offset) / text::fixed_to_fp;
 
-			glActiveTexture(GL_TEXTURE0);
-			glBindTexture(GL_TEXTURE_2D, font_instance.textures[gso.tx_sheet]);
-
-			glUniform4f(ui_shader_d_rect_uniform, x_offset / ui_scale, (baseline_y + y_offset) / ui_scale, float(gso.width) / ui_scale, float(gso.height) / ui_scale);
-			glUniform4f(ui_shader_subrect_uniform, float(gso.x) / float(1024) /* x offset */,
-					float(gso.width) / float(1024) /* x width */, float(gso.y) / float(1024) /* y offset */,
-					float(gso.height) / float(1024) /* y height */
-			);
-
-			glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+			glyph.d_rect[0] = x_offset / ui_scale;
+			glyph.d_rect[1] = (baseline_y + y_offset) / ui_scale;
+			glyph.d_rect[2] = float(gso.width) / ui_scale;
+			glyph.d_rect[3] = float(gso.height) / ui_scale;
+			glyph.subrect[0] = float(gso.x) / float(1024); /* x offset */
+			glyph.subrect[1] = float(gso.width) / float(1024); /* x width */
+			glyph.subrect[2] = float(gso.y) / float(1024); /* y offset */
+			glyph.subrect[3] = float(gso.height) / float(1024); /* y height */
+			queue_sprite(state, glyph, font_instance.textures[gso.tx_sheet], 0);
 		}
 
 		x += x_advance;
@@ -1112,17 +1119,13 @@ void text_render(
 }
 
 void render_new_text(sys::state& state, text::stored_glyphs const& txt, color_modification enabled, float x, float y, float size, color3f const& c, text::font& f) {
-	glUniform3f(state.open_gl.ui_shader_inner_color_uniform, c.r, c.g, c.b);
-	glUniform1f(state.open_gl.ui_shader_border_size_uniform, 0.08f * 16.0f / size);
 	text_render(
-		state.font_collection.ft_library,
-		state.open_gl.global_square_buffer,
-		state.user_settings.ui_scale,
-		state.open_gl.ui_shader_subroutines_index_uniform,
-		map_color_modification_to_index(enabled),
-		ogl::parameters::subsprite_b,
-		state.open_gl.ui_shader_d_rect_uniform,
-		state.open_gl.ui_shader_subrect_uniform,
+		state,
+		sprite_instance{
+			.inner_color = { c.r, c.g, c.b },
+			.border_size = 0.08f * 16.0f / size,
+			.subroutines = { map_color_modification_to_index(enabled), ogl::parameters::subsprite_b },
+			.square = square_index(ui::rotation::upright, false, false) },
 		txt.glyph_info,
 		static_cast<unsigned int>(txt.glyph_info.size()),
 		x,
@@ -1323,6 +1326,7 @@ GLuint load_texture_array_from_file(simple_fs::file& file, int32_t tiles_x, int3
 }
 
 void render_capture::ready(sys::state& state) {
+	flush_sprites(state);
 	if(state.x_size > max_x || state.y_size > max_y) {
 		max_x = std::max(max_x, state.x_size);
 		max_y = std::max(max_y, state.y_size);
@@ -1376,6 +1380,7 @@ void render_capture::ready(sys::state& state) {
 	}
 }
 void render_capture::finish(sys::state& state) {
+	flush_sprites(state);
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 GLuint render_capture::get() {
@@ -1388,16 +1393,10 @@ render_capture::~render_capture() {
 		glDeleteFramebuffers(1, &framebuffer);
 }
 void render_subrect(sys::state const& state, float target_x, float target_y, float target_width, float target_height, float source_x, float source_y, float source_width, float source_height, GLuint texture_handle) {
-	bind_vertices_by_rotation(state, ui::rotation::upright, false, false);
-	GLuint subroutines[2] = { parameters::enabled, parameters::subsprite_c };
-	glUniform2ui(state.open_gl.ui_shader_subroutines_index_uniform, subroutines[0], subroutines[1]);
-
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, texture_handle);
-
-	glUniform4f(state.open_gl.ui_shader_d_rect_uniform, target_x, target_y, target_width, target_height);
-	glUniform4f(state.open_gl.ui_shader_subrect_uniform, source_x /* x offset */, source_width /* x width */, source_y /* y offset */, source_height /* y height */);
-	glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+	queue_sprite(state, sprite_instance{
+		.d_rect = { target_x, target_y, target_width, target_height },
+		.subrect = { source_x /* x offset */, source_width /* x width */, source_y /* y offset */, source_height /* y height */ },
+		.subroutines = { parameters::enabled, parameters::subsprite_c } }, texture_handle, 0);
 }
 
 void animation::start_animation(sys::state& state, int32_t x, int32_t y, int32_t w, int32_t h, type t, int32_t runtime) {
@@ -1536,11 +1535,13 @@ void animation::render(sys::state& state) {
 	}
 }
 
-scissor_box::scissor_box(sys::state const& state, int32_t x, int32_t y, int32_t w, int32_t h) : x(x), y(y), w(w), h(h) {
+scissor_box::scissor_box(sys::state const& state, int32_t x, int32_t y, int32_t w, int32_t h) : state(state), x(x), y(y), w(w), h(h) {
+	flush_sprites(state);
 	glEnable(GL_SCISSOR_TEST);
 	glScissor(int32_t(x * state.user_settings.ui_scale), int32_t((state.ui_state.root->base_data.size.y - h - y) * state.user_settings.ui_scale), int32_t(w * state.user_settings.ui_scale), int32_t(h * state.user_settings.ui_scale));
 }
 scissor_box::~scissor_box() {
+	flush_sprites(state);
 	glDisable(GL_SCISSOR_TEST);
 }
 
@@ -112,6 +112,59 @@ inline void debug_callback(GLenum source, GLenum type, GLuint id, GLenum severit
 #endif
 }
 
+// batched sprites
+//
+// the render_* functions below that draw a single rectangle through the ui shader do not draw it. they append a
+// sprite_instance holding what they would have set as uniforms to a buffer, and flush_sprites draws the buffer with
+// one instanced draw for each run of consecutive sprites that sample the same textures (a sprite that samples none
+// joins any run). the vertex shader takes the rectangle, the subrect, the colors and the subroutines from the
+// instance attributes, and the vertices from a copy of the rotated, flipped or mirrored square it would have been drawn
+// with
+//
+// render_new_text queues each glyph in the same way, sampling the atlas sheet it is on, so that a run of text costs
+// one draw per sheet rather than one per glyph
+//
+// the instances are copied into a buffer that stays mapped for the life of the program. it is divided into segments,
+// and a flush writes to the current segment, moving on to the next when it does not fit; a fence set when the
+// drawing leaves a segment is waited on before it is written to again, by which time the gpu has long finished with it
+//
+// whatever changes how the queued sprites would be drawn (the scissor box, the framebuffer, the screen size uniforms)
+// or draws through the ui shader in some other way must call flush_sprites first. the functions in this file do so
+// themselves, and state::render flushes at the end of the frame. a texture must not be deleted while a sprite that
+// samples it is still queued
+
+struct sprite_instance {
+	float d_rect[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	float subrect[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	float inner_color[3] = { 0.0f, 0.0f, 0.0f };
+	float border_size = 0.0f; // read together with inner_color as one attribute
+	GLuint subroutines[2] = { 0, 0 };
+	GLuint square = 0; // see square_index
+	GLuint padding = 0;
+};
+static_assert(sizeof(sprite_instance) == 64);
+
+struct sprite_run {
+	uint32_t first = 0;
+	uint32_t count = 0;
+	GLuint texture = 0; // 0 when no sprite in the run samples it
+	GLuint secondary_texture = 0;
+};
+
+struct sprite_batch {
+	static constexpr uint32_t segment_size = 8192; // instances
+	static constexpr uint32_t segment_count = 4;
+
+	std::vector<sprite_instance> instances;
+	std::vector<sprite_run> runs;
+	GLuint vao = 0;
+	GLuint buffer = 0;
+	sprite_instance* mapped = nullptr; // the whole buffer, persistently and coherently
+	uint32_t head = 0; // the next free instance in the buffer
+	uint32_t segment = 0; // the segment head is in
+	GLsync fences[segment_count] = { };
+};
+
 struct data {
 	tagged_vector<texture, dcon::texture_id> asset_textures;
 	ankerl::unordered_dense::map<std::string, dcon::texture_id> late_loaded_map;
@@ -134,6 +187,8 @@ struct data {
 	GLuint ui_shader_screen_width_uniform = 0;
 	GLuint ui_shader_screen_height_uniform = 0;
 	GLuint ui_shader_gamma_uniform = 0;
+	GLuint ui_shader_batched_uniform = 0;
+	GLuint ui_shader_square_vertices_uniform = 0;
 
 	GLuint global_square_vao = 0;
 	GLuint global_square_buffer = 0;
@@ -150,6 +205,8 @@ struct data {
 	GLuint global_rtl_square_right_flipped_buffer = 0;
 	GLuint global_rtl_square_left_flipped_buffer = 0;
 
+	mutable sprite_batch sprites; // queued by the render functions, which only see a const state
+
 	GLuint money_icon_tex = 0;
 	GLuint cross_icon_tex = 0;
 	GLuint cross_desaturated_icon_tex = 0;
@@ -186,6 +243,13 @@ GLuint create_program(std::string_view vertex_shader, std::string_view fragment_
 GLuint create_program(std::string_view vertex_shader, std::string_view tes_control_shader, std::string_view tes_eval_shader, std::string_view fragment_shader, bool debug_geom_shader);
 void load_shaders(sys::state& state);
 void load_global_squares(sys::state& state);
+void load_sprite_batch(sys::state& state);
+
+// which of the twelve squares bind_vertices_by_rotation chooses between
+uint32_t square_index(ui::rotation r, bool flipped, bool rtl);
+// texture and secondary_texture are 0 if the sprite does not sample them
+void queue_sprite(sys::state const& state, sprite_instance const& sprite, GLuint texture, GLuint secondary_texture);
+void flush_sprites(sys::state const& state);
 
 class bezier_path {
 public:
@@ -356,6 +420,7 @@ void set_gltex_parameters(GLuint texture_handle, GLuint texture_type, GLuint fil
 GLuint load_texture_array_from_file(simple_fs::file& file, int32_t tiles_x, int32_t tiles_y);
 
 struct scissor_box {
+	sys::state const& state;
 	const int32_t x;
 	const int32_t y;
 	const int32_t w;
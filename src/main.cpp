@@ -14,10 +14,23 @@
 #include "gui_graphics.cpp"
 #include "game_scene.cpp"
 #include "commands.cpp"
+#include "circuit.cpp"
+#include "netlist.cpp"
+#include "simulation.cpp"
+#include "lane_simulation.cpp"
+#include "module.cpp"
+#include "logic_tables.cpp"
+#include "spatial_index.cpp"
+#include "selection.cpp"
+#include "journal.cpp"
+#include "board_save.cpp"
+#include "autosave.cpp"
+#include "state_hash.cpp"
 #include "gui_element_base.cpp"
 #include "gui_other.cpp"
 #include "platform_specific.cpp"
 #include "opengl_wrapper.cpp"
+#include "board_renderer.cpp"
 #include "prng.cpp"
 #include "blake2.cpp"
 #include "asvg.cpp"